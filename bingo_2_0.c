@@ -2,18 +2,35 @@
 // GAME DESCRIPTION                                                           //
 ////////////////////////////////////////////////////////////////////////////////
 // This program implements a multiplayer Bingo game using socket programming.//
-// Players connect via TCP sockets, take turns marking numbers on a 5x5 grid,//
+// Players connect via TCP sockets, take turns marking numbers on an NxN grid //
 // and compete to achieve a full row, column, or diagonal of marked numbers. //
 // The game tracks win/loss history and supports two players.                //
 ///////////////////////////////////////////////////////////////////////////////
 
+#define _GNU_SOURCE
 #include <arpa/inet.h>
+#include <ifaddrs.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 // HEADER                                                                     //
@@ -43,35 +60,760 @@ char PLAYER_2_IP_ADDRESS[] = "127.0.0.1";// CHANGE FOR CONTINUOUS PLAY WITH SAME
 ////////////////////////////////////////////////////////////////////////////////
 // MACROS FOR BINGO GAME                                                      //
 ////////////////////////////////////////////////////////////////////////////////
-#define BINGO_CARD_SIZE 5      // Size of the Bingo card (5x5 grid)
-#define ROW BINGO_CARD_SIZE    // Number of rows in the grid
-#define COL BINGO_CARD_SIZE    // Number of columns in the grid
+#define BINGO_CARD_SIZE 5      // Default size of the Bingo card (5x5 grid)
+#define ROW BINGO_CARD_SIZE    // Number of rows in the default grid
+#define COL BINGO_CARD_SIZE    // Number of columns in the default grid
+#define CARD_CELLS (ROW*COL)   // Cells on a default card, one bit each in a mask
+#define CARD_LINES (ROW+COL+2) // Rows, columns and both diagonals
+#define MAX_NUMBER CARD_CELLS  // Numbers on a default card run from 1 to MAX_NUMBER
+#define MIN_CARD_SIZE 3        // Smallest N for an N x N card
+#define MAX_CARD_SIZE 64       // Largest N, so a row fits in one 64-bit word
+#define MAX_CARD_CELLS (MAX_CARD_SIZE*MAX_CARD_SIZE) // Cells on the largest card
+#define MAX_CARD_NUMBER 65535  // Largest number range (16-bit on the wire)
+#define LINES_TO_WIN(card) ((card)->size) // Completed lines needed for BINGO
+
+////////////////////////////////////////////////////////////////////////////////
+// MACROS FOR TERMINAL RENDERER                                               //
+////////////////////////////////////////////////////////////////////////////////
+#define RENDER_BUFFER_SIZE 4096 // Smallest frame buffer, enough for a 5x5 card
+#define RENDER_CELL_BYTES 10   // Cursor move to one cell, on top of its digits
+#define RENDER_ROW_BYTES 8     // Cursor move to one grid row in a full redraw
+#define RENDER_FRAME_SLACK 128 // Screen clear, scroll region and status row
+#define GRID_TOP_ROW 2         // Screen row of the first grid row
+
+////////////////////////////////////////////////////////////////////////////////
+// MACROS FOR GAME SERVER                                                     //
+////////////////////////////////////////////////////////////////////////////////
+#define JOIN_GAME_SERVER 3     // Menu choice for joining a dedicated server
+#define WATCH_GAME_SERVER 4    // Menu choice for watching a match on a server
+#define SERVER_MAX_EVENTS 256  // Events handled per epoll_wait call
+#define SERVER_BACKLOG 4096    // Pending connections queued by listen()
+#define SERVER_OUT_FRAMES 64   // Queued output frames before a consumer is slow
+#define SERVER_MAX_SHARDS 256  // Upper bound on event loop threads (--threads)
+#define SHARD_REBALANCE_SLACK 16 // Extra rooms a shard holds before new matches move
+
+////////////////////////////////////////////////////////////////////////////////
+// MACROS FOR SERVER METRICS                                                  //
+////////////////////////////////////////////////////////////////////////////////
+#define METRICS_HIST_LINEAR 16 // Latency buckets of one nanosecond each
+#define METRICS_HIST_STEPS 8   // Buckets per power of two above that (12.5% wide)
+#define METRICS_HIST_BUCKETS (METRICS_HIST_LINEAR + 27*METRICS_HIST_STEPS) // Up to ~2 s
+#define METRICS_REPLY_SIZE 65536 // Text of one scrape, every shard included
+#define METRICS_SEND_TIMEOUT 100 // Milliseconds a scraper gets to take its reply
+#define METRIC_ADD(server,field,n) __atomic_store_n(&(server)->metrics.field, \
+        (server)->metrics.field + (n), __ATOMIC_RELAXED) // Only the shard writes
+#define CLOSE_HANGUP 0         // Client closed its socket
+#define CLOSE_SOCKET_ERROR 1   // read() or write() failed, e.g. connection reset
+#define CLOSE_PROTOCOL 2       // Corrupt or oversized frame
+#define CLOSE_SLOW 3           // A player's output queue overflowed
+#define CLOSE_OPPONENT 4       // The other side of the match left
+#define CLOSE_EXPIRED 5        // A dropped player did not resume in time
+#define CLOSE_REFUSED 6        // Nothing to watch, unknown token or too old for the hall
+#define CLOSE_REPLACED 7       // Seat taken back by the player's new connection
+#define CLOSE_NO_MEMORY 8      // Allocation failure
+#define CLOSE_REASONS 9        // Number of CLOSE_* reasons
+
+////////////////////////////////////////////////////////////////////////////////
+// MACROS FOR CALLER HALL                                                     //
+////////////////////////////////////////////////////////////////////////////////
+#define HALL_SEAT 0            // MSG_PAIRED role of a card holder in a caller hall
+#define HALL_MIN_VERSION 4     // Protocol version needed to hold a hall card
+#define HALL_CALLER_NAME "Caller" // Opponent name shown to hall players
+#define MAX_CALL_INTERVAL 60000 // Largest accepted --caller interval (ms)
+
+////////////////////////////////////////////////////////////////////////////////
+// MACROS FOR CLIENT EVENT LOOP                                               //
+////////////////////////////////////////////////////////////////////////////////
+#define TURN_TIMEOUT 60        // Default seconds per move, 0 turns the limit off
+#define MAX_TURN_TIMEOUT 3600  // Largest accepted --turn-timeout
+#define HEARTBEAT_INTERVAL 5   // Seconds of silence before sending MSG_PING
+#define HEARTBEAT_TIMEOUT 15   // Seconds without any frame before the peer is dead
+#define INPUT_BUFFER_SIZE 256  // Typed-ahead input kept until it is our turn
+#define REMATCH_MIN_VERSION 6  // Protocol version needed to rematch on one connection
+
+////////////////////////////////////////////////////////////////////////////////
+// MACROS FOR GAME HISTORY                                                    //
+////////////////////////////////////////////////////////////////////////////////
+#define HISTORY_LOG_PATH "/tmp/bingo_2_0_history.bin"   // Append-only record log
+#define HISTORY_INDEX_PATH "/tmp/bingo_2_0_history.idx" // Per-player summaries
+#define HISTORY_LEGACY_WIN_PATH "/tmp/bingo_2_0_win_status.bin"   // Text, pre-log
+#define HISTORY_LEGACY_LOSE_PATH "/tmp/bingo_2_0_lose_status.bin" // Text, pre-log
+#define HISTORY_MAGIC 0x32544948474e4942ull // "BINGHIT2" in the index header
+#define HISTORY_MIN_SLOTS 65536 // Hash slots of a new index (power of two)
+#define HISTORY_FILL_PERCENT 75 // Slots in use before the index doubles
+#define HISTORY_INDEX_SIZE(slots) (sizeof(struct history_index) + (slots) * sizeof(struct history_entry))
+#define HISTORY_RECENT 10      // Records shown by FETCH
+
+////////////////////////////////////////////////////////////////////////////////
+// MACROS FOR WIRE PROTOCOL                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Every message is a 4 byte header followed by `length` payload bytes:       //
+//   version (1 byte) | type (1 byte) | length (2 bytes, network order)       //
+// Receivers skip types they do not know, so either side can be upgraded      //
+// first; both sides speak the lower version announced in MSG_HELLO.          //
+////////////////////////////////////////////////////////////////////////////////
+#define PROTOCOL_VERSION 8     // Highest protocol version this build speaks
+#define FRAME_HEADER_SIZE 4    // Version, type and 16-bit payload length
+#define FRAME_MAX_PAYLOAD 1020 // Largest payload accepted by the decoder
+#define FRAME_DECODER_SIZE (FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD)
+#define MSG_HELLO 1            // Payload: nick name
+#define MSG_MOVE 2             // Payload: called number (16-bit)
+#define MSG_WIN 3              // Payload: winning number (16-bit)
+#define MSG_QUIT 4             // Payload: empty
+#define MSG_PAIRED 5           // Payload: role (1 byte) + opponent name
+#define MSG_CONFIG 6           // Payload: card size (1 byte) + max number (16-bit), v2+
+                               //          + turn timeout in seconds (16-bit), v3+
+#define MSG_PING 7             // Payload: empty, heartbeat while idle, v3+
+#define MSG_TIMEOUT 8          // Payload: empty, sender ran out of time, v3+
+#define MSG_CARD 9             // Payload: card seed (64-bit), caller hall, v4+;
+                               //          own card once a match is decided, v8+
+#define MSG_CALL 10            // Payload: called number (16-bit), caller hall, v4+
+#define MSG_LINES 11           // Payload: lines (16-bit) + BINGO flag (1 byte), v4+
+#define MSG_ROUND_END 12       // Payload: calls (16-bit) + winners (16-bit) + names, v4+
+#define MSG_WATCH 13           // Payload: nick name of a player, empty for any, v5+
+#define MSG_WATCHING 14        // Payload: size (1 byte) + max number (16-bit) + names, v5+
+#define MSG_PLAYED 15          // Payload: seat (1 byte) + relayed frame, v5+
+#define MSG_SNAPSHOT 16        // Payload: numbers called so far (16-bit each), v5+
+#define MSG_REMATCH 17         // Payload: empty, ready for another match, v6+
+#define MSG_TOKEN 18           // Payload: resume token (64-bit) of the seat, v7+
+#define MSG_RESUME 19          // Payload: token (64-bit) from a returning player, or
+                               //          calls (16-bit) from the host + MSG_SNAPSHOT, v7+
+#define FRAME_NEED_MORE 0      // Decoder holds only part of a frame
+#define FRAME_READY 1          // Decoder produced a frame
+#define FRAME_ERROR -1         // Stream is corrupt or the peer closed
+
+////////////////////////////////////////////////////////////////////////////////
+// STRUCTURES FOR BINGO GAME                                                  //
+////////////////////////////////////////////////////////////////////////////////
+struct bingo_rng{
+    uint64_t state[4];                   // xoshiro256** state
+};
+
+struct bingo_card{                       // Not copied by value: arrays may be inline
+    int size;                            // Cells per row and per column (N)
+    int max_number;                      // Numbers run from 1 to max_number
+    uint32_t marked;                     // 5x5 cards: bit i set once cell i is marked
+    uint64_t *marked_rows;               // Other sizes: one word of marks per row
+    uint16_t *cells;                     // Number printed in each cell
+    uint16_t *cell_of;                   // Cell + 1 holding each number, 0 if none
+    void *storage;                       // Heap block behind the arrays, if any
+    uint16_t classic_cells[CARD_CELLS];  // Inline arrays for default cards
+    uint16_t classic_cell_of[MAX_NUMBER+1];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION DECLARATIONS FOR BINGO CARD ENGINE                                //
+////////////////////////////////////////////////////////////////////////////////
+int  bingo_card_init(struct bingo_card *,int,int);     // Sizes card, N and range
+void bingo_card_free(struct bingo_card *);             // Releases heap arrays
+void bingo_card_clear(struct bingo_card *);            // Empties card and marks
+int  bingo_card_marked(const struct bingo_card *,int); // Is the cell marked
+int  bingo_card_cell_score(const struct bingo_card *,int); // Progress of cell lines
+int  valid_card_config(int,int);                       // Checks size and range
+void bingo_card_set(struct bingo_card *,int,int);      // Places number in cell
+int  bingo_card_mark(struct bingo_card *,int);         // Marks number, O(1)
+void bingo_card_copy_marks(struct bingo_card *,const struct bingo_card *); // Same card
+int  bingo_card_lines(const struct bingo_card *);      // Counts completed lines
+int  bingo_card_number(const struct bingo_card *,int); // Cell value, 0 if marked
+void bingo_card_generate(struct bingo_card *,uint64_t);// Builds card from seed
+void     bingo_rng_seed(struct bingo_rng *,uint64_t);  // Expands a 64-bit seed
+uint64_t bingo_rng_next(struct bingo_rng *);           // Next 64 random bits
+uint32_t bingo_rng_below(struct bingo_rng *,uint32_t); // Uniform in [0, n)
 
 ////////////////////////////////////////////////////////////////////////////////
 // FUNCTION DECLARATIONS FOR BINGO GAME                                       //
 ////////////////////////////////////////////////////////////////////////////////
 void display_grid(void);              // Displays the current Bingo grid
+void display_grid_changes(void);      // Redraws only cells that changed
 int  mark_number(int);                // Marks a number on the grid and checks for win
 int  check_for_win(void);             // Checks if the player has won
-int  is_number_duplicate(int);        // Checks if a number is already in the grid
-int  generate_random_number(void);    // Generates a unique random number for the grid
+uint64_t new_card_seed(void);         // Picks a fresh seed for the next card
 void clear_terminal_lines(int);       // Clears specified number of lines in terminal
 void display_loading_quote(void);     // Displays a loading quote with animation
 void initialize_bingo_game();         // Initializes the Bingo game grid
+void deal_bingo_card(void);           // Builds and draws the card of card_seed
 int  send_to_bingo(int);              // Sends a number to the Bingo grid and checks win
 
+////////////////////////////////////////////////////////////////////////////////
+// STRUCTURES FOR TERMINAL RENDERER                                           //
+////////////////////////////////////////////////////////////////////////////////
+struct terminal_renderer{
+    char *frame;                         // Frame built before the single write()
+    size_t capacity;                     // Bytes allocated for frame
+    size_t len;                          // Bytes used in frame
+    uint16_t shown[MAX_CARD_CELLS];      // Number currently on screen per cell
+    int shown_lines;                     // Line count currently on status row
+    int row_step;                        // Screen rows per grid row
+    int cell_width;                      // Screen columns per cell
+    int status_row;                      // Screen row of lines cleared / BINGO
+    int active;                          // Grid drawn and scroll region set
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION DECLARATIONS FOR TERMINAL RENDERER                                //
+////////////////////////////////////////////////////////////////////////////////
+int  render_reserve(size_t);          // Grows the frame buffer
+void render_append(const char *,...); // Adds formatted bytes to the frame
+void render_status(void);             // Writes the status row into the frame
+void render_flush(void);              // Sends the frame with one write()
+void render_release(void);            // Gives the whole screen back to stdout
+
 ////////////////////////////////////////////////////////////////////////////////
 // FUNCTION DECLARATIONS FOR SOCKET PROGRAMMING                               //
 ////////////////////////////////////////////////////////////////////////////////
+struct bingo_frame;
 void handle_sigint(int);              // Handles SIGINT signal for graceful exit
 int  setup_socket(int);               // Sets up socket connection for players
 void update_game_status(int,int);     // Updates and fetches game history
+int  join_game_server(void);          // Exchanges names and role with server
+int  watch_game_server(void);         // Prints a match played on the server
+int  apply_game_config(const struct bingo_frame *); // Adopts a MSG_CONFIG card
+int  exchange_player_names(void);     // Swaps names and card config with peer
+int  agree_rematch(void);             // Asks both players for another match
+int  start_session(void);             // Menu, connection and greeting of a player
+int  read_token(void);                // Reads the resume token of our seat
+
+////////////////////////////////////////////////////////////////////////////////
+// STRUCTURES FOR CLIENT EVENT LOOP                                           //
+////////////////////////////////////////////////////////////////////////////////
+struct game_loop{
+    int peer_fd;                         // Socket of the opponent or the server
+    int my_turn;                         // Set while this player has to move
+    int prompt_shown;                    // Prompt for the current turn printed
+    int last_number;                     // Number the opponent called last
+    int turn_limit;                      // Seconds per move, 0 if unlimited
+    int heartbeat;                       // Peer sends MSG_PING (protocol v3+)
+    uint64_t turn_start;                 // When the current turn began (ms)
+    uint64_t last_sent;                  // When we last wrote a frame (ms)
+    uint64_t last_heard;                 // When a frame last arrived (ms)
+    char input[INPUT_BUFFER_SIZE];       // Typed lines not yet played
+    size_t input_len;                    // Bytes used in input
+    int input_closed;                    // Stdin reached end of file
+    int hall;                            // Holding a card in a caller hall
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION DECLARATIONS FOR CLIENT EVENT LOOP                                //
+////////////////////////////////////////////////////////////////////////////////
+void     run_game_loop(void);                                    // Plays the match
+int      game_loop_frame(struct game_loop *,const struct bingo_frame *); // Peer frame
+int      game_loop_hall_frame(struct game_loop *,const struct bingo_frame *); // Caller
+int      game_loop_line(struct game_loop *,const char *);        // Typed line
+void     game_loop_hint(const struct game_loop *);               // Typed "hint"
+int      game_loop_timers(struct game_loop *,uint64_t);          // Deadlines
+uint64_t game_loop_now(void);                                    // Monotonic ms
+
+////////////////////////////////////////////////////////////////////////////////
+// STRUCTURES FOR GAME HISTORY                                                //
+////////////////////////////////////////////////////////////////////////////////
+struct history_record{                   // One finished game, 64 bytes on disk
+    uint64_t timestamp;                  // End of the game, seconds since epoch
+    uint64_t card_seed;                  // Seed of the player's card
+    int32_t result;                      // PLAYER_WIN or PLAYER_LOSE
+    char player[20];                     // Player on this machine
+    char opponent[20];                   // Opponent's nick name
+    uint32_t reserved;                   // Zero, keeps records 64 bytes
+};
+
+struct history_entry{                    // Index slot, empty when player[0] == 0
+    char player[20];                     // Player name
+    char opponent[20];                   // Opponent, empty for player totals
+    uint32_t wins;                       // Games won
+    uint32_t losses;                     // Games lost
+};
+
+struct history_index{                    // Memory-mapped index file
+    uint64_t magic;                      // HISTORY_MAGIC
+    uint64_t indexed_records;            // Log records folded into the index
+    uint64_t total_wins;                 // Wins of every player on this machine
+    uint64_t total_losses;               // Losses of every player on this machine
+    uint64_t slot_count;                 // Hash slots, a power of two
+    uint64_t used_slots;                 // Slots holding a key
+    struct history_entry slots[];        // Open-addressing hash table
+};
+
+struct bingo_history{
+    int log_fd;                          // Record log, opened O_APPEND
+    int index_fd;                        // Index file, locked with flock()
+    struct history_index *index;         // Shared mapping of the index file
+    size_t map_size;                     // Bytes mapped, follows index->slot_count
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION DECLARATIONS FOR GAME HISTORY                                     //
+////////////////////////////////////////////////////////////////////////////////
+int  history_open(struct bingo_history *);                 // Maps log and index
+void history_close(struct bingo_history *);                // Unmaps and closes
+void history_catch_up(struct bingo_history *);             // Folds unindexed records
+void history_import_legacy(struct bingo_history *);        // Reads old text files
+void history_append(struct bingo_history *,const struct history_record *);
+void history_count(struct bingo_history *,const struct history_record *);
+int  history_map(struct bingo_history *,uint64_t);         // (Re)maps the index
+int  history_sync(struct bingo_history *);                 // Follows other writers
+int  history_grow(struct bingo_history *);                 // Doubles and rehashes
+struct history_entry *history_lookup(struct history_index *,const char *,const char *,int);
+
+////////////////////////////////////////////////////////////////////////////////
+// MACROS FOR SESSION RESUME                                                  //
+////////////////////////////////////////////////////////////////////////////////
+#define SESSION_PATH "/tmp/bingo_2_0_session_%s.bin" // Checkpoint per nick name
+#define SESSION_MAGIC 0x31535345474e4942ull // "BINGSES1" while a match is resumable
+#define RESUME_MIN_VERSION 7   // Protocol version that hands out resume tokens
+#define RESUME_GRACE 60        // Seconds a dropped match waits for its player
+#define RESUME_HELLO_MS 2000   // Time a reconnecting client has to show its token
+
+////////////////////////////////////////////////////////////////////////////////
+// STRUCTURES FOR SESSION RESUME                                              //
+////////////////////////////////////////////////////////////////////////////////
+struct session_snapshot{                 // mmap'd checkpoint of the running match
+    uint64_t magic;                      // SESSION_MAGIC once the match has started
+    uint64_t token;                      // Seat token from the host or game server
+    uint64_t card_seed;                  // Card, rebuilt with bingo_card_generate()
+    int32_t current_player;              // Role in the match (1 or 2)
+    int32_t joined_game_server;          // Played through a game server
+    int32_t card_size, max_number;       // Card config of the match
+    int32_t turn_timeout;                // Seconds per move
+    int32_t protocol_version;            // Version agreed with the opponent
+    char player_names[PLAYERS_SIZE][20]; // Both nick names
+    char host[INET_ADDRSTRLEN];          // Address of Player 1 or the game server
+    uint32_t call_count;                 // Numbers called so far; its parity is the turn
+    uint16_t calls[MAX_CARD_NUMBER];     // Called numbers in order; marks follow
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION DECLARATIONS FOR SESSION RESUME                                   //
+////////////////////////////////////////////////////////////////////////////////
+int  session_open(const char *);      // Maps the checkpoint file of a nick name
+void session_begin(void);             // Checkpoints the start of a match
+void session_record(int);             // Checkpoints one called number
+void session_finish(void);            // Drops the checkpoint of an ended match
+int  session_load(const char *);      // Adopts a checkpoint for --resume
+void session_restore(void);           // Rebuilds card and marks from the calls
+int  session_reconnect(void);         // Resumes a match after a dropped connection
+int  session_accept(int,uint64_t);    // Host: checks a token and sends the calls
+int  session_send_calls(int,const uint16_t *,int); // MSG_RESUME + MSG_SNAPSHOT
+int  session_read_calls(int,uint64_t); // Guest: adopts the host's calls
+
+////////////////////////////////////////////////////////////////////////////////
+// MACROS FOR GAME RECORDING                                                  //
+////////////////////////////////////////////////////////////////////////////////
+// A recording file is RECORD_FILE_MAGIC followed by one record per match:    //
+//   RECORD_MARK (1) | winner (1) | card size (1) | max number (2)            //
+//   | start, seconds since epoch (varint) | card seed of the first mover (8) //
+//   | card seed of the second mover (8) | calls (varint)                     //
+//   | per call: number (1 byte, 2 above 255) + ms since the last (varint)    //
+// Multi-byte fields are in network order; varints are 7 bits per byte, low   //
+// group first. A seed is 0 when it was never revealed.                       //
+////////////////////////////////////////////////////////////////////////////////
+#define RECORD_PATH "/tmp/bingo_2_0_games.rec" // Matches hosted by Player 1 here
+#define RECORD_FILE_MAGIC "BINGREC1" // First 8 bytes of a recording file
+#define RECORD_MAGIC_SIZE 8    // Bytes of RECORD_FILE_MAGIC
+#define RECORD_MARK 0xB5       // First byte of every record
+#define RECORD_FIRST_MOVER 0   // Winner byte: the player who called first won
+#define RECORD_SECOND_MOVER 1  // Winner byte: the other player won
+#define RECORD_NO_WINNER 2     // Winner byte: the match was never decided
+#define RECORD_MIN_VERSION 8   // Protocol version that reveals card seeds after a match
+#define RECORD_MAX_SIZE(calls) (40 + 7*(size_t)(calls)) // Longest encoding of a record
+#define RECORD_BUFFER_SIZE 65536 // Server: records gathered per write()
+#define RECORD_FLUSH_MS 1000   // Server: longest a record waits in the buffer
+
+////////////////////////////////////////////////////////////////////////////////
+// STRUCTURES FOR GAME RECORDING                                              //
+////////////////////////////////////////////////////////////////////////////////
+struct game_record{                      // One decoded or to-be-encoded match
+    int winner;                          // RECORD_FIRST_MOVER, _SECOND_MOVER or _NO_WINNER
+    int card_size, max_number;           // Card config of both cards
+    uint64_t start;                      // Start of the match, seconds since epoch
+    uint64_t seeds[PLAYERS_SIZE];        // Card seeds, first mover first, 0 if unknown
+    int call_count;                      // Numbers called
+    uint16_t *calls;                     // Called numbers in order
+    uint32_t *call_ms;                   // Milliseconds since the start per call
+};
+
+struct game_recorder{                    // Calls of the match played here
+    uint64_t started_ms;                 // game_loop_now() at the start
+    uint64_t started_at;                 // Wall clock at the start
+    uint64_t peer_seed;                  // Opponent's card, 0 until revealed
+    int call_count;                      // Numbers called so far
+    uint16_t calls[MAX_CARD_NUMBER];     // Called numbers in order
+    uint32_t call_ms[MAX_CARD_NUMBER];   // Milliseconds since the start per call
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION DECLARATIONS FOR GAME RECORDING                                   //
+////////////////////////////////////////////////////////////////////////////////
+size_t record_put_varint(unsigned char *,uint64_t); // 7 bits per byte
+size_t record_get_varint(const unsigned char *,size_t,uint64_t *); // Reads one
+size_t record_encode(unsigned char *,const struct game_record *); // Packs a match
+size_t record_decode(const unsigned char *,size_t,struct game_record *); // Unpacks
+int    record_open(const char *);     // Opens a recording file for appending
+void   record_start(void);            // Starts recording a new match
+void   record_call(int);              // Records one called number
+void   reveal_card_seeds(void);       // Swaps card seeds once a match is decided
+void   record_game(void);             // Host: appends the finished match
+
+////////////////////////////////////////////////////////////////////////////////
+// STRUCTURES FOR WIRE PROTOCOL                                               //
+////////////////////////////////////////////////////////////////////////////////
+struct bingo_frame{
+    int version;                         // Protocol version of the sender
+    int type;                            // MSG_* message type
+    size_t length;                       // Payload length in bytes
+    const unsigned char *payload;        // Points into the decoder buffer
+    const unsigned char *raw;            // Header start, for zero-copy relay
+};
+
+struct frame_decoder{
+    unsigned char buffer[FRAME_DECODER_SIZE]; // Bytes read from the socket
+    size_t start;                        // First byte not yet decoded
+    size_t end;                          // One past the last byte read
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION DECLARATIONS FOR WIRE PROTOCOL                                    //
+////////////////////////////////////////////////////////////////////////////////
+size_t encode_frame(unsigned char *,int,int,const void *,size_t);   // Builds frame
+size_t encode_number_frame(unsigned char *,int,int,int);            // MOVE/WIN
+size_t encode_config_frame(unsigned char *,int,int,int,int);        // MSG_CONFIG
+int    frame_number(const struct bingo_frame *);                     // Reads MOVE/WIN
+unsigned char *frame_decoder_space(struct frame_decoder *,size_t *); // Read target
+int    frame_decoder_next(struct frame_decoder *,struct bingo_frame *); // Next frame
+int    send_frame(int,int,const void *,size_t);                      // Blocking send
+int    send_number(int,int,int);                                     // Blocking MOVE
+int    send_config(int,int,int,int);                                 // Blocking CONFIG
+int    read_frame(int,struct frame_decoder *,struct bingo_frame *);  // Blocking read
+int    read_frame_until(int,struct frame_decoder *,struct bingo_frame *,uint64_t); // With deadline
+
+////////////////////////////////////////////////////////////////////////////////
+// STRUCTURES FOR GAME SERVER                                                 //
+////////////////////////////////////////////////////////////////////////////////
+struct bingo_room;
+struct bingo_hall;
+struct server_group;
+
+struct shared_frame{                     // Encoded once, queued on many sockets
+    int refs;                            // Queues and callers holding the frame
+    size_t len;                          // Encoded bytes
+    unsigned char data[];                // One or more complete frames
+};
+
+struct server_metrics{                   // Written by its shard only, read by scrapes
+    long rooms, away_rooms, connections; // Gauges published after every event batch
+    long accepted;                       // Connections accepted
+    long accepted_local;                 // Of which on the local Unix socket
+    long moves;                          // MSG_MOVE frames relayed between players
+    long reads, writes;                  // read() and write()/writev() calls
+    long bytes_read, bytes_written;      // Socket bytes in and out
+    long disconnects[CLOSE_REASONS];     // Closed connections by CLOSE_* reason
+    long move_ns[METRICS_HIST_BUCKETS];  // Move handling time, log-linear buckets
+    long move_ns_sum, move_ns_max;       // Total and slowest move handling time
+};
+
+struct bingo_connection{
+    int fd;                              // Non-blocking client socket
+    int seat;                            // PLAYER_NO_1 or PLAYER_NO_2
+    int closed;                          // Set once queued for release
+    struct bingo_room *room;             // Room this connection plays in or watches
+    struct bingo_connection *next_closed;// Link in the deferred free list
+    int version;                         // Version negotiated in MSG_HELLO
+    struct frame_decoder decoder;        // Per-connection receive buffer
+    struct shared_frame *out_queue[SERVER_OUT_FRAMES]; // Frames waiting for EPOLLOUT
+    int out_head, out_count;             // Ring position and queued frames
+    size_t out_offset;                   // Bytes of the head frame already written
+    int spectator;                       // Watches its room instead of playing
+    int lagging;                         // Dropped output, owed a snapshot
+    struct bingo_connection *watch_prev, *watch_next; // Room's spectator list
+    int moving;                          // Handed to shard `target` after this batch
+    int target;                          // Shard taking over an unseated connection
+    struct bingo_room *join_room;        // Waiting room it moves to fill, on target
+    int watching;                        // Moves to look for its match on the target
+    int hops;                            // Shards it was handed through
+    uint64_t resume_token;               // Seat it moves to take back, on target
+    struct bingo_connection *next_moved; // Link in a handoff list
+    char name[20];                       // Nick name, caller hall only
+    long hall_member;                    // Index in the hall's members, -1 if none
+    long hall_card;                      // Index of this round's card, -1 if none
+};
+
+struct bingo_room{
+    struct bingo_connection *players[PLAYERS_SIZE]; // Seated connections
+    char player_names[PLAYERS_SIZE][20];            // Names of both players
+    int name_transfer_flag;                         // One bit per named seat
+    int card_size, max_number;                      // Card config of the match
+    int turn_timeout;                               // Seconds per move of the match
+    struct bingo_connection *spectators;            // Watching connections
+    long spectator_count;                           // Length of spectators
+    uint16_t *calls;                                // Numbers called so far
+    int call_count, call_capacity;                  // Used and allocated calls
+    struct bingo_room *prev, *next;                 // Active room list
+    int expecting;                                  // A second player is on its way (lobby lock)
+    int rematch;                                    // One bit per seat asking for a rematch
+    uint64_t tokens[PLAYERS_SIZE];                  // Resume token per seat, 0 below v7
+    int decided;                                    // WIN, TIMEOUT or QUIT was relayed
+    uint64_t away_until;                            // Deadline of an empty seat, 0 if none
+    struct bingo_room *next_free;                   // Free-list link
+    uint32_t *call_ms;                              // Ms from started_ms per call (--record)
+    uint64_t started_ms, started_at;                // Match start, monotonic ms and wall clock
+    uint64_t seeds[PLAYERS_SIZE];                   // Card seeds revealed with MSG_CARD (v8+)
+    int revealed;                                   // One bit per seat that sent its seed
+    int winner;                                     // Winning seat + 1, 0 if none
+    int recorded;                                   // Match already in the recording
+};
+
+struct bingo_server{
+    int index;                           // Shard number within its group
+    struct server_group *group;          // All shards of this process
+    pthread_t thread;                    // Thread running the shard's event loop
+    int listen_fd;                       // Listening socket on PORT (SO_REUSEPORT)
+    int epoll_fd;                        // Edge-triggered event loop
+    struct bingo_room *free_rooms;       // Recycled room structures
+    struct bingo_room *rooms;            // Active rooms, searched by MSG_WATCH
+    struct bingo_connection *closed;     // Released after each event batch
+    long active_rooms;                   // Rooms with at least one player
+    long active_connections;             // Connected client sockets
+    int card_size, max_number;           // Card config sent to new rooms
+    int turn_timeout;                    // Seconds per move sent to new rooms
+    struct bingo_hall *hall;             // Caller hall, NULL unless --caller
+    long load;                           // active_rooms published for other shards
+    int inbox_fd;                        // eventfd waking the loop for handoffs
+    pthread_mutex_t inbox_lock;          // Guards inbox
+    struct bingo_connection *inbox;      // Connections handed over by other shards
+    struct bingo_connection *moving;     // Connections leaving after this batch
+    long away_rooms;                     // Rooms holding a dropped player's seat
+    struct bingo_rng rng;                // Resume tokens
+    struct server_metrics metrics;       // Counters of this shard (--metrics)
+    unsigned char *record_buffer;        // Encoded matches not yet written, NULL without --record
+    size_t record_len;                   // Bytes used in record_buffer
+    uint64_t record_since;               // game_loop_now() of the oldest buffered match
+};
+
+struct server_group{                     // Shards of one server process
+    int count;                           // Shards, one event loop thread each
+    struct bingo_server *shards;         // Owned by their threads
+    pthread_mutex_t lobby_lock;          // Guards the waiting fields, never moves
+    struct bingo_room *waiting;          // Room with one player open to anyone
+    int waiting_shard;                   // Shard owning that room
+    int metrics_fd;                      // Scrape listener on 127.0.0.1, -1 if none
+    pthread_t metrics_thread;            // Thread answering scrapes
+    int record_fd;                       // Recording file (--record), -1 if none
+    int local_fd;                        // Unix listener all shards watch, -1 if none
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION DECLARATIONS FOR GAME SERVER                                      //
+////////////////////////////////////////////////////////////////////////////////
+int  run_game_server(void);                                // Runs every shard
+void handle_server_sigint(int);                            // Stops the event loops
+void *server_shard_main(void *);                           // Thread of one shard
+void server_loop(struct bingo_server *);                   // Runs one event loop
+int  server_listen(struct bingo_server *);                 // Opens listen socket
+void server_move(struct bingo_server *,struct bingo_connection *,int); // Hands off
+void server_adopt(struct bingo_server *);                  // Takes handed conns
+void server_release_room(struct bingo_server *,struct bingo_room *);   // Frees room
+void server_accept(struct bingo_server *,int);             // Accepts connections
+int  server_seat(struct bingo_server *,struct bingo_connection *);  // Pairs
+void server_fill(struct bingo_server *,struct bingo_connection *,struct bingo_room *);
+void server_named(struct bingo_server *,struct bingo_connection *); // Pairs up
+void server_watch(struct bingo_server *,struct bingo_connection *); // Spectates
+void server_read(struct bingo_server *,struct bingo_connection *);  // Reads
+void server_frame(struct bingo_server *,struct bingo_connection *,const struct bingo_frame *);
+void server_flush(struct bingo_server *,struct bingo_connection *); // Writes
+void server_send(struct bingo_server *,struct bingo_connection *,const void *,size_t);
+void server_send_shared(struct bingo_server *,struct bingo_connection *,struct shared_frame *);
+void server_queue(struct bingo_server *,struct bingo_connection *,struct shared_frame *,size_t);
+void server_catch_up(struct bingo_server *,struct bingo_connection *); // Snapshot
+struct shared_frame *shared_frame_new(const void *,size_t); // Refcount of one
+void shared_frame_release(struct shared_frame *);          // Frees on last ref
+void server_close(struct bingo_server *,struct bingo_connection *,int); // Closes
+void server_resume(struct bingo_server *,struct bingo_connection *); // Re-seats
+void server_expire(struct bingo_server *);                 // Ends unclaimed seats
+void server_send_calls(struct bingo_server *,struct bingo_connection *,const unsigned char *,size_t,const uint16_t *,int);
+void server_add_call(struct bingo_server *,struct bingo_room *,int); // Keeps a call
+void server_record(struct bingo_server *,struct bingo_room *); // Buffers a match
+void server_record_flush(struct bingo_server *);           // Writes the buffer
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION DECLARATIONS FOR SERVER METRICS                                   //
+////////////////////////////////////////////////////////////////////////////////
+int      metrics_listen(struct server_group *,int);           // Opens scrape port
+void    *metrics_main(void *);                                // Answers scrapes
+void     metrics_append(char *,size_t,size_t *,const char *,...); // Adds text
+size_t   metrics_format(struct server_group *,char *,size_t,long *,uint64_t *); // Scrape
+void     metrics_record_move(struct bingo_server *,uint64_t); // One relayed move
+int      metrics_bucket(uint64_t);                            // Bucket of a value
+uint64_t metrics_bucket_value(int);                           // Bucket lower bound
+uint64_t metrics_percentile(const long *,long,double);        // p-th sample
+uint64_t metrics_now_ns(void);                                // Monotonic ns
+
+////////////////////////////////////////////////////////////////////////////////
+// STRUCTURES FOR CALLER HALL                                                 //
+////////////////////////////////////////////////////////////////////////////////
+struct hall_entry{                       // One cell holding a number
+    uint32_t card;                       // Card index in the round
+    uint8_t row, col;                    // Cell of the number on that card
+};
+
+struct hall_card{
+    struct bingo_connection *conn;       // Holder, NULL once disconnected
+    uint64_t seed;                       // Seed the card was dealt from
+    int lines;                           // Completed lines so far
+};
+
+struct bingo_hall{
+    int size, max_number;                // Card config of every round
+    int interval;                        // Milliseconds between calls
+    int active;                          // Round in progress
+    uint64_t next_call;                  // game_loop_now() time of the next tick
+    struct bingo_rng rng;                // Card seeds and call order
+    struct bingo_connection **members;   // Every named connection
+    long member_count, member_capacity;
+    struct hall_card *cards;             // Cards dealt this round
+    long card_count, card_capacity;
+    uint8_t *line_counts;                // 2N+2 marked counts per card
+    uint32_t *index_start;               // Entries of number n: [start[n], start[n+1])
+    struct hall_entry *entries;          // Inverted index, N*N entries per card
+    uint32_t *changed;                   // Cards whose lines changed on this call
+    uint16_t *calls;                     // Numbers, the first call_count called
+    int call_count;                      // Calls made this round
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION DECLARATIONS FOR CALLER HALL                                      //
+////////////////////////////////////////////////////////////////////////////////
+struct bingo_hall *hall_create(int,int,int);               // Empty hall
+void hall_free(struct bingo_hall *);                       // Releases a hall
+int  hall_reserve(struct bingo_hall *,long);               // Sizes round arrays
+int  hall_build_index(struct bingo_hall *);                // Deals and indexes cards
+long hall_mark(struct bingo_hall *,int);                   // Applies one call
+void hall_join(struct bingo_server *,struct bingo_connection *);  // Seats a card holder
+void hall_leave(struct bingo_server *,struct bingo_connection *); // Drops a holder
+void hall_tick(struct bingo_server *);                     // Next call or round
+void hall_start_round(struct bingo_server *);              // Deals every member
+void hall_call(struct bingo_server *);                     // Calls and reports
+
+////////////////////////////////////////////////////////////////////////////////
+// MACROS FOR HEADLESS SIMULATOR                                              //
+////////////////////////////////////////////////////////////////////////////////
+#define SIM_MAX_PLAYERS 8      // Bots that can share one simulated game
+#define SIM_MAX_THREADS 256    // Upper bound on worker threads
+#define BOT_RANDOM 0           // Calls a uniformly random open number
+#define BOT_GREEDY 1           // Calls the number that best extends a line
+
+////////////////////////////////////////////////////////////////////////////////
+// STRUCTURES FOR HEADLESS SIMULATOR                                          //
+////////////////////////////////////////////////////////////////////////////////
+struct simulation_stats{
+    long games;                          // Games played
+    long wins[SIM_MAX_PLAYERS];          // Wins by seat, seat 0 calls first
+    long shared_wins;                    // Games where more than one bot had BINGO
+    long *length;                        // Games by number of calls (max+1 slots)
+};
+
+struct simulation_worker{
+    pthread_t thread;                    // Worker thread
+    long games;                          // Games this worker plays
+    int players;                         // Bots per game
+    const int *strategies;               // BOT_* strategy of every seat
+    uint64_t seed;                       // Seed of the worker's generator
+    int record_fd;                       // Recording file (--record), -1 if none
+    struct simulation_stats stats;       // Results, merged after join
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION DECLARATIONS FOR HEADLESS SIMULATOR                               //
+////////////////////////////////////////////////////////////////////////////////
+int   run_simulation(int,char **);                              // --simulate entry
+void *simulation_worker_main(void *);                           // Worker thread
+int   simulate_game(struct bingo_card *,int,const int *,uint16_t *,struct bingo_rng *,int *,struct game_record *);
+int   bot_choose_number(const struct bingo_card *,const uint16_t *,int,int,struct bingo_rng *);
+
+////////////////////////////////////////////////////////////////////////////////
+// MACROS FOR MOVE ADVISOR                                                    //
+////////////////////////////////////////////////////////////////////////////////
+#define ADVISOR_BUDGET_MS 50   // Time the computer and a hint take per move
+#define ADVISOR_MAX_THREADS 64 // Upper bound on advisor worker threads
+#define ADVISOR_DRAW_TRIES 8   // Opponent cards drawn to find one not yet won
+#define COMPUTER_GAME 5        // Menu choice for a match against the computer
+#define BOT_NAME "Computer"    // Nick name of the computer opponent
+
+////////////////////////////////////////////////////////////////////////////////
+// STRUCTURES FOR MOVE ADVISOR                                                //
+////////////////////////////////////////////////////////////////////////////////
+struct advisor_result{
+    int number;                          // Number to call
+    double win_rate;                     // Share of its simulated finishes we won
+    long simulations;                    // Finishes simulated over all numbers
+    int candidates;                      // Open numbers weighed
+};
+
+struct advisor_worker{
+    pthread_t thread;                    // Worker thread, idle between moves
+    struct bingo_card base;              // Our card with the calls so far
+    struct bingo_card mine, theirs;      // Cards of the finish being simulated
+    uint16_t *pool;                      // Numbers still open in that finish
+    long *plays, *wins;                  // Finishes and wins by first number
+    int capacity;                        // max_number the arrays above hold
+    struct bingo_rng rng;                // Opponent cards and random calls
+};
+
+struct advisor_pool{
+    int threads;                         // Workers, one per core
+    struct advisor_worker *workers;      // Owned by their threads
+    pthread_mutex_t lock;                // Guards generation and running
+    pthread_cond_t wake, done;           // Job posted, last worker finished
+    unsigned long generation;            // Bumped for every move weighed
+    int running;                         // Workers still on the current move
+    uint64_t seed;                       // Our card: seed and config
+    int card_size, max_number;
+    const uint16_t *calls;               // Numbers called so far
+    int call_count;
+    uint16_t *open;                      // Numbers not called yet
+    int open_count;
+    uint64_t deadline;                   // game_loop_now() at which to stop
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION DECLARATIONS FOR MOVE ADVISOR                                     //
+////////////////////////////////////////////////////////////////////////////////
+int   advise_move(uint64_t,int,int,const uint16_t *,int,int,struct advisor_result *);
+void  advisor_start(void);                                      // Starts the pool
+void *advisor_worker_main(void *);                              // Worker thread
+void  advisor_prepare(struct advisor_worker *);                 // Per-move setup
+int   advisor_finish(struct advisor_worker *,int);              // One simulation
+int   start_computer_opponent(void);                            // Menu choice 5
+void *computer_opponent_main(void *);                           // Its thread
+int   run_bot(const char *);                                    // --bot entry
+int   bot_play(int,int);                                        // One session
+
+////////////////////////////////////////////////////////////////////////////////
+// MACROS FOR LOCAL TRANSPORT                                                 //
+////////////////////////////////////////////////////////////////////////////////
+#define LOCAL_SOCKET_NAME "bingo_2_0.%d" // Abstract AF_UNIX name of a port
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION DECLARATIONS FOR LOCAL TRANSPORT                                  //
+////////////////////////////////////////////////////////////////////////////////
+socklen_t transport_local_name(struct sockaddr_un *,int);        // Port's name
+int  transport_is_local(struct in_addr);                         // Our address
+int  transport_listen(int,int,int);                              // Local listener
+int  transport_connect(const struct sockaddr_in *,int *);        // Local or TCP
+int  transport_accept(int,int,int);                              // Either listener
 
 ////////////////////////////////////////////////////////////////////////////////
 // GLOBAL VARIABLES FOR BINGO GAME                                           //
 ////////////////////////////////////////////////////////////////////////////////
 int count = 0;                        // Counter for completed lines in Bingo
-int bingo_grid[ROW][COL];             // 5x5 grid for Bingo numbers
+struct bingo_card bingo_grid;         // NxN grid for Bingo numbers
+int card_size = BINGO_CARD_SIZE;      // N of the next card (--size)
+int card_max_number = MAX_NUMBER;     // Number range of the next card (--numbers)
+int turn_timeout = TURN_TIMEOUT;      // Seconds per move (--turn-timeout)
+int caller_interval = DEFAULT_STATUS; // Milliseconds per hall call (--caller)
+int server_threads = DEFAULT_STATUS;  // Server event loops, 0 for one per core (--threads)
+int metrics_port = DEFAULT_STATUS;    // Local port serving server metrics, 0 if off (--metrics)
+uint32_t card_line_masks[CARD_LINES]; // Cells of every row, column, diagonal
+struct terminal_renderer renderer;    // Screen state of the grid
+uint64_t card_seed;                   // Seed the current card was built from
+int card_seed_requested = DEFAULT_STATUS; // Set by --seed to rebuild a card
 int game_result = DEFAULT_STATUS;     // Result of the game (win/lose)
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -81,9 +823,24 @@ int current_player;                   // Current player number (1 or 2)
 char player_names[PLAYERS_SIZE][20];  // Names of both players
 int __name_transfer_flag = DEFAULT_STATUS; // Flag for name transfer between players
 int player_1_fd, player_2_fd;         // File descriptors for player sockets
+int local_listen_fd = -1;             // Player 1's listener for same-host guests
+int transport_tcp_only = DEFAULT_STATUS; // Set by --tcp to skip local sockets
 struct sockaddr_in server_address;    // Server address structure
-socklen_t addrlen = sizeof(server_address); // Length of address structure
 char communication_buffer[BUF_SIZE];                  // Buffer for data transmission
+struct frame_decoder peer_decoder;    // Frames received from the opponent
+int protocol_version = PROTOCOL_VERSION; // Version agreed with the opponent
+int joined_game_server = DEFAULT_STATUS; // Set when playing through a server
+int caller_hall = DEFAULT_STATUS;     // Set when holding a card in a caller hall
+uint64_t resume_token;                // Token of our seat, 0 if the match cannot resume
+struct session_snapshot *session;     // Checkpoint of the running match, NULL if none
+int connection_lost = DEFAULT_STATUS; // The match stopped on a dropped connection
+struct game_recorder recorder;        // Calls of the match played here
+const char *record_path;              // Recording file (--record), NULL for the default
+struct advisor_pool advisor;          // Move advisor behind hints and the computer
+int computer_game = DEFAULT_STATUS;   // Single-player match against the computer
+pthread_mutex_t advisor_lock = PTHREAD_MUTEX_INITIALIZER; // One move weighed at a time
+pthread_once_t advisor_once = PTHREAD_ONCE_INIT;          // Starts the pool on first use
+volatile sig_atomic_t server_running = SET_VALUE; // Cleared by SIGINT in server
 
 ////////////////////////////////////////////////////////////////////////////////
 // FUNCTION: handle_sigint                                                    //
@@ -94,129 +851,157 @@ char communication_buffer[BUF_SIZE];                  // Buffer for data transmi
 // Returns: void                                                              //
 ////////////////////////////////////////////////////////////////////////////////
 void handle_sigint(int sig_no){
+    render_release();
     printf("Closing connection\n");
     close(player_1_fd);
-    if(current_player == 1)close(player_2_fd);
+    if(current_player == 1 && !joined_game_server)close(player_2_fd);
     kill(getpid(),SIGTERM);
 }
+#ifndef BINGO_NO_MAIN // Tools such as bingo_bench.c include this file without main()
 ////////////////////////////////////////////////////////////////////////////////
 // FUNCTION: main                                                             //
 ////////////////////////////////////////////////////////////////////////////////
 // Description: Entry point of the program. Sets up signal handling, displays //
 //              game history, prompts for player selection, establishes       //
 //              socket connection, and manages the game loop for multiplayer  //
-//              Bingo.                                                        //
-// Parameters: void                                                           //
+//              Bingo. "--server" runs the dedicated multi-room game server;  //
+//              "--seed <hex>" rebuilds the card printed with that seed,      //
+//              "--size <N>" and "--numbers <M>" pick an N x N card with      //
+//              numbers 1..M and "--turn-timeout <s>" the time per move for   //
+//              the match hosted here; "--server --caller <ms>" turns the     //
+//              server into one caller hall calling a number every <ms>,      //
+//              "--server --threads <N>" runs N event loops (one per core by  //
+//              default), "--server --metrics <port>" serves live counters on //
+//              127.0.0.1:<port> and "--simulate" plays headless bot games on //
+//              all cores. After a match both players may agree to a rematch  //
+//              on the same connection, which starts with a fresh card at     //
+//              once. A match cut off by a dropped connection is resumed, and //
+//              "--resume <name>" takes it up again after a crash. Player 1   //
+//              appends every match to a recording, "--record <file>" picks   //
+//              the file and makes the server record its matches too. Choice  //
+//              5 plays the computer and "--bot <ip>" puts it on a server.    //
+//              Peers on one host talk over a Unix socket unless "--tcp".     //
+// Parameters: argc, argv - Command line arguments                            //
 // Returns: int - Exit status (0 for success)                                 //
 ////////////////////////////////////////////////////////////////////////////////
-int main(){
+int main(int argc, char *argv[]){
+    int server_mode = DEFAULT_STATUS, numbers = 0;
+    const char *resume_name = NULL, *bot_host = NULL;
+    if(argc > 1 && strcmp(argv[1],"--simulate") == 0)return run_simulation(argc - 2, argv + 2);
+    for(int i = 1 ; i < argc ; i++){
+        if(strcmp(argv[i],"--server") == 0)server_mode = SET_VALUE;
+        else if(i + 1 < argc && strcmp(argv[i],"--seed") == 0){
+            card_seed = strtoull(argv[++i], NULL, 16);
+            card_seed_requested = SET_VALUE;
+        }
+        else if(i + 1 < argc && strcmp(argv[i],"--size") == 0)card_size = atoi(argv[++i]);
+        else if(i + 1 < argc && strcmp(argv[i],"--numbers") == 0)numbers = atoi(argv[++i]);
+        else if(i + 1 < argc && strcmp(argv[i],"--turn-timeout") == 0)turn_timeout = atoi(argv[++i]);
+        else if(i + 1 < argc && strcmp(argv[i],"--caller") == 0)caller_interval = atoi(argv[++i]);
+        else if(i + 1 < argc && strcmp(argv[i],"--threads") == 0)server_threads = atoi(argv[++i]);
+        else if(i + 1 < argc && strcmp(argv[i],"--metrics") == 0)metrics_port = atoi(argv[++i]);
+        else if(i + 1 < argc && strcmp(argv[i],"--resume") == 0)resume_name = argv[++i];
+        else if(i + 1 < argc && strcmp(argv[i],"--record") == 0)record_path = argv[++i];
+        else if(i + 1 < argc && strcmp(argv[i],"--bot") == 0)bot_host = argv[++i];
+        else if(strcmp(argv[i],"--tcp") == 0)transport_tcp_only = SET_VALUE;
+    }
+    if(bot_host)return run_bot(bot_host);
+    card_max_number = numbers ? numbers : card_size * card_size;
+    if(!valid_card_config(card_size, card_max_number)){
+        printf("Card size must be %d-%d and numbers from size x size up to %d\n",MIN_CARD_SIZE,MAX_CARD_SIZE,MAX_CARD_NUMBER);
+        return 1;
+    }
+    if(turn_timeout < 0 || turn_timeout > MAX_TURN_TIMEOUT){
+        printf("Turn timeout must be 0 (off) to %d seconds\n",MAX_TURN_TIMEOUT);
+        return 1;
+    }
+    if(caller_interval < 0 || caller_interval > MAX_CALL_INTERVAL){
+        printf("Caller interval must be 0 (off) to %d milliseconds\n",MAX_CALL_INTERVAL);
+        return 1;
+    }
+    if(server_threads < 0 || server_threads > SERVER_MAX_SHARDS){
+        printf("Server threads must be 1 to %d, 0 for one per core\n",SERVER_MAX_SHARDS);
+        return 1;
+    }
+    if(metrics_port < 0 || metrics_port > 65535 || metrics_port == PORT){
+        printf("Metrics port must be 1 to 65535 and not %d\n",PORT);
+        return 1;
+    }
+    if(server_mode)return run_game_server();
     signal(SIGINT,handle_sigint);
-    update_game_status(game_result,FETCH);
-    printf("Select Player No :\nPlayer - 1\nPlayer - 2\nEnter choice :");
-    scanf("%d",&current_player);
-    printf("Enter Player - %d's nick name :",current_player);
-    scanf("%s",player_names[current_player-1]);
-    strcpy(communication_buffer,player_names[current_player-1]);
-    while(setup_socket(current_player))sleep(3);
-    while(1){
-        if (current_player == 1){
-            if(!__name_transfer_flag){
-                memset(player_names[PLAYER_NO_2], 0, sizeof(player_names[PLAYER_NO_2]));
-                read(player_2_fd,player_names[PLAYER_NO_2],sizeof(player_names[PLAYER_NO_2])-1);
-                write(player_2_fd,player_names[PLAYER_NO_1], strlen(player_names[PLAYER_NO_1]));
-                __name_transfer_flag = SET_VALUE;
-                continue;
-            }
-            printf("\nWating for player-2( %s )..\n",player_names[PLAYER_NO_2]);
-            memset(communication_buffer, 0, sizeof(communication_buffer));
-
-
-            ssize_t bytes_read = read(player_2_fd, communication_buffer, sizeof(communication_buffer) - 1);
-            
-            if(strncmp(communication_buffer,"-1",sizeof("-1"))==0 || (atoi(communication_buffer)==-1)){
-                printf("\n( %s )You LOST the MATCH Better Luck Next Time..\n",player_names[PLAYER_NO_1]);
-                game_result = PLAYER_LOSE;
-                break;
-            }
-            if (bytes_read <= 0 || (strncmp(communication_buffer,"exit",sizeof("exit")) == 0)) {
-                (bytes_read<0)?perror("Read failed"):printf("Player - 2 ( %s )disconnected.\n",player_names[PLAYER_NO_2]);
-                break;
-            }
-            if(!send_to_bingo(atoi(communication_buffer))){
-                memset(communication_buffer, 0, sizeof(communication_buffer));
-                strcpy(communication_buffer,"-1");
-                write(player_2_fd, communication_buffer, strlen(communication_buffer));
-                printf("\n( %s )You WON the MATCH\n",player_names[PLAYER_NO_1]);
-                game_result = PLAYER_WIN;
-                break;
-            }            
-
-            printf("Player_2 ( %s ) choosed : %s\n\nType Your No : ",player_names[PLAYER_NO_2],communication_buffer);
-            scanf("%s",communication_buffer);
-            if(!send_to_bingo(atoi(communication_buffer))){
-                memset(communication_buffer, 0, sizeof(communication_buffer));
-                strcpy(communication_buffer,"-1");
-                write(player_2_fd, communication_buffer, strlen(communication_buffer));
-                printf("\n( %s )You WON the MATCH\n",player_names[PLAYER_NO_1]); 
-                game_result = PLAYER_WIN;            
-                break;
-            }
-            ssize_t bytes_sent = write(player_2_fd, communication_buffer, strlen(communication_buffer));
-            if (bytes_sent < 0) {
-                perror("Write failed");
-                break;
-            }
-            if(strncmp(communication_buffer,"exit",4) == 0)break;
-
-        }else if(current_player == 2){
-            if(!__name_transfer_flag){
-                write(player_1_fd,player_names[PLAYER_NO_2], strlen(player_names[PLAYER_NO_2]));
-                memset(player_names[PLAYER_NO_1], 0, sizeof(player_names[PLAYER_NO_1]));
-                read(player_1_fd,player_names[PLAYER_NO_1],sizeof(player_names[PLAYER_NO_1])-1);
-                __name_transfer_flag = SET_VALUE;
-                continue;
-            }
-            printf("Player_1 ( %s ) choosed : %s\n\nType Your No : ",player_names[PLAYER_NO_1],(!atoi(communication_buffer))?"\b\bYou to start":communication_buffer);
-            scanf("%s",communication_buffer);
-            if(!send_to_bingo(atoi(communication_buffer))){
-                memset(communication_buffer, 0, sizeof(communication_buffer));
-                strcpy(communication_buffer,"-1");
-                write(player_1_fd, communication_buffer, strlen(communication_buffer));
-                printf("\n( %s )You WON the MATCH\n",player_names[PLAYER_NO_2]);
-                game_result = PLAYER_WIN;         
-                break;
-            }
-            communication_buffer[strcspn(communication_buffer, "\n")] = 0;
-            write(player_1_fd, communication_buffer, strlen(communication_buffer));
-
-            if (strncmp(communication_buffer, "exit", 4) == 0)break;
-
-            printf("\nWating for player-1( %s )..\n",player_names[PLAYER_NO_1]);
-            memset(communication_buffer, 0, sizeof(communication_buffer));
-            read(player_1_fd, communication_buffer, sizeof(communication_buffer) - 1);
-            if(strncmp(communication_buffer,"-1",sizeof("-1"))==0 || (atoi(communication_buffer)==-1)){
-                printf("\n( %s )You LOST the MATCH Better Luck Next Time..\n",player_names[PLAYER_NO_2]);
-                game_result = PLAYER_LOSE;
-                break;
-            }
-            if(!send_to_bingo(atoi(communication_buffer))){
-                memset(communication_buffer, 0, sizeof(communication_buffer));
-                strcpy(communication_buffer,"-1");
-                write(player_1_fd, communication_buffer, strlen(communication_buffer));
-                printf("\n( %s )You WON the MATCH\n",player_names[PLAYER_NO_2]);
-                game_result = PLAYER_WIN;       
-                break;
-            }
-            if(strncmp(communication_buffer, "exit", sizeof("exit")) == 0)break;
+    setvbuf(stdin, NULL, _IONBF, 0); // Moves are read with read() in run_game_loop()
+    if(resume_name){
+        if(session_load(resume_name)){
+            printf("No match of %s to resume\n",resume_name);
+            return 1;
         }
+        if(session_reconnect())return 1;
+    }else if(start_session())return 1;
+    while(1){
+        run_game_loop();
+        render_release();
+        if(connection_lost && session_reconnect() == 0)continue;
+        reveal_card_seeds();
+        record_game();
+        session_finish();
+        update_game_status(game_result,UPDATE);
+        update_game_status(game_result,FETCH);
+        if(!agree_rematch())break;
+        card_seed = new_card_seed();  // Same names, config and socket; only the card is new
+        deal_bingo_card();
+        game_result = DEFAULT_STATUS;
+        session_begin();
+        record_start();
     }
-    update_game_status(game_result,UPDATE);
-    update_game_status(game_result,FETCH);
     printf("Closing connection\n");
     close(player_1_fd);
-    if(current_player == 1)close(player_2_fd);
+    if(current_player == 1 && !joined_game_server)close(player_2_fd);
+    if(local_listen_fd >= 0)close(local_listen_fd);
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: start_session                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Shows the history, asks for the role and nick name, connects  //
+//              and agrees names and card config, then checkpoints the match. //
+//              A spectator watches here and exits once its match is over.    //
+//              Against the computer we host the match as Player 1 and the    //
+//              computer joins over a socket pair, with nothing to resume.    //
+// Parameters: void                                                           //
+// Returns: int - 0 once a match can start, 1 to exit                         //
+////////////////////////////////////////////////////////////////////////////////
+int start_session(void){
+    update_game_status(game_result,FETCH);
+    printf("Select Player No :\nPlayer - 1\nPlayer - 2\nGame Server - 3\nWatch a match - 4\nPlay the computer - 5\nEnter choice :");
+    scanf("%d",&current_player);
+    if(current_player == COMPUTER_GAME){
+        printf("Enter your nick name :");
+        scanf("%19s",player_names[PLAYER_NO_1]);
+        current_player = 1;
+        computer_game = SET_VALUE;
+        player_1_fd = -1;
+        if(start_computer_opponent())return 1;
+    }else if(current_player == WATCH_GAME_SERVER){
+        printf("Enter the nick name of a player to watch (- for any) :");
+        scanf("%19s",communication_buffer);
+    }else if(current_player == JOIN_GAME_SERVER){
+        printf("Enter your nick name :");
+        scanf("%19s",communication_buffer);
+    }else{
+        printf("Enter Player - %d's nick name :",current_player);
+        scanf("%19s",player_names[current_player-1]);
+        strcpy(communication_buffer,player_names[current_player-1]);
+    }
+    while(!computer_game && setup_socket(current_player))sleep(3);
+    if(current_player == WATCH_GAME_SERVER)exit(watch_game_server());
+    if(current_player == JOIN_GAME_SERVER){
+        if(join_game_server())return 1;
+    }else if(exchange_player_names())return 1;
+    session_begin();
+    record_start();
     return 0;
 }
+#endif
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -225,24 +1010,30 @@ int main(){
 // Description: Sets up the socket connection for the specified player.      //
 //              For Player 1, it acts as the server, binding to a port and   //
 //              waiting for Player 2 to connect. For Player 2, it acts as the//
-//              client, connecting to Player 1's IP address. Initializes the //
-//              Bingo game after successful connection.                      //
-// Parameters: current_player - The player number (1 or 2)                   //
+//              client, connecting to Player 1's IP address. Choices 3 and 4  //
+//              connect the same way to a dedicated game server. The game is  //
+//              initialized once the card config has been agreed. Player 1    //
+//              also listens on a Unix socket and a peer on this host uses it //
+//              instead of TCP (see LOCAL TRANSPORT).                         //
+// Parameters: current_player - The player number (1 or 2) or 3 for server    //
 // Returns: int - 0 on success, 1 on failure                                 //
 ////////////////////////////////////////////////////////////////////////////////
 int setup_socket(int current_player){
-
-    player_1_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (player_1_fd < 0) {
-        perror("Socket failed");
-        return 1;
-    }
+    int local = DEFAULT_STATUS;
 
     memset(&server_address, 0, sizeof(server_address));
     server_address.sin_family = AF_INET;
     server_address.sin_port = htons(PORT); 
     if(current_player == 1){        
+        int enable = SET_VALUE;
+        player_1_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (player_1_fd < 0) {
+            perror("Socket failed");
+            return 1;
+        }
         server_address.sin_addr.s_addr = INADDR_ANY;
+        // Lets a resumed host rebind PORT over this match's TIME_WAIT sockets
+        setsockopt(player_1_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
         if (bind(player_1_fd, (struct sockaddr *)&server_address, sizeof(server_address)) < 0) {
             perror("Bind failed");
             close(player_1_fd);
@@ -253,229 +1044,539 @@ int setup_socket(int current_player){
             close(player_1_fd);
             return 1;
         }
+        if(!transport_tcp_only && local_listen_fd < 0)local_listen_fd = transport_listen(PORT, 0, 1);
 
         if(fork() == 0)execlp("ip","ip","-br","-4","addr",NULL);
         printf("\nShare IP inet address with Player-2\nTo Start Game\n");
 
-        player_2_fd = accept(player_1_fd, (struct sockaddr *)&server_address, &addrlen);
+        player_2_fd = transport_accept(player_1_fd, local_listen_fd, -1);
         if (player_2_fd < 0) {
             perror("Accept failed");
             close(player_1_fd);
             return 1;
         }
         printf("Player - 2  connected!\n");
-    }else if(current_player == 2){
-        printf("Enter IP Of player - 1:\n Displayed on player-1's Display : ");
+    }else if(current_player == 2 || current_player == JOIN_GAME_SERVER || current_player == WATCH_GAME_SERVER){
+        if(current_player == 2)printf("Enter IP Of player - 1:\n Displayed on player-1's Display : ");
+        else printf("Enter IP Of game server : ");
         if(sizeof(PLAYER_2_IP_ADDRESS)<=11)scanf("%s",PLAYER_2_IP_ADDRESS);
 
         if (inet_pton(AF_INET, PLAYER_2_IP_ADDRESS ,&server_address.sin_addr) <= 0) {
             perror("inet_pton failed");
-            close(player_1_fd);
-            setup_socket(current_player);
+            return setup_socket(current_player);
         }
-        if (connect(player_1_fd, (struct sockaddr*)&server_address, sizeof(server_address)) < 0) {
+        player_1_fd = transport_connect(&server_address, &local);
+        if (player_1_fd < 0) {
             printf("\rWaiting for Player-1 :");
             fflush(stdout);
-            close(player_1_fd);
             return 1;
         }
-        printf("Connected to Player - 1 \n");
+        printf("Connected to %s%s\n",(current_player == 2)?"Player - 1":"game server",local ? " on this host" : " ");
     }
-    initialize_bingo_game();
     return 0;
 }
 ////////////////////////////////////////////////////////////////////////////////
-// FUNCTION: update_game_status                                               //
-////////////////////////////////////////////////////////////////////////////////
-// Description: Updates or fetches the game history from files. Updates the   //
-//              win/loss records in binary files, or displays the history in  //
-//              a formatted table with counts.                                //
-// Parameters: status - Game result (PLAYER_WIN or PLAYER_LOSE)               //
-//             type - Operation type (UPDATE or FETCH)                        //
-// Returns: void                                                              //
-////////////////////////////////////////////////////////////////////////////////
-void update_game_status(int status,int type){
-
-    FILE *win_fp,*lose_fp;
-    win_fp = fopen("/tmp/bingo_2_0_win_status.bin","ab+");
-    lose_fp = fopen("/tmp/bingo_2_0_lose_status.bin","ab+");
-    if((win_fp == NULL) || (lose_fp == NULL))perror("File Open Error\n");
-    if(type == UPDATE)fprintf(status==PLAYER_WIN?win_fp:lose_fp,"\t%-25s %-20s %-20s\n",player_names[current_player-1],status==PLAYER_WIN?"WON  AGANIST":"LOST AGANIST",(current_player==1)?player_names[PLAYER_NO_2]:player_names[PLAYER_NO_1]);
-    else if(type == FETCH){
-        int win_count = 0, lose_count = 0;
-        printf("\n");
-        printf("╔══════════════════════════════════════════════════════════════════════════════╗\n");
-        printf("║                                 GAME HISTORY                                 ║\n");
-        printf("╠══════════════════════════════════════════════════════════════════════════════╣\n");
-        printf("║                                 WIN RECORDS                                  ║\n");
-        printf("╠══════════════════════════════════════════════════════════════════════════════╣\n");
-        rewind(win_fp);
-        while(fgets(communication_buffer,BUF_SIZE,win_fp)){
-            communication_buffer[strcspn(communication_buffer, "\n")] = 0;
-            printf(" %-76s \n", communication_buffer);
-            win_count++;
-        }
-        if(win_count == 0) printf("║ %-76s ║\n", "No wins recorded yet.");
-        printf("╠══════════════════════════════════════════════════════════════════════════════╣\n");
-        printf("║                                 LOSE RECORDS                                 ║\n");
-        printf("╠══════════════════════════════════════════════════════════════════════════════╣\n");
-        rewind(lose_fp);
-        while(fgets(communication_buffer,BUF_SIZE,lose_fp)){
-            communication_buffer[strcspn(communication_buffer, "\n")] = 0;  // Remove newline
-            printf(" %-76s \n", communication_buffer);
-            lose_count++;
-        }
-        if(lose_count == 0) printf("║ %-76s ║\n", "No losses recorded yet.");
-        printf("╚══════════════════════════════════════════════════════════════════════════════╝\n");
-        printf("Total Wins: %d | Total Losses: %d | Total Matchs: %d\n\n", win_count, lose_count, win_count+lose_count);
-    }
-    fclose(win_fp);
-    fclose(lose_fp);
-}
-////////////////////////////////////////////////////////////////////////////////
-// FUNCTION: initialize_bingo_game                                            //
+// FUNCTION: join_game_server                                                 //
 ////////////////////////////////////////////////////////////////////////////////
-// Description: Initializes the Bingo game by seeding the random number       //
-//              generator, filling the Bingo grid with unique random numbers, //
-//              clearing the terminal, and displaying the initial grid.       //
+// Description: Sends the nick name to the game server and waits until it is  //
+//              paired with an opponent. The server answers "<role>:<name>"   //
+//              where role 1 waits first and role 2 types first, exactly as   //
+//              in a direct Player 1 / Player 2 match. Version 2 servers then //
+//              send the card config of the match before the game starts.     //
+//              Role HALL_SEAT (version 4) seats us in a caller hall, where   //
+//              cards arrive with MSG_CARD at the start of every round.       //
+//              Version 7 matches end the greeting with our resume token.     //
 // Parameters: void                                                           //
-// Returns: void                                                              //
+// Returns: int - 0 on success, 1 on failure                                 //
 ////////////////////////////////////////////////////////////////////////////////
-void initialize_bingo_game(){
-    int random_number_address;
-    display_loading_quote();
-    srand(time(NULL)^getpid()^(unsigned long)&random_number_address);
-    for(int i = 0 ; i< ROW ; i++){
-        for(int j = 0 ; j< COL ; j++){
-            bingo_grid[i][j] = generate_random_number();
-        }
+int join_game_server(void){
+    struct bingo_frame frame;
+    char name[20];
+    strcpy(name,communication_buffer);
+    send_frame(player_1_fd,MSG_HELLO,name,strlen(name));
+    printf("Waiting for an opponent on the game server..\n");
+    fflush(stdout);
+    if(read_frame(player_1_fd,&peer_decoder,&frame) != FRAME_READY || frame.type != MSG_PAIRED || frame.length < 1){
+        printf("Game server closed the connection.\n");
+        close(player_1_fd);
+        return 1;
     }
-    clear_terminal_lines(100);
-    display_grid();
-}
-int send_to_bingo(int num){
-    int WIN = mark_number(num);
-        if(WIN) return 0;
-    return 1;    
+    current_player = frame.payload[0];
+    if(current_player == HALL_SEAT && frame.version >= HALL_MIN_VERSION){
+        caller_hall = SET_VALUE;
+        current_player = 2;
+    }
+    if(current_player != 1 && current_player != 2){
+        printf("Game server sent an unknown role.\n");
+        close(player_1_fd);
+        return 1;
+    }
+    if(frame.version < protocol_version)protocol_version = frame.version;
+    joined_game_server = SET_VALUE;
+    strcpy(player_names[current_player-1],name);
+    memset(player_names[2-current_player], 0, sizeof(player_names[0]));
+    memcpy(player_names[2-current_player],frame.payload+1,frame.length-1 < 19 ? frame.length-1 : 19);
+    if(current_player == 1)player_2_fd = player_1_fd;
+    card_size = BINGO_CARD_SIZE;
+    card_max_number = MAX_NUMBER;
+    if(protocol_version >= 2 && (read_frame(player_1_fd,&peer_decoder,&frame) != FRAME_READY || apply_game_config(&frame))){
+        printf("Game server sent no usable card config.\n");
+        close(player_1_fd);
+        return 1;
+    }
+    if(protocol_version >= RESUME_MIN_VERSION && !caller_hall && read_token()){
+        printf("Game server sent no resume token.\n");
+        close(player_1_fd);
+        return 1;
+    }
+    if(caller_hall)printf("Seated in the caller hall, %dx%d cards with numbers 1-%d\n",card_size,card_size,card_max_number);
+    else initialize_bingo_game();
+    __name_transfer_flag = SET_VALUE;
+    return 0;
 }
-
 ////////////////////////////////////////////////////////////////////////////////
-// FUNCTION: generate_random_number                                           //
+// FUNCTION: watch_game_server                                                //
 ////////////////////////////////////////////////////////////////////////////////
-// Description: Generates a unique random number between 1 and 25 that is not //
-//              already present in the Bingo grid.                            //
+// Description: Watches a match on the game server until it ends. The server  //
+//              answers MSG_WATCH with the players and card config, the       //
+//              numbers called so far and then every move as it is played.    //
+//              The same snapshot arrives again if we fall too far behind.    //
 // Parameters: void                                                           //
-// Returns: int - A unique random number                                      //
+// Returns: int - 0 once the match is over, 1 if there is none to watch       //
 ////////////////////////////////////////////////////////////////////////////////
-int generate_random_number(){
-    int min = 1, max =25;
-    int rand_num = 0;
+int watch_game_server(void){
+    struct bingo_frame frame;
+    char names[PLAYERS_SIZE][20];
+    const char *name = strcmp(communication_buffer,"-") ? communication_buffer : "";
+    send_frame(player_1_fd,MSG_WATCH,name,strlen(name));
+    if(read_frame(player_1_fd,&peer_decoder,&frame) != FRAME_READY || frame.type != MSG_WATCHING){
+        printf("No match to watch on the game server.\n");
+        close(player_1_fd);
+        return 1;
+    }
     while(1){
-        rand_num = (rand()%(max-min+1))+min;
-        if(is_number_duplicate(rand_num))
-            continue;
-        else{
-            return rand_num;
+        if(frame.type == MSG_WATCHING && frame.length >= 4){
+            const char *first = (const char *)frame.payload + 3;
+            size_t first_len = strnlen(first, frame.length - 3);
+            memset(names, 0, sizeof(names));
+            memcpy(names[PLAYER_NO_2], first, first_len < 19 ? first_len : 19);
+            if(3 + first_len < frame.length){
+                size_t second_len = frame.length - 4 - first_len;
+                memcpy(names[PLAYER_NO_1], first + first_len + 1, second_len < 19 ? second_len : 19);
+            }
+            printf("Watching %s vs %s, %dx%d cards with numbers 1-%d\n",names[PLAYER_NO_2],names[PLAYER_NO_1],
+                   frame.payload[0],frame.payload[0],(frame.payload[1] << 8) | frame.payload[2]);
+        }else if(frame.type == MSG_SNAPSHOT){
+            printf("Called so far :");
+            for(int i = 0 ; i + 1 < frame.length ; i += 2)printf(" %d",(frame.payload[i] << 8) | frame.payload[i + 1]);
+            printf("\n");
+        }else if(frame.type == MSG_PLAYED && frame.length >= 1 + FRAME_HEADER_SIZE && frame.payload[0] < PLAYERS_SIZE){
+            const char *player = names[frame.payload[0]];
+            const unsigned char *played = frame.payload + 1;
+            int number = frame.length >= 1 + FRAME_HEADER_SIZE + 2 ? (played[4] << 8) | played[5] : 0;
+            if(played[1] == MSG_MOVE)printf("%s called %d\n",player,number);
+            else if(played[1] == MSG_WIN)printf("%s has BINGO on %d\n",player,number);
+            else if(played[1] == MSG_TIMEOUT)printf("%s ran out of time\n",player);
+            else if(played[1] == MSG_QUIT)printf("%s left the match\n",player);
+        }else if(frame.type == MSG_QUIT){
+            break;
         }
+        fflush(stdout);
+        if(read_frame(player_1_fd,&peer_decoder,&frame) != FRAME_READY)break;
     }
-
+    printf("The match is over.\n");
+    close(player_1_fd);
+    return 0;
 }
 ////////////////////////////////////////////////////////////////////////////////
-// FUNCTION: is_number_duplicate                                              //
+// FUNCTION: exchange_player_names                                            //
 ////////////////////////////////////////////////////////////////////////////////
-// Description: Checks if a given number is already present in the Bingo grid //
-// Parameters: val - The number to check                                      //
-// Returns: int - 1 if duplicate, 0 otherwise                                 //
+// Description: Swaps nick names with the opponent of a direct match. Player  //
+//              2 sends first; Player 1 answers and, on version 2, sends the  //
+//              card config (and on version 3 the turn timeout) it hosts and  //
+//              on version 7 the token Player 2 resumes the match with.       //
+// Parameters: void                                                           //
+// Returns: int - 0 on success, 1 on failure                                 //
 ////////////////////////////////////////////////////////////////////////////////
-int is_number_duplicate(int val){
-    for(int i =0 ;i<ROW; i++){
-        for(int j = 0; j<COL; j++)
-            if(bingo_grid[i][j]==val)return 1;
+int exchange_player_names(void){
+    struct bingo_frame frame;
+    if(current_player == 1){
+        memset(player_names[PLAYER_NO_2], 0, sizeof(player_names[PLAYER_NO_2]));
+        if(read_frame(player_2_fd,&peer_decoder,&frame) != FRAME_READY || frame.type != MSG_HELLO){
+            printf("Player - 2 disconnected.\n");
+            return 1;
+        }
+        memcpy(player_names[PLAYER_NO_2],frame.payload,frame.length < 19 ? frame.length : 19);
+        if(frame.version < protocol_version)protocol_version = frame.version;
+        send_frame(player_2_fd,MSG_HELLO,player_names[PLAYER_NO_1], strlen(player_names[PLAYER_NO_1]));
+        if(protocol_version >= 2)send_config(player_2_fd, card_size, card_max_number, turn_timeout);
+        if(protocol_version >= RESUME_MIN_VERSION){
+            unsigned char token[8];
+            resume_token = new_card_seed() | 1;
+            for(int b = 0 ; b < 8 ; b++)token[b] = resume_token >> (56 - 8*b);
+            send_frame(player_2_fd, MSG_TOKEN, token, sizeof(token));
+        }
+        else if(card_size != BINGO_CARD_SIZE || card_max_number != MAX_NUMBER){
+            printf("Player - 2 ( %s ) runs an older version, playing %dx%d\n",player_names[PLAYER_NO_2],ROW,COL);
+            card_size = BINGO_CARD_SIZE;
+            card_max_number = MAX_NUMBER;
+        }
+    }else{
+        send_frame(player_1_fd,MSG_HELLO,player_names[PLAYER_NO_2], strlen(player_names[PLAYER_NO_2]));
+        memset(player_names[PLAYER_NO_1], 0, sizeof(player_names[PLAYER_NO_1]));
+        if(read_frame(player_1_fd,&peer_decoder,&frame) != FRAME_READY || frame.type != MSG_HELLO){
+            printf("Player - 1 disconnected.\n");
+            return 1;
+        }
+        memcpy(player_names[PLAYER_NO_1],frame.payload,frame.length < 19 ? frame.length : 19);
+        if(frame.version < protocol_version)protocol_version = frame.version;
+        card_size = BINGO_CARD_SIZE;
+        card_max_number = MAX_NUMBER;
+        if(protocol_version >= 2 && (read_frame(player_1_fd,&peer_decoder,&frame) != FRAME_READY || apply_game_config(&frame))){
+            printf("Player - 1 sent no usable card config.\n");
+            return 1;
+        }
+        if(protocol_version >= RESUME_MIN_VERSION && read_token()){
+            printf("Player - 1 sent no resume token.\n");
+            return 1;
+        }
     }
+    initialize_bingo_game();
+    __name_transfer_flag = SET_VALUE;
     return 0;
 }
 ////////////////////////////////////////////////////////////////////////////////
-// FUNCTION: display_grid                                                     //
+// FUNCTION: agree_rematch                                                    //
 ////////////////////////////////////////////////////////////////////////////////
-// Description: Prints the current state of the Bingo grid to the console.    //
+// Description: Offers another match once one has been decided. Both sides    //
+//              answer y with MSG_REMATCH or n with MSG_QUIT while waiting    //
+//              for the opponent, so setup, names, config and the connection  //
+//              are all reused. Frames after the opponent's MSG_REMATCH stay  //
+//              in peer_decoder for the next run_game_loop().                 //
 // Parameters: void                                                           //
-// Returns: void                                                              //
+// Returns: int - 1 if both players want a rematch, 0 to close the session    //
 ////////////////////////////////////////////////////////////////////////////////
-void display_grid(){
-    printf("\n");
-    for(int i = 0 ; i< ROW ; i++){
-        for(int j = 0 ; j< COL ; j++){
-            printf(" %2d ",bingo_grid[i][j]);
-        }printf("\n\n");
+int agree_rematch(void){
+    struct pollfd fds[2];
+    struct bingo_frame frame;
+    char input[INPUT_BUFFER_SIZE];
+    size_t input_len = 0;
+    int peer = current_player == 1 ? PLAYER_NO_2 : PLAYER_NO_1;
+    int peer_fd = current_player == 1 ? player_2_fd : player_1_fd;
+    int asked = DEFAULT_STATUS, peer_ready = DEFAULT_STATUS;
+
+    if(caller_hall || protocol_version < REMATCH_MIN_VERSION || (game_result != PLAYER_WIN && game_result != PLAYER_LOSE))return 0;
+    printf("Rematch with %s? (y/n) : ",player_names[peer]);
+    fflush(stdout);
+    while(!asked || !peer_ready){
+        int status;
+        while(!peer_ready && (status = frame_decoder_next(&peer_decoder, &frame)) == FRAME_READY){
+            if(frame.type == MSG_QUIT){
+                printf("\nPlayer - %d ( %s ) does not want a rematch.\n",peer + 1,player_names[peer]);
+                return 0;
+            }
+            if(frame.type == MSG_REMATCH){
+                peer_ready = SET_VALUE;
+                if(!asked)printf("\n%s wants a rematch. (y/n) : ",player_names[peer]);
+                fflush(stdout);
+            }
+        }
+        if(!peer_ready && status == FRAME_ERROR)return 0;
+        if(asked && peer_ready)break;
+
+        char *newline = memchr(input, '\n', input_len);
+        if(newline && !asked){
+            char *answer = input;
+            while(*answer == ' ' || *answer == '\t')answer++;
+            if(*answer != 'y' && *answer != 'Y'){
+                send_frame(peer_fd, MSG_QUIT, NULL, 0);
+                return 0;
+            }
+            if(send_frame(peer_fd, MSG_REMATCH, NULL, 0) < 0)return 0;
+            asked = SET_VALUE;
+            if(!peer_ready)printf("Waiting for player-%d( %s )..\n",peer + 1,player_names[peer]);
+            fflush(stdout);
+            continue;
+        }
+
+        fds[0].fd = asked ? -1 : STDIN_FILENO;
+        fds[0].events = POLLIN;
+        fds[1].fd = peer_fd;
+        fds[1].events = POLLIN;
+        fds[0].revents = fds[1].revents = 0;
+        if(poll(fds, 2, -1) < 0){
+            if(errno == EINTR)continue;
+            perror("poll failed");
+            return 0;
+        }
+        if(fds[0].revents & (POLLIN|POLLHUP|POLLERR)){
+            if(input_len == sizeof(input))input_len = 0;
+            ssize_t bytes_read = read(STDIN_FILENO, input + input_len, sizeof(input) - input_len);
+            if(bytes_read > 0)input_len += bytes_read;
+            else if(bytes_read == 0 || errno != EINTR){
+                send_frame(peer_fd, MSG_QUIT, NULL, 0);
+                return 0;
+            }
+        }
+        if(fds[1].revents & (POLLIN|POLLHUP|POLLERR)){
+            size_t available;
+            unsigned char *space = frame_decoder_space(&peer_decoder, &available);
+            ssize_t bytes_read = read(peer_fd, space, available);
+            if(bytes_read < 0 && errno == EINTR)continue;
+            if(bytes_read <= 0){
+                printf("\nPlayer - %d ( %s )disconnected.\n",peer + 1,player_names[peer]);
+                return 0;
+            }
+            peer_decoder.end += bytes_read;
+        }
+    }
+    return 1;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: apply_game_config                                                //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Adopts the card size, number range and (version 3) turn       //
+//              timeout sent in MSG_CONFIG by the host of the match (Player 1 //
+//              or the game server).                                          //
+// Parameters: frame - Received frame                                         //
+// Returns: int - 0 on success, 1 if it is not a usable MSG_CONFIG            //
+////////////////////////////////////////////////////////////////////////////////
+int apply_game_config(const struct bingo_frame *frame){
+    if(frame->type != MSG_CONFIG || frame->length < 3)return 1;
+    int size = frame->payload[0], max_number = (frame->payload[1] << 8) | frame->payload[2];
+    if(!valid_card_config(size, max_number))return 1;
+    card_size = size;
+    card_max_number = max_number;
+    if(frame->length >= 5)turn_timeout = (frame->payload[3] << 8) | frame->payload[4];
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: read_token                                                       //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Reads the MSG_TOKEN the host of the match sends after its     //
+//              card config and keeps it for session_reconnect().             //
+// Parameters: void                                                           //
+// Returns: int - 0 on success, 1 if no token arrived                         //
+////////////////////////////////////////////////////////////////////////////////
+int read_token(void){
+    struct bingo_frame frame;
+    if(read_frame(player_1_fd,&peer_decoder,&frame) != FRAME_READY || frame.type != MSG_TOKEN || frame.length < 8)return 1;
+    resume_token = 0;
+    for(int b = 0 ; b < 8 ; b++)resume_token = resume_token << 8 | frame.payload[b];
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: update_game_status                                               //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Updates or fetches the game history. UPDATE appends one       //
+//              fixed-size record to the history log and bumps the summary    //
+//              index; FETCH prints the most recent records and the totals,   //
+//              which come straight from the index, in a formatted table.     //
+// Parameters: status - Game result (PLAYER_WIN or PLAYER_LOSE)               //
+//             type - Operation type (UPDATE or FETCH)                        //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void update_game_status(int status,int type){
+    struct bingo_history history;
+    const char *player = (current_player==1 || current_player==2)?player_names[current_player-1]:"";
+    const char *opponent = (current_player==1)?player_names[PLAYER_NO_2]:(current_player==2)?player_names[PLAYER_NO_1]:"";
+
+    if(history_open(&history)){
+        perror("File Open Error\n");
+        return;
+    }
+    if(type == UPDATE){
+        struct history_record record;
+        if(status != PLAYER_WIN && status != PLAYER_LOSE){
+            history_close(&history);
+            return;
+        }
+        memset(&record, 0, sizeof(record));
+        record.timestamp = time(NULL);
+        record.card_seed = card_seed;
+        record.result = status;
+        snprintf(record.player, sizeof(record.player), "%s", player);
+        snprintf(record.opponent, sizeof(record.opponent), "%s", opponent);
+        history_append(&history, &record);
+    }else if(type == FETCH){
+        struct stat log_stat;
+        const struct history_record *records = NULL;
+        size_t record_count = 0;
+
+        flock(history.index_fd, LOCK_SH);
+        if(history_sync(&history)){
+            perror("History index remap failed");
+            flock(history.index_fd, LOCK_UN);
+            history_close(&history);
+            return;
+        }
+        if(fstat(history.log_fd, &log_stat) == 0)record_count = log_stat.st_size / sizeof(struct history_record);
+        if(record_count)records = mmap(NULL, record_count * sizeof(struct history_record), PROT_READ, MAP_SHARED, history.log_fd, 0);
+        if(records == MAP_FAILED)records = NULL;
+        printf("\n");
+        printf("╔══════════════════════════════════════════════════════════════════════════════╗\n");
+        printf("║                                 GAME HISTORY                                 ║\n");
+        printf("╠══════════════════════════════════════════════════════════════════════════════╣\n");
+        printf("║                                RECENT MATCHES                                ║\n");
+        printf("╠══════════════════════════════════════════════════════════════════════════════╣\n");
+        for(size_t i = record_count > HISTORY_RECENT ? record_count - HISTORY_RECENT : 0 ; records && i < record_count ; i++)
+            printf(" \t%-25.20s %-20s %-20.20s \n", records[i].player, records[i].result == PLAYER_WIN ? "WON  AGANIST" : "LOST AGANIST", records[i].opponent);
+        if(record_count == 0) printf("║ %-76s ║\n", "No matches recorded yet.");
+        printf("╚══════════════════════════════════════════════════════════════════════════════╝\n");
+        if(records)munmap((void *)records, record_count * sizeof(struct history_record));
+
+        uint64_t win_count = history.index->total_wins, lose_count = history.index->total_losses;
+        printf("Total Wins: %llu | Total Losses: %llu | Total Matchs: %llu\n", (unsigned long long)win_count, (unsigned long long)lose_count, (unsigned long long)(win_count+lose_count));
+        struct history_entry *entry = player[0] ? history_lookup(history.index, player, "", 0) : NULL;
+        if(entry)printf("%s : %u Wins | %u Losses\n", player, entry->wins, entry->losses);
+        entry = (player[0] && opponent[0]) ? history_lookup(history.index, player, opponent, 0) : NULL;
+        if(entry)printf("%s against %s : %u Wins | %u Losses\n", player, opponent, entry->wins, entry->losses);
+        printf("\n");
+        flock(history.index_fd, LOCK_UN);
+    }
+    history_close(&history);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: initialize_bingo_game                                            //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Initializes the Bingo game by picking the card seed (or the   //
+//              one given with --seed), sizing the card as agreed with the    //
+//              opponent, shuffling the numbers onto the grid, clearing the   //
+//              terminal, and displaying the initial grid.                    //
+// Parameters: void                                                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void initialize_bingo_game(){
+    display_loading_quote();
+    if(!card_seed_requested)card_seed = new_card_seed();
+    deal_bingo_card();
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: deal_bingo_card                                                  //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Sizes the grid as agreed, fills it from card_seed and draws   //
+//              it, without the loading animation.                            //
+// Parameters: void                                                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void deal_bingo_card(void){
+    if(bingo_card_init(&bingo_grid, card_size, card_max_number)){
+        perror("Card allocation failed");
+        exit(1);
     }
-    printf("\n");
+    bingo_card_generate(&bingo_grid, card_seed);
+    count = 0;
+    display_grid();
+    printf("Card seed : %016llx (%dx%d, 1-%d)\n", (unsigned long long)card_seed, card_size, card_size, card_max_number);
+}
+int send_to_bingo(int num){
+    int WIN = mark_number(num);
+        if(WIN) return 0;
+    return 1;    
+}
 
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: new_card_seed                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Derives a fresh card seed from the clock, the process id and  //
+//              a stack address, so simultaneous players get different cards. //
+// Parameters: void                                                           //
+// Returns: uint64_t - Seed to pass to bingo_card_generate()                  //
+////////////////////////////////////////////////////////////////////////////////
+uint64_t new_card_seed(void){
+    struct timespec now;
+    struct bingo_rng rng;
+    clock_gettime(CLOCK_REALTIME, &now);
+    bingo_rng_seed(&rng, ((uint64_t)now.tv_sec * 1000000000u + now.tv_nsec) ^ ((uint64_t)getpid() << 32) ^ (uintptr_t)&now);
+    return bingo_rng_next(&rng);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: display_grid                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Clears the screen and draws the whole Bingo grid and status   //
+//              row at fixed rows, then limits scrolling to the rows below    //
+//              so prompts never push the grid away. The frame buffer is      //
+//              sized here for this card's largest frame (a full redraw, or   //
+//              every cell changing at once), so each frame is one write().   //
+// Parameters: void                                                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void display_grid(){
+    int size = bingo_grid.size, digits = 1;
+    for(int n = bingo_grid.max_number ; n >= 10 ; n /= 10)digits++;
+    if(render_reserve((size_t)size*size*(digits + RENDER_CELL_BYTES) + size*RENDER_ROW_BYTES + RENDER_FRAME_SLACK))
+        perror("Render buffer allocation failed");  // Large frames then go out in several writes
+    renderer.row_step = size <= BINGO_CARD_SIZE ? 2 : 1;
+    renderer.cell_width = digits + 2;
+    renderer.status_row = GRID_TOP_ROW + size*renderer.row_step;
+    render_append("\033[r\033[H\033[2J");
+    for(int i = 0 ; i< size ; i++){
+        render_append("\033[%d;1H", GRID_TOP_ROW + i*renderer.row_step);
+        for(int j = 0 ; j< size ; j++){
+            renderer.shown[i*size+j] = bingo_card_number(&bingo_grid, i*size+j);
+            render_append(" %*d ", digits, renderer.shown[i*size+j]);
+        }
+    }
+    renderer.shown_lines = count;
+    render_status();
+    render_append("\033[%d;r\033[%d;1H", renderer.status_row + 2, renderer.status_row + 2);
+    renderer.active = SET_VALUE;
+    render_flush();
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: display_grid_changes                                             //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Redraws only the cells and status row that differ from what   //
+//              is on screen, using cursor addressing between a saved and     //
+//              restored cursor, so the prompt below stays where it was.      //
+//              A typical move costs a few dozen bytes in one write().        //
+// Parameters: void                                                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void display_grid_changes(void){
+    if(!renderer.active){
+        display_grid();
+        return;
+    }
+    int size = bingo_grid.size;
+    render_append("\0337");
+    for(int cell = 0 ; cell < size*size ; cell++){
+        int number = bingo_card_number(&bingo_grid, cell);
+        if(number == renderer.shown[cell])continue;
+        renderer.shown[cell] = number;
+        render_append("\033[%d;%dH%*d", GRID_TOP_ROW + cell/size*renderer.row_step, cell%size*renderer.cell_width + 2, renderer.cell_width - 2, number);
+    }
+    if(count != renderer.shown_lines){
+        renderer.shown_lines = count;
+        render_status();
+    }
+    render_append("\0338");
+    render_flush();
 }
 ////////////////////////////////////////////////////////////////////////////////
 // FUNCTION: mark_number                                                      //
 ////////////////////////////////////////////////////////////////////////////////
-// Description: Marks a number on the Bingo grid by setting it to 0, checks   //
-//              for win conditions, clears terminal, and displays the grid.   //
+// Description: Marks a number on the Bingo grid (shown as 0 from then on),   //
+//              checks for win conditions and redraws what changed.           //
 // Parameters: val - The number to mark                                       //
 // Returns: int - 1 if win, 0 otherwise                                       //
 ////////////////////////////////////////////////////////////////////////////////
 int mark_number(int val){
-    for(int i = 0 ; i< ROW ; i++){
-        for(int j = 0 ; j< COL ; j++){
-            if(bingo_grid[i][j] == val){
-                bingo_grid[i][j] = 0;
-            }
-        }
-    }
+    bingo_card_mark(&bingo_grid, val);
     count = check_for_win();
-    clear_terminal_lines(100);
-    if(count)printf("\n Congratulations Cleared : %d \n",count);
-    display_grid();
-    if(count >= ROW){
-        clear_terminal_lines(100);
-        printf("\n\n//***** BINGO *****\\\\\n\n"); 
-        display_grid();
-        printf("\\\\***** BINGO ****//\n\n\n"); 
-        return 1;
-    }else{
-        return 0;
-    }
-
+    display_grid_changes();
+    return count >= LINES_TO_WIN(&bingo_grid);
 }
 ////////////////////////////////////////////////////////////////////////////////
 // FUNCTION: check_for_win                                                    //
 ////////////////////////////////////////////////////////////////////////////////
 // Description: Checks the Bingo grid for completed lines (rows, columns,     //
-//              diagonals) by counting how many lines are fully marked (all 0)//
+//              diagonals) by counting how many lines are fully marked.       //
 // Parameters: void                                                           //
 // Returns: int - Number of completed lines                                   //
 ////////////////////////////////////////////////////////////////////////////////
 int check_for_win(){
-
-    int count = 0;
-    for(int i = 0 ; i< ROW ; i++){
-        for(int j = 0 ; j< COL-1; j++){
-            if(bingo_grid[i][j] == bingo_grid[i][j+1]){
-                if(j==COL-2) ++count;
-            }else break;
-        }
-    }
-    for(int i = 0 ; i< COL ; i++){
-        for(int j = 0 ; j< ROW-1; j++){
-            if(bingo_grid[j][i] == bingo_grid[j+1][i]){
-                if(j==ROW-2) ++count;
-            }else break;
-        }
-    }
-    for(int i = 0 ; i< COL-1; i++){
-        if(bingo_grid[i][i] != bingo_grid[i+1][i+1]) break;
-        if(i == COL-2) count++;
-    }
-    for(int i = 0 ,j = COL-1; i< COL-1; i++,j--){
-        if(bingo_grid[i][j] != bingo_grid[i+1][j-1]) break;
-        if(i == COL-2) count++;
-    }
-    return count;
+    return bingo_card_lines(&bingo_grid);
 }
 ////////////////////////////////////////////////////////////////////////////////
 // FUNCTION: display_loading_quote                                            //
@@ -516,3 +1617,4273 @@ void clear_terminal_lines(int l){
 	printf("\r\033[2k");
 	fflush(stdout);
 }
+////////////////////////////////////////////////////////////////////////////////
+// TERMINAL RENDERER                                                          //
+////////////////////////////////////////////////////////////////////////////////
+// The grid lives at fixed screen rows above a scroll region for prompts.     //
+// Each redraw is built in one buffer and sent with a single write(), and     //
+// only cells whose value changed are redrawn.                                //
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: render_append                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Appends formatted text to the frame buffer. It only flushes   //
+//              mid-frame if the buffer could not be sized for the card.      //
+// Parameters: format, ... - printf style format and arguments                //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void render_append(const char *format, ...){
+    va_list args;
+    if(renderer.capacity == 0 && render_reserve(RENDER_BUFFER_SIZE))return;
+    for(int attempt = 0 ; attempt < 2 ; attempt++){
+        va_start(args, format);
+        int len = vsnprintf(renderer.frame + renderer.len, renderer.capacity - renderer.len, format, args);
+        va_end(args);
+        if(len < 0)return;
+        if(renderer.len + len < renderer.capacity){
+            renderer.len += len;
+            return;
+        }
+        render_flush();
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: render_reserve                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Grows the frame buffer to hold at least `bytes` (never below  //
+//              RENDER_BUFFER_SIZE), keeping whatever is already in it.       //
+// Parameters: bytes - Largest frame expected                                 //
+// Returns: int - 0 on success, 1 if the old buffer had to be kept            //
+////////////////////////////////////////////////////////////////////////////////
+int render_reserve(size_t bytes){
+    if(bytes < RENDER_BUFFER_SIZE)bytes = RENDER_BUFFER_SIZE;
+    if(bytes <= renderer.capacity)return 0;
+    char *frame = realloc(renderer.frame, bytes);
+    if(frame == NULL)return 1;
+    renderer.frame = frame;
+    renderer.capacity = bytes;
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: render_status                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Adds the status row (lines cleared or BINGO) to the frame.    //
+// Parameters: void                                                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void render_status(void){
+    render_append("\033[%d;1H\033[2K", renderer.status_row);
+    if(renderer.shown_lines >= LINES_TO_WIN(&bingo_grid))render_append("//***** BINGO *****\\\\ Cleared : %d", renderer.shown_lines);
+    else if(renderer.shown_lines)render_append(" Congratulations Cleared : %d ", renderer.shown_lines);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: render_flush                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Sends the frame to the terminal with one write(). Anything    //
+//              still buffered by printf goes out first to keep the order.    //
+// Parameters: void                                                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void render_flush(void){
+    size_t offset = 0;
+    fflush(stdout);
+    while(offset < renderer.len){
+        ssize_t bytes_sent = write(STDOUT_FILENO, renderer.frame + offset, renderer.len - offset);
+        if(bytes_sent < 0 && errno == EINTR)continue;
+        if(bytes_sent <= 0)break;
+        offset += bytes_sent;
+    }
+    renderer.len = 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: render_release                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Resets the scroll region and moves below everything, so the   //
+//              game history and exit messages print as usual.                //
+// Parameters: void                                                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void render_release(void){
+    if(!renderer.active)return;
+    renderer.active = DEFAULT_STATUS;
+    render_append("\0337\033[r\0338\n");
+    render_flush();
+}
+////////////////////////////////////////////////////////////////////////////////
+// BINGO CARD ENGINE                                                          //
+////////////////////////////////////////////////////////////////////////////////
+// A card keeps its numbers, a number-to-cell lookup and its marked cells.    //
+// Marking is one lookup and one bit set. The default 5x5 card keeps all      //
+// marks in one 32-bit mask tested against precomputed line masks; any other  //
+// N x N card keeps one 64-bit word per row, so rows compare whole words,     //
+// columns are the AND of every row and only the diagonals go bit by bit.     //
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: valid_card_config                                                //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Checks a card size and number range. The range must hold at   //
+//              least one number per cell and fit the 16-bit wire format.     //
+// Parameters: size - Cells per row (N)                                       //
+//             max_number - Highest number on a card                          //
+// Returns: int - 1 if usable, 0 otherwise                                    //
+////////////////////////////////////////////////////////////////////////////////
+int valid_card_config(int size, int max_number){
+    return size >= MIN_CARD_SIZE && size <= MAX_CARD_SIZE &&
+           max_number >= size*size && max_number <= MAX_CARD_NUMBER;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bingo_card_init                                                  //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Sizes a card for N x N cells and numbers 1..max_number and    //
+//              clears it. The default 5x5 card with up to MAX_NUMBER numbers //
+//              uses the arrays inside the struct; others get one heap block. //
+//              A card may be re-initialised, its old block is released.      //
+// Parameters: card - Card to size (zeroed or previously initialised)         //
+//             size - Cells per row (N)                                       //
+//             max_number - Highest number on the card                        //
+// Returns: int - 0 on success, 1 on invalid config or allocation failure     //
+////////////////////////////////////////////////////////////////////////////////
+int bingo_card_init(struct bingo_card *card, int size, int max_number){
+    if(!valid_card_config(size, max_number))return 1;
+    bingo_card_free(card);
+    card->size = size;
+    card->max_number = max_number;
+    if(size == BINGO_CARD_SIZE && max_number <= MAX_NUMBER){
+        card->cells = card->classic_cells;
+        card->cell_of = card->classic_cell_of;
+    }else{
+        size_t rows = size * sizeof(uint64_t);
+        size_t cells = size * size * sizeof(uint16_t);
+        card->storage = malloc(rows + cells + (max_number + 1) * sizeof(uint16_t));
+        if(card->storage == NULL){
+            card->size = 0;
+            return 1;
+        }
+        if(size != BINGO_CARD_SIZE)card->marked_rows = card->storage;
+        card->cells = (uint16_t *)((char *)card->storage + rows);
+        card->cell_of = (uint16_t *)((char *)card->storage + rows + cells);
+    }
+    bingo_card_clear(card);
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bingo_card_free                                                  //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Releases the heap block of a card and leaves it unsized.      //
+// Parameters: card - Card to release                                         //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void bingo_card_free(struct bingo_card *card){
+    free(card->storage);
+    card->storage = NULL;
+    card->marked_rows = NULL;
+    card->size = 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bingo_card_clear                                                 //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Empties a card and builds the 5x5 line masks on first use.    //
+//              An unsized card becomes a default 5x5 card.                   //
+// Parameters: card - Card to clear                                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void bingo_card_clear(struct bingo_card *card){
+    if(!card->size){
+        bingo_card_init(card, BINGO_CARD_SIZE, MAX_NUMBER);
+        return;
+    }
+    if(!card_line_masks[0]){
+        for(int i = 0 ; i < ROW ; i++){
+            for(int j = 0 ; j < COL ; j++){
+                card_line_masks[i] |= 1u << (i*COL+j);
+                card_line_masks[ROW+j] |= 1u << (i*COL+j);
+            }
+            card_line_masks[ROW+COL] |= 1u << (i*COL+i);
+            card_line_masks[ROW+COL+1] |= 1u << (i*COL+COL-1-i);
+        }
+    }
+    memset(card->cells, 0, card->size * card->size * sizeof(card->cells[0]));
+    memset(card->cell_of, 0, (card->max_number + 1) * sizeof(card->cell_of[0]));
+    if(card->marked_rows)memset(card->marked_rows, 0, card->size * sizeof(card->marked_rows[0]));
+    card->marked = 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bingo_card_set                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Places a number in a cell and records it in the lookup.       //
+// Parameters: card - Card to fill                                            //
+//             cell - Cell index (row * size + column)                        //
+//             number - Number between 1 and the card's max_number            //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void bingo_card_set(struct bingo_card *card, int cell, int number){
+    card->cells[cell] = number;
+    card->cell_of[number] = cell + 1;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bingo_card_mark                                                  //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Marks a number by setting the bit of the cell holding it.     //
+//              Numbers that are out of range or not on the card are ignored. //
+// Parameters: card - Card to mark                                            //
+//             number - Called number                                         //
+// Returns: int - 1 if the number is on the card, 0 otherwise                 //
+////////////////////////////////////////////////////////////////////////////////
+int bingo_card_mark(struct bingo_card *card, int number){
+    if(number < 1 || number > card->max_number || !card->cell_of[number])return 0;
+    int cell = card->cell_of[number] - 1;
+    if(card->marked_rows)card->marked_rows[cell / card->size] |= 1ull << (cell % card->size);
+    else card->marked |= 1u << cell;
+    return 1;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bingo_card_copy_marks                                            //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Resets a card's marks to those of another card built from the //
+//              same seed and config, without rebuilding its numbers.         //
+// Parameters: card - Card to reset                                           //
+//             from - Card to copy the marks from                             //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void bingo_card_copy_marks(struct bingo_card *card, const struct bingo_card *from){
+    if(card->marked_rows)memcpy(card->marked_rows, from->marked_rows, card->size * sizeof(card->marked_rows[0]));
+    card->marked = from->marked;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bingo_card_marked                                                //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Tells whether a cell has been marked.                         //
+// Parameters: card - Card to read                                            //
+//             cell - Cell index (row * size + column)                        //
+// Returns: int - 1 if marked, 0 otherwise                                    //
+////////////////////////////////////////////////////////////////////////////////
+int bingo_card_marked(const struct bingo_card *card, int cell){
+    if(card->marked_rows)return card->marked_rows[cell / card->size] >> (cell % card->size) & 1;
+    return card->marked >> cell & 1;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bingo_card_lines                                                 //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Counts completed rows, columns and diagonals. A 5x5 card      //
+//              tests its mask against each line mask; other sizes make one   //
+//              pass over the row words (see the section comment above).      //
+// Parameters: card - Card to check                                           //
+// Returns: int - Number of completed lines                                   //
+////////////////////////////////////////////////////////////////////////////////
+int bingo_card_lines(const struct bingo_card *card){
+    int lines = 0;
+    if(!card->marked_rows){
+        for(int i = 0 ; i < CARD_LINES ; i++)
+            lines += (card->marked & card_line_masks[i]) == card_line_masks[i];
+        return lines;
+    }
+    int size = card->size;
+    uint64_t full = size == 64 ? ~0ull : (1ull << size) - 1;
+    uint64_t columns = full, diagonal = 1, anti_diagonal = 1;
+    for(int i = 0 ; i < size ; i++){
+        uint64_t row = card->marked_rows[i];
+        lines += row == full;
+        columns &= row;
+        diagonal &= row >> i;
+        anti_diagonal &= row >> (size - 1 - i);
+    }
+    return lines + __builtin_popcountll(columns) + (int)(diagonal & 1) + (int)(anti_diagonal & 1);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bingo_card_cell_score                                            //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Scores how far the lines through a cell are already marked,   //
+//              adding the square of the marked count of each such line.      //
+// Parameters: card - Card to read                                            //
+//             cell - Cell index (row * size + column)                        //
+// Returns: int - Sum of squared marked counts over the cell's lines          //
+////////////////////////////////////////////////////////////////////////////////
+int bingo_card_cell_score(const struct bingo_card *card, int cell){
+    int size = card->size, row = cell / size, col = cell % size;
+    int score = 0, marked;
+    if(!card->marked_rows){
+        marked = __builtin_popcount(card->marked & card_line_masks[row]);
+        score += marked * marked;
+        marked = __builtin_popcount(card->marked & card_line_masks[ROW+col]);
+        score += marked * marked;
+        if(row == col){
+            marked = __builtin_popcount(card->marked & card_line_masks[ROW+COL]);
+            score += marked * marked;
+        }
+        if(row + col == COL - 1){
+            marked = __builtin_popcount(card->marked & card_line_masks[ROW+COL+1]);
+            score += marked * marked;
+        }
+        return score;
+    }
+    int column = 0, diagonal = 0, anti_diagonal = 0;
+    for(int i = 0 ; i < size ; i++){
+        uint64_t bits = card->marked_rows[i];
+        column += bits >> col & 1;
+        diagonal += bits >> i & 1;
+        anti_diagonal += bits >> (size - 1 - i) & 1;
+    }
+    marked = __builtin_popcountll(card->marked_rows[row]);
+    score = marked * marked + column * column;
+    if(row == col)score += diagonal * diagonal;
+    if(row + col == size - 1)score += anti_diagonal * anti_diagonal;
+    return score;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bingo_card_number                                                //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Returns the number to show in a cell, 0 once it is marked.    //
+// Parameters: card - Card to read                                            //
+//             cell - Cell index (row * size + column)                        //
+// Returns: int - Cell number, or 0 if marked                                 //
+////////////////////////////////////////////////////////////////////////////////
+int bingo_card_number(const struct bingo_card *card, int cell){
+    return bingo_card_marked(card, cell) ? 0 : card->cells[cell];
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bingo_card_generate                                              //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Builds a card from a seed with a Fisher-Yates shuffle of      //
+//              1..max_number, stopped once every cell is filled. The same    //
+//              seed, size and range always give the same card.               //
+// Parameters: card - Card to fill, sized by bingo_card_init()                //
+//             seed - Card seed                                               //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void bingo_card_generate(struct bingo_card *card, uint64_t seed){
+    struct bingo_rng rng;
+    bingo_rng_seed(&rng, seed);
+    bingo_card_clear(card);
+    int max_number = card->max_number, cells = card->size * card->size;
+    uint16_t numbers[max_number];
+    for(int i = 0 ; i < max_number ; i++)numbers[i] = i + 1;
+    for(int i = 0 ; i < cells ; i++){
+        int j = i + bingo_rng_below(&rng, max_number - i);
+        int number = numbers[j];
+        numbers[j] = numbers[i];
+        bingo_card_set(card, i, number);
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bingo_rng_seed                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Expands a 64-bit seed into xoshiro256** state with splitmix64.//
+// Parameters: rng - Generator to seed                                        //
+//             seed - Any 64-bit value, including 0                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void bingo_rng_seed(struct bingo_rng *rng, uint64_t seed){
+    for(int i = 0 ; i < 4 ; i++){
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        rng->state[i] = z ^ (z >> 31);
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bingo_rng_next                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Returns the next output of xoshiro256**.                      //
+// Parameters: rng - Generator                                                //
+// Returns: uint64_t - 64 random bits                                         //
+////////////////////////////////////////////////////////////////////////////////
+uint64_t bingo_rng_next(struct bingo_rng *rng){
+    uint64_t *s = rng->state;
+    uint64_t x = s[1] * 5;
+    uint64_t result = ((x << 7) | (x >> 57)) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+    return result;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bingo_rng_below                                                  //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Returns an unbiased random value below n using Lemire's       //
+//              multiply-and-reject method (no division in the common case).  //
+// Parameters: rng - Generator                                                //
+//             n - Exclusive upper bound, greater than 0                      //
+// Returns: uint32_t - Value in [0, n)                                        //
+////////////////////////////////////////////////////////////////////////////////
+uint32_t bingo_rng_below(struct bingo_rng *rng, uint32_t n){
+    uint64_t product = (bingo_rng_next(rng) >> 32) * n;
+    if((uint32_t)product < n){
+        uint32_t threshold = -n % n;
+        while((uint32_t)product < threshold)product = (bingo_rng_next(rng) >> 32) * n;
+    }
+    return product >> 32;
+}
+////////////////////////////////////////////////////////////////////////////////
+// GAME HISTORY                                                               //
+////////////////////////////////////////////////////////////////////////////////
+// Finished games are appended as fixed-size records to HISTORY_LOG_PATH.     //
+// HISTORY_INDEX_PATH is a memory-mapped hash table of win/loss counts per    //
+// player and per (player, opponent) pair plus machine totals, so FETCH does  //
+// not re-read the log. Writers hold an exclusive flock() on the index while  //
+// appending; the index records how many log records it covers and catches    //
+// up on open, so a crash between the two writes is repaired next time. The   //
+// table doubles once HISTORY_FILL_PERCENT of its slots are taken; every      //
+// process remaps it after taking the lock if another one grew it.            //
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: history_open                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Opens the record log and maps the index, creating both on     //
+//              first use (importing the old text history files once).        //
+// Parameters: history - Receives the open history                            //
+// Returns: int - 0 on success, 1 on failure                                  //
+////////////////////////////////////////////////////////////////////////////////
+int history_open(struct bingo_history *history){
+    struct stat index_stat;
+    history->log_fd = open(HISTORY_LOG_PATH, O_RDWR | O_APPEND | O_CREAT, 0666);
+    history->index_fd = open(HISTORY_INDEX_PATH, O_RDWR | O_CREAT, 0666);
+    history->index = MAP_FAILED;
+    history->map_size = 0;
+    if(history->log_fd >= 0 && history->index_fd >= 0){
+        flock(history->index_fd, LOCK_EX);
+        if(history_map(history, HISTORY_MIN_SLOTS))history->index = MAP_FAILED;
+    }
+    if(history->index == MAP_FAILED){
+        if(history->log_fd >= 0)close(history->log_fd);
+        if(history->index_fd >= 0)close(history->index_fd);
+        return 1;
+    }
+    uint64_t slots = history->index->slot_count;
+    if(history->index->magic != HISTORY_MAGIC || slots < HISTORY_MIN_SLOTS || (slots & (slots - 1)) ||
+       fstat(history->index_fd, &index_stat) < 0 || (uint64_t)index_stat.st_size < HISTORY_INDEX_SIZE(slots) ||
+       history_map(history, slots)){
+        struct stat log_stat;  // New, older or damaged index: rebuilt from the log
+        if(ftruncate(history->index_fd, HISTORY_INDEX_SIZE(HISTORY_MIN_SLOTS)) < 0 || history_map(history, HISTORY_MIN_SLOTS)){
+            history_close(history);
+            return 1;
+        }
+        memset(history->index, 0, history->map_size);
+        history->index->slot_count = HISTORY_MIN_SLOTS;
+        history->index->magic = HISTORY_MAGIC;
+        if(fstat(history->log_fd, &log_stat) == 0 && log_stat.st_size == 0)history_import_legacy(history);
+    }
+    history_catch_up(history);
+    flock(history->index_fd, LOCK_UN);
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: history_close                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Unmaps the index and closes both history files.               //
+// Parameters: history - Open history                                         //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void history_close(struct bingo_history *history){
+    munmap(history->index, history->map_size);
+    close(history->log_fd);
+    close(history->index_fd);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: history_catch_up                                                 //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Folds log records the index does not cover yet into it.       //
+//              Normally nothing is left; after a crash (or a fresh index)    //
+//              the missing tail of the log is replayed. Caller holds the     //
+//              exclusive lock.                                               //
+// Parameters: history - Open history                                         //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void history_catch_up(struct bingo_history *history){
+    struct stat log_stat;
+    if(fstat(history->log_fd, &log_stat) < 0)return;
+    uint64_t record_count = log_stat.st_size / sizeof(struct history_record);
+    if(history->index->indexed_records >= record_count)return;
+    const struct history_record *records = mmap(NULL, record_count * sizeof(struct history_record), PROT_READ, MAP_SHARED, history->log_fd, 0);
+    if(records == MAP_FAILED)return;
+    for(uint64_t i = history->index->indexed_records ; i < record_count ; i++)history_count(history, &records[i]);
+    history->index->indexed_records = record_count;
+    munmap((void *)records, record_count * sizeof(struct history_record));
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: history_import_legacy                                            //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Copies the text history of older versions into the record     //
+//              log so existing wins and losses are kept. Caller holds the    //
+//              exclusive lock.                                               //
+// Parameters: history - Open history with an empty log                       //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void history_import_legacy(struct bingo_history *history){
+    const char *paths[] = { HISTORY_LEGACY_WIN_PATH, HISTORY_LEGACY_LOSE_PATH };
+    char line[BUF_SIZE];
+    for(int i = 0 ; i < 2 ; i++){
+        FILE *fp = fopen(paths[i], "r");
+        if(fp == NULL)continue;
+        while(fgets(line, sizeof(line), fp)){
+            struct history_record record;
+            memset(&record, 0, sizeof(record));
+            if(sscanf(line, "%19s %*s %*s %19s", record.player, record.opponent) < 1)continue;
+            record.result = (i == 0) ? PLAYER_WIN : PLAYER_LOSE;
+            if(write(history->log_fd, &record, sizeof(record)) != sizeof(record))break;
+        }
+        fclose(fp);
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: history_append                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Appends a record to the log and counts it in the index under  //
+//              an exclusive lock, so concurrent games never interleave.      //
+// Parameters: history - Open history                                         //
+//             record - Finished game                                         //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void history_append(struct bingo_history *history, const struct history_record *record){
+    flock(history->index_fd, LOCK_EX);
+    if(history_sync(history)){
+        perror("History index remap failed");
+        flock(history->index_fd, LOCK_UN);
+        return;
+    }
+    history_catch_up(history);
+    if(write(history->log_fd, record, sizeof(*record)) == sizeof(*record)){
+        history_count(history, record);
+        history->index->indexed_records++;
+    }else{
+        perror("History write failed");
+    }
+    flock(history->index_fd, LOCK_UN);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: history_count                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Adds one record to the machine totals, the player's totals    //
+//              and the player's record against that opponent.                //
+// Parameters: history - Open history (exclusive lock held)                   //
+//             record - Record to count                                       //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void history_count(struct bingo_history *history, const struct history_record *record){
+    char player[20], opponent[20];
+    snprintf(player, sizeof(player), "%.19s", record->player);
+    snprintf(opponent, sizeof(opponent), "%.19s", record->opponent);
+    if((history->index->used_slots + 2) * 100 > history->index->slot_count * HISTORY_FILL_PERCENT && history_grow(history))
+        perror("History index growth failed");  // Fills up further; a full table is reported below
+    struct history_entry *entries[2] = {
+        history_lookup(history->index, player, "", 1),
+        history_lookup(history->index, player, opponent, 1)
+    };
+    if(record->result == PLAYER_WIN)history->index->total_wins++;
+    else history->index->total_losses++;
+    for(int i = 0 ; i < 2 ; i++){
+        if(entries[i] == NULL){
+            if(player[0])printf("History index full : %s%s%s not counted, delete %s to rebuild it\n",
+                                player, i ? " against " : "", i ? opponent : "", HISTORY_INDEX_PATH);
+            continue;
+        }
+        if(record->result == PLAYER_WIN)entries[i]->wins++;
+        else entries[i]->losses++;
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: history_lookup                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Finds the index slot of a player (opponent "") or of a        //
+//              player/opponent pair with FNV-1a hashing and linear probing.  //
+// Parameters: index - Mapped index                                           //
+//             player, opponent - Key                                         //
+//             create - Claim an empty slot when the key is missing           //
+// Returns: struct history_entry * - Slot, or NULL if missing / table full    //
+////////////////////////////////////////////////////////////////////////////////
+struct history_entry *history_lookup(struct history_index *index, const char *player, const char *opponent, int create){
+    uint32_t hash = 2166136261u;
+    if(player[0] == 0)return NULL;
+    for(const char *c = player ; *c ; c++)hash = (hash ^ (unsigned char)*c) * 16777619u;
+    hash = (hash ^ 0xff) * 16777619u;
+    for(const char *c = opponent ; *c ; c++)hash = (hash ^ (unsigned char)*c) * 16777619u;
+    for(uint64_t probe = 0 ; probe < index->slot_count ; probe++){
+        struct history_entry *entry = &index->slots[(hash + probe) & (index->slot_count - 1)];
+        if(entry->player[0] == 0){
+            if(!create)return NULL;
+            snprintf(entry->player, sizeof(entry->player), "%s", player);
+            snprintf(entry->opponent, sizeof(entry->opponent), "%s", opponent);
+            index->used_slots++;
+            return entry;
+        }
+        if(strcmp(entry->player, player) == 0 && strcmp(entry->opponent, opponent) == 0)return entry;
+    }
+    return NULL;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: history_map                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Maps the index with room for `slots` slots, growing the file  //
+//              if it is shorter. The old mapping is only dropped once the    //
+//              new one is in place. Caller holds the lock.                   //
+// Parameters: history - History with its index file open                     //
+//             slots - Slot count to map                                      //
+// Returns: int - 0 on success, 1 on failure (old mapping kept)               //
+////////////////////////////////////////////////////////////////////////////////
+int history_map(struct bingo_history *history, uint64_t slots){
+    struct stat index_stat;
+    size_t size = HISTORY_INDEX_SIZE(slots);
+    if(fstat(history->index_fd, &index_stat) < 0)return 1;
+    if((uint64_t)index_stat.st_size < size && ftruncate(history->index_fd, size) < 0)return 1;
+    struct history_index *index = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, history->index_fd, 0);
+    if(index == MAP_FAILED)return 1;
+    if(history->map_size)munmap(history->index, history->map_size);
+    history->index = index;
+    history->map_size = size;
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: history_sync                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Remaps the index if another process grew it since we mapped   //
+//              it. The header always lies in the first page, so it can be    //
+//              read through the old mapping. Caller holds the lock.          //
+// Parameters: history - Open history                                         //
+// Returns: int - 0 on success, 1 if the remap failed                         //
+////////////////////////////////////////////////////////////////////////////////
+int history_sync(struct bingo_history *history){
+    if(HISTORY_INDEX_SIZE(history->index->slot_count) == history->map_size)return 0;
+    return history_map(history, history->index->slot_count);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: history_grow                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Doubles the hash table and reinserts every key. The magic is  //
+//              cleared meanwhile, so a crash halfway leaves an index that    //
+//              the next history_open() rebuilds from the log. Caller holds   //
+//              the exclusive lock.                                           //
+// Parameters: history - Open history                                         //
+// Returns: int - 0 on success, 1 if the table kept its size                  //
+////////////////////////////////////////////////////////////////////////////////
+int history_grow(struct bingo_history *history){
+    uint64_t old_count = history->index->slot_count;
+    struct history_entry *old_slots = malloc(old_count * sizeof(struct history_entry));
+    if(old_slots == NULL)return 1;
+    memcpy(old_slots, history->index->slots, old_count * sizeof(struct history_entry));
+    history->index->magic = 0;
+    if(history_map(history, old_count * 2)){
+        history->index->magic = HISTORY_MAGIC;
+        free(old_slots);
+        return 1;
+    }
+    memset(history->index->slots, 0, old_count * 2 * sizeof(struct history_entry));
+    history->index->slot_count = old_count * 2;
+    history->index->used_slots = 0;
+    for(uint64_t i = 0 ; i < old_count ; i++){
+        if(old_slots[i].player[0] == 0)continue;
+        struct history_entry *entry = history_lookup(history->index, old_slots[i].player, old_slots[i].opponent, 1);
+        entry->wins = old_slots[i].wins;
+        entry->losses = old_slots[i].losses;
+    }
+    history->index->magic = HISTORY_MAGIC;
+    free(old_slots);
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// WIRE PROTOCOL                                                              //
+////////////////////////////////////////////////////////////////////////////////
+// TCP may split one write across reads or merge several writes into one.     //
+// Frames carry their own length, and the decoder keeps partial frames until  //
+// the rest arrives, so moves are never dropped or glued together.            //
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: encode_frame                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Writes a frame header and payload into `out`, which must hold //
+//              FRAME_HEADER_SIZE + len bytes.                                //
+// Parameters: out - Destination buffer                                       //
+//             version - Protocol version to stamp in the header              //
+//             type - MSG_* message type                                      //
+//             payload, len - Payload bytes (payload may be NULL if len is 0) //
+// Returns: size_t - Number of bytes written                                  //
+////////////////////////////////////////////////////////////////////////////////
+size_t encode_frame(unsigned char *out, int version, int type, const void *payload, size_t len){
+    out[0] = version;
+    out[1] = type;
+    out[2] = len >> 8;
+    out[3] = len & 0xff;
+    if(len)memcpy(out + FRAME_HEADER_SIZE, payload, len);
+    return FRAME_HEADER_SIZE + len;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: encode_number_frame                                              //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Builds a MSG_MOVE or MSG_WIN frame carrying a 16-bit number.  //
+// Parameters: out - Destination buffer (at least 6 bytes)                    //
+//             version - Protocol version to stamp in the header              //
+//             type - MSG_MOVE or MSG_WIN                                     //
+//             number - Called number                                         //
+// Returns: size_t - Number of bytes written                                  //
+////////////////////////////////////////////////////////////////////////////////
+size_t encode_number_frame(unsigned char *out, int version, int type, int number){
+    unsigned char payload[2] = { (number >> 8) & 0xff, number & 0xff };
+    return encode_frame(out, version, type, payload, sizeof(payload));
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: encode_config_frame                                              //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Builds a MSG_CONFIG frame: card size in one byte followed by  //
+//              the highest card number and the turn timeout as 16-bit        //
+//              values. Version 2 peers read only the first three bytes.      //
+// Parameters: out - Destination buffer (at least 9 bytes)                    //
+//             version - Protocol version to stamp in the header              //
+//             size - Cells per row (N)                                       //
+//             max_number - Highest number on a card                          //
+//             timeout - Seconds per move, 0 for no limit                     //
+// Returns: size_t - Number of bytes written                                  //
+////////////////////////////////////////////////////////////////////////////////
+size_t encode_config_frame(unsigned char *out, int version, int size, int max_number, int timeout){
+    unsigned char payload[5] = { size, (max_number >> 8) & 0xff, max_number & 0xff, (timeout >> 8) & 0xff, timeout & 0xff };
+    return encode_frame(out, version, MSG_CONFIG, payload, sizeof(payload));
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: frame_number                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Extracts the number carried by a MSG_MOVE or MSG_WIN frame.   //
+// Parameters: frame - Decoded frame                                          //
+// Returns: int - The number, or 0 if the payload is too short                //
+////////////////////////////////////////////////////////////////////////////////
+int frame_number(const struct bingo_frame *frame){
+    if(frame->length < 2)return 0;
+    return (frame->payload[0] << 8) | frame->payload[1];
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: frame_decoder_space                                              //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Returns where the next read() should store bytes, so data     //
+//              lands straight in the decoder without an extra copy. A        //
+//              partial frame left at the end is moved to the front first.    //
+//              Frames returned earlier become invalid after this call.       //
+// Parameters: decoder - Frame decoder                                        //
+//             available - Receives the number of free bytes                  //
+// Returns: unsigned char * - Start of the free space                         //
+////////////////////////////////////////////////////////////////////////////////
+unsigned char *frame_decoder_space(struct frame_decoder *decoder, size_t *available){
+    if(decoder->start == decoder->end){
+        decoder->start = decoder->end = 0;
+    }else if(decoder->start > 0 && decoder->end == sizeof(decoder->buffer)){
+        memmove(decoder->buffer, decoder->buffer + decoder->start, decoder->end - decoder->start);
+        decoder->end -= decoder->start;
+        decoder->start = 0;
+    }
+    *available = sizeof(decoder->buffer) - decoder->end;
+    return decoder->buffer + decoder->end;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: frame_decoder_next                                               //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Decodes the next complete frame held by the decoder. The      //
+//              payload points into the decoder buffer and stays valid until  //
+//              frame_decoder_space() is called again.                        //
+// Parameters: decoder - Frame decoder                                        //
+//             frame - Receives the decoded frame                             //
+// Returns: int - FRAME_READY, FRAME_NEED_MORE or FRAME_ERROR                 //
+////////////////////////////////////////////////////////////////////////////////
+int frame_decoder_next(struct frame_decoder *decoder, struct bingo_frame *frame){
+    size_t buffered = decoder->end - decoder->start;
+    const unsigned char *raw = decoder->buffer + decoder->start;
+    if(buffered < FRAME_HEADER_SIZE)return FRAME_NEED_MORE;
+    size_t length = (raw[2] << 8) | raw[3];
+    if(raw[0] == 0 || length > FRAME_MAX_PAYLOAD)return FRAME_ERROR;
+    if(buffered < FRAME_HEADER_SIZE + length)return FRAME_NEED_MORE;
+    frame->version = raw[0];
+    frame->type = raw[1];
+    frame->length = length;
+    frame->payload = raw + FRAME_HEADER_SIZE;
+    frame->raw = raw;
+    decoder->start += FRAME_HEADER_SIZE + length;
+    return FRAME_READY;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: send_frame                                                       //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Encodes one frame with the agreed protocol version and writes //
+//              all of it to a blocking socket.                               //
+// Parameters: fd - Socket to write to                                        //
+//             type - MSG_* message type                                      //
+//             payload, len - Payload bytes                                   //
+// Returns: int - 0 on success, -1 on failure                                 //
+////////////////////////////////////////////////////////////////////////////////
+int send_frame(int fd, int type, const void *payload, size_t len){
+    unsigned char frame[FRAME_DECODER_SIZE];
+    if(len > FRAME_MAX_PAYLOAD)return -1;
+    size_t total = encode_frame(frame, protocol_version, type, payload, len);
+    size_t offset = 0;
+    while(offset < total){
+        ssize_t bytes_sent = write(fd, frame + offset, total - offset);
+        if(bytes_sent < 0 && errno == EINTR)continue;
+        if(bytes_sent <= 0)return -1;
+        offset += bytes_sent;
+    }
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: send_number                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Sends a MSG_MOVE or MSG_WIN frame on a blocking socket.       //
+// Parameters: fd - Socket to write to                                        //
+//             type - MSG_MOVE or MSG_WIN                                     //
+//             number - Called number                                         //
+// Returns: int - 0 on success, -1 on failure                                 //
+////////////////////////////////////////////////////////////////////////////////
+int send_number(int fd, int type, int number){
+    unsigned char payload[2] = { (number >> 8) & 0xff, number & 0xff };
+    return send_frame(fd, type, payload, sizeof(payload));
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: send_config                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Sends the card size, number range and turn timeout of the     //
+//              match.                                                        //
+// Parameters: fd - Socket to write to                                        //
+//             size - Cells per row (N)                                       //
+//             max_number - Highest number on a card                          //
+//             timeout - Seconds per move, 0 for no limit                     //
+// Returns: int - 0 on success, -1 on failure                                 //
+////////////////////////////////////////////////////////////////////////////////
+int send_config(int fd, int size, int max_number, int timeout){
+    unsigned char payload[5] = { size, (max_number >> 8) & 0xff, max_number & 0xff, (timeout >> 8) & 0xff, timeout & 0xff };
+    return send_frame(fd, MSG_CONFIG, payload, sizeof(payload));
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: read_frame                                                       //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Returns the next frame from a blocking socket, reading only   //
+//              when the decoder has no complete frame buffered. Several      //
+//              frames that arrived in one read are returned one by one.      //
+// Parameters: fd - Socket to read from                                       //
+//             decoder - Decoder holding bytes already received on `fd`       //
+//             frame - Receives the decoded frame                             //
+// Returns: int - FRAME_READY, or FRAME_ERROR on corrupt stream / EOF (errno  //
+//               is 0 on a clean EOF)                                         //
+////////////////////////////////////////////////////////////////////////////////
+int read_frame(int fd, struct frame_decoder *decoder, struct bingo_frame *frame){
+    while(1){
+        int status = frame_decoder_next(decoder, frame);
+        if(status != FRAME_NEED_MORE)return status;
+        size_t available;
+        unsigned char *space = frame_decoder_space(decoder, &available);
+        ssize_t bytes_read = read(fd, space, available);
+        if(bytes_read < 0 && errno == EINTR)continue;
+        if(bytes_read == 0)errno = 0;
+        if(bytes_read <= 0)return FRAME_ERROR;
+        decoder->end += bytes_read;
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: read_frame_until                                                 //
+////////////////////////////////////////////////////////////////////////////////
+// Description: read_frame() that gives up at a deadline, so a peer sending   //
+//              nothing or half a frame cannot hold us past it.               //
+// Parameters: fd - Socket to read from                                       //
+//             decoder - Decoder holding bytes already received on `fd`       //
+//             frame - Receives the decoded frame                             //
+//             deadline - game_loop_now() time to give up at                  //
+// Returns: int - FRAME_READY, or FRAME_ERROR on corrupt stream, EOF or time- //
+//               out (errno is ETIMEDOUT)                                     //
+////////////////////////////////////////////////////////////////////////////////
+int read_frame_until(int fd, struct frame_decoder *decoder, struct bingo_frame *frame, uint64_t deadline){
+    while(1){
+        int status = frame_decoder_next(decoder, frame);
+        if(status != FRAME_NEED_MORE)return status;
+        struct pollfd peer = { fd, POLLIN, 0 };
+        uint64_t now = game_loop_now();
+        int ready = now < deadline ? poll(&peer, 1, (int)(deadline - now)) : 0;
+        if(ready < 0 && errno == EINTR)continue;
+        if(ready == 0)errno = ETIMEDOUT;
+        if(ready <= 0)return FRAME_ERROR;
+        size_t available;
+        unsigned char *space = frame_decoder_space(decoder, &available);
+        ssize_t bytes_read = read(fd, space, available);
+        if(bytes_read < 0 && errno == EINTR)continue;
+        if(bytes_read == 0)errno = 0;
+        if(bytes_read <= 0)return FRAME_ERROR;
+        decoder->end += bytes_read;
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// CLIENT EVENT LOOP                                                          //
+////////////////////////////////////////////////////////////////////////////////
+// One poll() watches stdin and the opponent's socket together, so typed      //
+// lines and frames are handled in whatever order they arrive. Lines typed    //
+// before our turn wait in the input buffer. The mover loses with MSG_TIMEOUT //
+// once the turn limit passes; on version 3 both sides send MSG_PING after    //
+// HEARTBEAT_INTERVAL of silence and give up on a peer not heard from for     //
+// HEARTBEAT_TIMEOUT, so a half-open connection is noticed in bounded time.   //
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: game_loop_now                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Reads the monotonic clock used for turn and heartbeat timers. //
+// Parameters: void                                                           //
+// Returns: uint64_t - Milliseconds since an arbitrary start                  //
+////////////////////////////////////////////////////////////////////////////////
+uint64_t game_loop_now(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: run_game_loop                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Plays the match once names and card config are agreed. Waits  //
+//              in poll() until stdin or the socket is readable or the next   //
+//              turn / heartbeat deadline is due, and sets game_result, or    //
+//              connection_lost when the opponent's socket fails. A resumed   //
+//              match picks up the turn from the checkpointed calls.          //
+// Parameters: void                                                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void run_game_loop(void){
+    struct game_loop loop;
+    struct pollfd fds[2];
+    struct bingo_frame frame;
+    int peer = current_player == 1 ? PLAYER_NO_2 : PLAYER_NO_1;
+
+    int calls = session ? session->call_count : 0;
+
+    memset(&loop, 0, sizeof(loop));
+    connection_lost = DEFAULT_STATUS;
+    loop.peer_fd = current_player == 1 ? player_2_fd : player_1_fd;
+    loop.hall = caller_hall;
+    loop.my_turn = (current_player == 2) == (calls % 2 == 0) && !loop.hall;  // Player 2 makes the even calls
+    loop.last_number = calls ? session->calls[calls - 1] : 0;
+    loop.turn_limit = protocol_version >= 3 && !loop.hall ? turn_timeout : 0;
+    loop.heartbeat = protocol_version >= 3 && !loop.hall;
+    loop.turn_start = loop.last_sent = loop.last_heard = game_loop_now();
+    signal(SIGPIPE,SIG_IGN);
+    if(loop.turn_limit)printf("%d seconds per move\n",loop.turn_limit);
+    while(frame_decoder_next(&peer_decoder, &frame) == FRAME_READY)
+        if(game_loop_frame(&loop, &frame))return;
+
+    while(1){
+        if(!loop.prompt_shown){
+            if(loop.hall)printf("Waiting for the next round, type exit to leave\n");
+            else if(!loop.my_turn)printf("\nWating for player-%d( %s )..\n",peer + 1,player_names[peer]);
+            else if(loop.last_number)printf("Player_%d ( %s ) choosed : %d\n\nType Your No : ",peer + 1,player_names[peer],loop.last_number);
+            else printf("Player_%d ( %s ) You to start\n\nType Your No : ",peer + 1,player_names[peer]);
+            fflush(stdout);
+            loop.prompt_shown = SET_VALUE;
+        }
+
+        char *newline = memchr(loop.input, '\n', loop.input_len);
+        if(newline && (loop.my_turn || loop.hall || strncmp(loop.input,"exit",4) == 0)){
+            *newline = 0;
+            int done = game_loop_line(&loop, loop.input);
+            loop.input_len -= newline + 1 - loop.input;
+            memmove(loop.input, newline + 1, loop.input_len);
+            if(done)return;
+            continue;
+        }
+        if(loop.input_closed && loop.my_turn){
+            send_frame(loop.peer_fd, MSG_QUIT, NULL, 0);
+            return;
+        }
+
+        uint64_t now = game_loop_now(), deadline = UINT64_MAX;
+        if(loop.turn_limit)deadline = loop.turn_start + (loop.turn_limit + (loop.my_turn ? 0 : HEARTBEAT_TIMEOUT)) * 1000ull;
+        if(loop.heartbeat){
+            if(loop.last_sent + HEARTBEAT_INTERVAL * 1000ull < deadline)deadline = loop.last_sent + HEARTBEAT_INTERVAL * 1000ull;
+            if(loop.last_heard + HEARTBEAT_TIMEOUT * 1000ull < deadline)deadline = loop.last_heard + HEARTBEAT_TIMEOUT * 1000ull;
+        }
+        int wait = deadline == UINT64_MAX ? -1 : deadline > now ? (int)(deadline - now) : 0;
+
+        fds[0].fd = loop.input_closed ? -1 : STDIN_FILENO;
+        fds[0].events = POLLIN;
+        fds[1].fd = loop.peer_fd;
+        fds[1].events = POLLIN;
+        fds[0].revents = fds[1].revents = 0;
+        if(poll(fds, 2, wait) < 0 && errno != EINTR){
+            perror("poll failed");
+            return;
+        }
+
+        if(fds[0].revents & (POLLIN|POLLHUP|POLLERR)){
+            if(loop.input_len == sizeof(loop.input))loop.input_len = 0;
+            ssize_t bytes_read = read(STDIN_FILENO, loop.input + loop.input_len, sizeof(loop.input) - loop.input_len);
+            if(bytes_read > 0)loop.input_len += bytes_read;
+            else if(bytes_read == 0 || errno != EINTR)loop.input_closed = SET_VALUE;
+        }
+        if(fds[1].revents & (POLLIN|POLLHUP|POLLERR)){
+            size_t available;
+            unsigned char *space = frame_decoder_space(&peer_decoder, &available);
+            ssize_t bytes_read = read(loop.peer_fd, space, available);
+            int status = FRAME_ERROR;
+            if(bytes_read < 0 && errno == EINTR)continue;
+            if(bytes_read > 0){
+                peer_decoder.end += bytes_read;
+                loop.last_heard = game_loop_now();
+                while((status = frame_decoder_next(&peer_decoder, &frame)) == FRAME_READY)
+                    if(game_loop_frame(&loop, &frame))return;
+            }
+            if(status == FRAME_ERROR){
+                (bytes_read < 0)?perror("Read failed"):printf("Player - %d ( %s )disconnected.\n",peer + 1,player_names[peer]);
+                connection_lost = SET_VALUE;
+                return;
+            }
+        }
+        if(game_loop_timers(&loop, game_loop_now()))return;
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: game_loop_frame                                                  //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Handles one frame from the opponent. A move hands the turn    //
+//              to us, MSG_PING only proves the peer is alive (see            //
+//              last_heard) and unknown types are skipped.                    //
+// Parameters: loop - Loop state                                              //
+//             frame - Decoded frame                                          //
+// Returns: int - 1 once the match is over, 0 to keep playing                 //
+////////////////////////////////////////////////////////////////////////////////
+int game_loop_frame(struct game_loop *loop, const struct bingo_frame *frame){
+    int me = current_player - 1, peer = 1 - me;
+    if(loop->hall)return game_loop_hall_frame(loop, frame);
+    if(frame->type == MSG_WIN){
+        int number = frame_number(frame);
+        if(recorder.call_count == 0 || recorder.calls[recorder.call_count - 1] != number)record_call(number);
+        printf("\n( %s )You LOST the MATCH Better Luck Next Time..\n",player_names[me]);
+        game_result = PLAYER_LOSE;
+        return 1;
+    }
+    if(frame->type == MSG_TIMEOUT){
+        printf("\nPlayer - %d ( %s ) ran out of time\n( %s )You WON the MATCH\n",peer + 1,player_names[peer],player_names[me]);
+        game_result = PLAYER_WIN;
+        return 1;
+    }
+    if(frame->type == MSG_QUIT){
+        printf("Player - %d ( %s )disconnected.\n",peer + 1,player_names[peer]);
+        return 1;
+    }
+    if(frame->type != MSG_MOVE || loop->my_turn)return 0;
+    loop->last_number = frame_number(frame);
+    session_record(loop->last_number);
+    record_call(loop->last_number);
+    if(!send_to_bingo(loop->last_number)){
+        send_number(loop->peer_fd, MSG_WIN, loop->last_number);
+        printf("\n( %s )You WON the MATCH\n",player_names[me]);
+        game_result = PLAYER_WIN;
+        return 1;
+    }
+    loop->my_turn = SET_VALUE;
+    loop->prompt_shown = DEFAULT_STATUS;
+    loop->turn_start = game_loop_now();
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: game_loop_hall_frame                                             //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Handles one frame from a caller hall: a new card each round,  //
+//              called numbers to mark, a snapshot of them after falling      //
+//              behind, and the server's own count of our lines and the       //
+//              round's winners, which decide the result.                     //
+// Parameters: loop - Loop state                                              //
+//             frame - Decoded frame                                          //
+// Returns: int - 1 once the hall closes the session, 0 to keep playing       //
+////////////////////////////////////////////////////////////////////////////////
+int game_loop_hall_frame(struct game_loop *loop, const struct bingo_frame *frame){
+    int me = current_player - 1;
+    if(frame->type == MSG_CARD && frame->length >= 8){
+        card_seed = 0;
+        for(int i = 0 ; i < 8 ; i++)card_seed = card_seed << 8 | frame->payload[i];
+        deal_bingo_card();
+        printf("New round, good luck ( %s )\n",player_names[me]);
+    }else if(frame->type == MSG_CALL && bingo_grid.size){
+        loop->last_number = frame_number(frame);
+        mark_number(loop->last_number);
+        printf("Caller : %d\n",loop->last_number);
+    }else if(frame->type == MSG_SNAPSHOT && bingo_grid.size){
+        for(int i = 0 ; i + 1 < frame->length ; i += 2)
+            mark_number(loop->last_number = (frame->payload[i] << 8) | frame->payload[i + 1]);
+        printf("Caught up with the caller, %d numbers marked\n",(int)frame->length / 2);
+    }else if(frame->type == MSG_LINES && frame->length >= 3){
+        int lines = (frame->payload[0] << 8) | frame->payload[1];
+        if(frame->payload[2])printf("\n( %s )Your BINGO is confirmed, %d lines\n",player_names[me],lines);
+        else printf("Caller confirms %d lines\n",lines);
+    }else if(frame->type == MSG_ROUND_END && frame->length >= 4){
+        int calls = (frame->payload[0] << 8) | frame->payload[1];
+        int winners = (frame->payload[2] << 8) | frame->payload[3];
+        printf("Round over after %d calls, %d winner%s : %.*s\n",calls,winners,winners == 1 ? "" : "s",
+               (int)frame->length - 4,(const char *)frame->payload + 4);
+        bingo_card_free(&bingo_grid);
+    }else if(frame->type == MSG_QUIT){
+        printf("The caller hall closed.\n");
+        return 1;
+    }
+    fflush(stdout);
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: game_loop_line                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Plays one typed line: "exit" leaves at any time, "hint" asks  //
+//              the move advisor, a number on the card range is our move;     //
+//              anything else asks again.                                     //
+// Parameters: loop - Loop state                                              //
+//             line - Typed line without its newline                          //
+// Returns: int - 1 once the match is over, 0 to keep playing                 //
+////////////////////////////////////////////////////////////////////////////////
+int game_loop_line(struct game_loop *loop, const char *line){
+    int me = current_player - 1;
+    while(*line == ' ' || *line == '\t' || *line == '\r')line++;
+    if(strncmp(line,"exit",4) == 0){
+        send_frame(loop->peer_fd, MSG_QUIT, NULL, 0);
+        return 1;
+    }
+    if(*line == 0)return 0;
+    if(strncmp(line,"hint",4) == 0 && !loop->hall){
+        game_loop_hint(loop);
+        return 0;
+    }
+    if(loop->hall){
+        printf("The caller picks the numbers, type exit to leave\n");
+        fflush(stdout);
+        return 0;
+    }
+    int number = atoi(line);
+    if(number < 1 || number > bingo_grid.max_number){
+        printf("Numbers run from 1 to %d\n\nType Your No : ",bingo_grid.max_number);
+        fflush(stdout);
+        return 0;
+    }
+    if(!send_to_bingo(number)){
+        record_call(number);
+        send_number(loop->peer_fd, MSG_WIN, number);
+        printf("\n( %s )You WON the MATCH\n",player_names[me]);
+        game_result = PLAYER_WIN;
+        return 1;
+    }
+    if(send_number(loop->peer_fd, MSG_MOVE, number) < 0){
+        perror("Write failed");
+        connection_lost = SET_VALUE;
+        return 1;
+    }
+    session_record(number);
+    record_call(number);
+    loop->my_turn = DEFAULT_STATUS;
+    loop->prompt_shown = DEFAULT_STATUS;
+    loop->turn_start = loop->last_sent = game_loop_now();
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: game_loop_hint                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Suggests our next number from the move advisor, with the      //
+//              share of its simulated finishes that we went on to win.       //
+// Parameters: loop - Loop state                                              //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void game_loop_hint(const struct game_loop *loop){
+    struct advisor_result advice;
+    if(!loop->my_turn)printf("Hints are given on your turn\n");
+    else if(advise_move(card_seed, card_size, card_max_number, recorder.calls, recorder.call_count, ADVISOR_BUDGET_MS, &advice))
+        printf("No number is left to call\n");
+    else if(advice.simulations)
+        printf("Hint : call %d, it won %.0f%% of %ld simulated finishes over %d numbers\n\nType Your No : ",
+               advice.number, 100 * advice.win_rate, advice.simulations, advice.candidates);
+    else printf("Hint : call %d\n\nType Your No : ", advice.number);
+    fflush(stdout);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: game_loop_timers                                                 //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Acts on due deadlines: our turn running out (we forfeit with  //
+//              MSG_TIMEOUT), the opponent over-running its turn by more than //
+//              HEARTBEAT_TIMEOUT (we win), a heartbeat to send, or a peer    //
+//              that has gone silent (the match ends without a result).       //
+// Parameters: loop - Loop state                                              //
+//             now - Current game_loop_now() time                             //
+// Returns: int - 1 once the match is over, 0 to keep playing                 //
+////////////////////////////////////////////////////////////////////////////////
+int game_loop_timers(struct game_loop *loop, uint64_t now){
+    int me = current_player - 1, peer = 1 - me;
+    if(loop->turn_limit && loop->my_turn && now >= loop->turn_start + loop->turn_limit * 1000ull){
+        send_frame(loop->peer_fd, MSG_TIMEOUT, NULL, 0);
+        printf("\nTime is up\n( %s )You LOST the MATCH Better Luck Next Time..\n",player_names[me]);
+        game_result = PLAYER_LOSE;
+        return 1;
+    }
+    if(loop->turn_limit && !loop->my_turn && now >= loop->turn_start + (loop->turn_limit + HEARTBEAT_TIMEOUT) * 1000ull){
+        printf("\nPlayer - %d ( %s ) ran out of time\n( %s )You WON the MATCH\n",peer + 1,player_names[peer],player_names[me]);
+        game_result = PLAYER_WIN;
+        return 1;
+    }
+    if(!loop->heartbeat)return 0;
+    if(now >= loop->last_heard + HEARTBEAT_TIMEOUT * 1000ull){
+        printf("\nPlayer - %d ( %s ) stopped responding.\n",peer + 1,player_names[peer]);
+        connection_lost = SET_VALUE;
+        return 1;
+    }
+    if(now >= loop->last_sent + HEARTBEAT_INTERVAL * 1000ull){
+        if(send_frame(loop->peer_fd, MSG_PING, NULL, 0) < 0){
+            printf("Player - %d ( %s )disconnected.\n",peer + 1,player_names[peer]);
+            connection_lost = SET_VALUE;
+            return 1;
+        }
+        loop->last_sent = now;
+    }
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// SESSION RESUME                                                             //
+////////////////////////////////////////////////////////////////////////////////
+// On v7 the host of a match (Player 1 or the game server) gives each guest a //
+// resume token. Each player checkpoints its match into a small mmap'd file:  //
+// the card seed and config, both names, the role and every called number,    //
+// one store per move. The marks and whose turn it is follow from the calls.  //
+// When the connection drops mid-match, Player 1 waits for the guest on its   //
+// listening socket and a guest reconnects and sends MSG_RESUME with its      //
+// token; a game server keeps the seat for RESUME_GRACE seconds. The host's   //
+// list of calls wins: it is sent back and the card is rebuilt from it. A     //
+// crashed client picks the match up again with --resume <nick name>.         //
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: session_open                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Maps the checkpoint file of a nick name, creating it if       //
+//              needed. Stores into the mapping reach the file without any    //
+//              system call and survive the process.                          //
+// Parameters: name - Nick name of the player on this machine                 //
+// Returns: int - 0 on success, 1 on failure                                  //
+////////////////////////////////////////////////////////////////////////////////
+int session_open(const char *name){
+    char path[64];
+    snprintf(path, sizeof(path), SESSION_PATH, name);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if(fd < 0){
+        perror("Session Open Error");
+        return 1;
+    }
+    if(ftruncate(fd, sizeof(struct session_snapshot)) < 0){
+        perror("Session Open Error");
+        close(fd);
+        return 1;
+    }
+    session = mmap(NULL, sizeof(struct session_snapshot), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(session == MAP_FAILED){
+        perror("Session Open Error");
+        session = NULL;
+        return 1;
+    }
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: session_begin                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Checkpoints a match that is about to start. Matches without a //
+//              resume token (older peers, caller hall) are not checkpointed. //
+// Parameters: void                                                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void session_begin(void){
+    if(!resume_token || caller_hall || computer_game)return;
+    if(session == NULL && session_open(player_names[current_player-1]))return;
+    session->magic = 0;
+    session->token = resume_token;
+    session->card_seed = card_seed;
+    session->current_player = current_player;
+    session->joined_game_server = joined_game_server;
+    session->card_size = card_size;
+    session->max_number = card_max_number;
+    session->turn_timeout = turn_timeout;
+    session->protocol_version = protocol_version;
+    memcpy(session->player_names, player_names, sizeof(session->player_names));
+    snprintf(session->host, sizeof(session->host), "%s", inet_ntoa(server_address.sin_addr));
+    session->call_count = 0;
+    session->magic = SESSION_MAGIC;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: session_record                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Checkpoints one called number, ours once sent or the          //
+//              opponent's once received: one store and a count bump.         //
+// Parameters: number - Called number                                         //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void session_record(int number){
+    if(session == NULL || session->call_count >= MAX_CARD_NUMBER)return;
+    session->calls[session->call_count] = number;
+    __atomic_store_n(&session->call_count, session->call_count + 1, __ATOMIC_RELEASE);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: session_finish                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Drops the checkpoint of a match that ended for good, so a     //
+//              later --resume does not find it.                              //
+// Parameters: void                                                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void session_finish(void){
+    char path[64];
+    if(session == NULL)return;
+    session->magic = 0;
+    snprintf(path, sizeof(path), SESSION_PATH, player_names[current_player-1]);
+    unlink(path);
+    munmap(session, sizeof(struct session_snapshot));
+    session = NULL;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: session_load                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Adopts the checkpoint left by a client that died mid-match:   //
+//              role, names, config, token and the host to reconnect to.      //
+// Parameters: name - Nick name the match was played under                    //
+// Returns: int - 0 on success, 1 if there is no match to resume              //
+////////////////////////////////////////////////////////////////////////////////
+int session_load(const char *name){
+    struct stat session_stat;
+    char path[64];
+    snprintf(path, sizeof(path), SESSION_PATH, name);
+    if(stat(path, &session_stat) < 0 || session_stat.st_size != sizeof(struct session_snapshot) || session_open(name))return 1;
+    if(session->magic != SESSION_MAGIC || (session->current_player != 1 && session->current_player != 2) ||
+       !valid_card_config(session->card_size, session->max_number) || session->call_count > (uint32_t)session->max_number){
+        munmap(session, sizeof(struct session_snapshot));
+        session = NULL;
+        return 1;
+    }
+    resume_token = session->token;
+    current_player = session->current_player;
+    joined_game_server = session->joined_game_server;
+    card_size = session->card_size;
+    card_max_number = session->max_number;
+    turn_timeout = session->turn_timeout;
+    protocol_version = session->protocol_version;
+    card_seed = session->card_seed;
+    memcpy(player_names, session->player_names, sizeof(player_names));
+    for(int i = 0 ; i < PLAYERS_SIZE ; i++)player_names[i][19] = 0;
+    session->host[sizeof(session->host) - 1] = 0;
+    memset(&server_address, 0, sizeof(server_address));
+    server_address.sin_family = AF_INET;
+    server_address.sin_port = htons(PORT);
+    inet_pton(AF_INET, session->host, &server_address.sin_addr);
+    player_1_fd = player_2_fd = -1;
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: session_restore                                                  //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Rebuilds the card from its seed, marks every called number    //
+//              and redraws it, without the loading animation.                //
+// Parameters: void                                                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void session_restore(void){
+    card_seed = session->card_seed;
+    if(bingo_card_init(&bingo_grid, card_size, card_max_number)){
+        perror("Card allocation failed");
+        exit(1);
+    }
+    bingo_card_generate(&bingo_grid, card_seed);
+    for(uint32_t i = 0 ; i < session->call_count ; i++)bingo_card_mark(&bingo_grid, session->calls[i]);
+    if(!recorder.started_ms)record_start();  // Resumed after a crash: times count from here
+    if(recorder.call_count > (int)session->call_count)recorder.call_count = session->call_count;
+    while(recorder.call_count < (int)session->call_count)record_call(session->calls[recorder.call_count]);
+    count = check_for_win();
+    display_grid();
+    printf("Match resumed after %u calls\n", session->call_count);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: session_reconnect                                                //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Takes a match up again after its connection dropped. Player 1 //
+//              of a direct match accepts on its listening socket until the   //
+//              guest shows the right token, allowing each client             //
+//              RESUME_HELLO_MS to show one; everyone else reconnects to      //
+//              Player 1 or the game server and sends MSG_RESUME. Both give   //
+//              up after RESUME_GRACE seconds, reads included.                //
+// Parameters: void                                                           //
+// Returns: int - 0 once the match can go on, 1 if it is lost                 //
+////////////////////////////////////////////////////////////////////////////////
+int session_reconnect(void){
+    uint64_t deadline = game_loop_now() + RESUME_GRACE * 1000ull;
+    int host = current_player == 1 && !joined_game_server;
+    if(session == NULL)return 1;
+    printf("\nConnection lost, trying to resume the match for %d seconds..\n",RESUME_GRACE);
+    fflush(stdout);
+    if(host){
+        if(player_2_fd >= 0)close(player_2_fd);
+        player_2_fd = -1;
+        if(player_1_fd < 0){
+            int enable = SET_VALUE;
+            struct sockaddr_in address = server_address;
+            address.sin_addr.s_addr = INADDR_ANY;
+            player_1_fd = socket(AF_INET, SOCK_STREAM, 0);
+            setsockopt(player_1_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+            if(player_1_fd < 0 || bind(player_1_fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(player_1_fd, 1) < 0){
+                perror("Listen failed");
+                return 1;
+            }
+        }
+        if(!transport_tcp_only && local_listen_fd < 0)local_listen_fd = transport_listen(PORT, 0, 1);
+    }else if(player_1_fd >= 0){
+        close(player_1_fd);
+        player_1_fd = -1;
+    }
+    while(game_loop_now() < deadline){
+        int fd;
+        if(host){
+            if((fd = transport_accept(player_1_fd, local_listen_fd, (int)(deadline - game_loop_now()))) < 0)continue;
+            memset(&peer_decoder, 0, sizeof(peer_decoder));
+            uint64_t hello = game_loop_now() + RESUME_HELLO_MS;
+            if(session_accept(fd, hello < deadline ? hello : deadline)){
+                close(fd);
+                continue;
+            }
+            player_2_fd = fd;
+        }else{
+            unsigned char token[8];
+            if((fd = transport_connect(&server_address, NULL)) < 0){
+                sleep(1);
+                continue;
+            }
+            for(int b = 0 ; b < 8 ; b++)token[b] = resume_token >> (56 - 8*b);
+            memset(&peer_decoder, 0, sizeof(peer_decoder));
+            if(send_frame(fd, MSG_RESUME, token, sizeof(token)) < 0 || session_read_calls(fd, deadline)){
+                close(fd);
+                break;
+            }
+            player_1_fd = fd;
+            if(current_player == 1)player_2_fd = fd;
+        }
+        session_restore();
+        return 0;
+    }
+    printf("Could not resume the match.\n");
+    return 1;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: session_accept                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Host side of a resume: the guest's first frame must be        //
+//              MSG_RESUME with the token it was given; it is answered with   //
+//              our calls, which the guest adopts. Anyone else gets MSG_QUIT, //
+//              and a client still silent at the deadline is dropped.         //
+// Parameters: fd - Newly accepted connection                                 //
+//             deadline - game_loop_now() time the resume gives up at         //
+// Returns: int - 0 if the guest is back, 1 otherwise                         //
+////////////////////////////////////////////////////////////////////////////////
+int session_accept(int fd, uint64_t deadline){
+    struct bingo_frame frame;
+    uint64_t token = 0;
+    if(read_frame_until(fd, &peer_decoder, &frame, deadline) != FRAME_READY || frame.type != MSG_RESUME || frame.length < 8)return 1;
+    for(int b = 0 ; b < 8 ; b++)token = token << 8 | frame.payload[b];
+    if(token != resume_token){
+        send_frame(fd, MSG_QUIT, NULL, 0);
+        return 1;
+    }
+    return session_send_calls(fd, session->calls, session->call_count);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: session_send_calls                                               //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Sends MSG_RESUME with the number of calls, then the calls in  //
+//              MSG_SNAPSHOT chunks, the same way the game server does.       //
+// Parameters: fd - Guest's socket                                            //
+//             calls, call_count - Numbers called so far                      //
+// Returns: int - 0 on success, 1 on a failed write                           //
+////////////////////////////////////////////////////////////////////////////////
+int session_send_calls(int fd, const uint16_t *calls, int call_count){
+    unsigned char payload[FRAME_MAX_PAYLOAD] = { call_count >> 8, call_count & 0xff };
+    if(send_frame(fd, MSG_RESUME, payload, 2) < 0)return 1;
+    for(int i = 0 ; i < call_count ; i += FRAME_MAX_PAYLOAD / 2){
+        int chunk = call_count - i < FRAME_MAX_PAYLOAD / 2 ? call_count - i : FRAME_MAX_PAYLOAD / 2;
+        for(int k = 0 ; k < chunk ; k++){
+            payload[2*k] = calls[i + k] >> 8;
+            payload[2*k + 1] = calls[i + k] & 0xff;
+        }
+        if(send_frame(fd, MSG_SNAPSHOT, payload, 2 * chunk) < 0)return 1;
+    }
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: session_read_calls                                               //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Guest side of a resume: reads the host's MSG_RESUME and the   //
+//              MSG_SNAPSHOT chunks after it and replaces our calls with      //
+//              them, undoing a move of ours the host never got.              //
+// Parameters: fd - Socket to the host                                        //
+//             deadline - game_loop_now() time the resume gives up at         //
+// Returns: int - 0 on success, 1 if the host refused, the stream broke or    //
+//                the deadline passed                                         //
+////////////////////////////////////////////////////////////////////////////////
+int session_read_calls(int fd, uint64_t deadline){
+    struct bingo_frame frame;
+    int call_count;
+    do{
+        if(read_frame_until(fd, &peer_decoder, &frame, deadline) != FRAME_READY || frame.type == MSG_QUIT){
+            printf("The match is no longer there to resume.\n");
+            return 1;
+        }
+    }while(frame.type != MSG_RESUME || frame.length < 2);
+    call_count = (frame.payload[0] << 8) | frame.payload[1];
+    if(call_count > card_max_number)return 1;
+    session->call_count = 0;
+    while((int)session->call_count < call_count){
+        if(read_frame_until(fd, &peer_decoder, &frame, deadline) != FRAME_READY)return 1;
+        if(frame.type != MSG_SNAPSHOT)continue;
+        for(int i = 0 ; i + 1 < frame.length && (int)session->call_count < call_count ; i += 2)
+            session_record((frame.payload[i] << 8) | frame.payload[i + 1]);
+    }
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// GAME RECORDING                                                             //
+////////////////////////////////////////////////////////////////////////////////
+// The host of a match (Player 1, or a game server run with --record) appends //
+// it to a recording file once it ends: the card config, both card seeds and  //
+// every called number with the milliseconds since the previous call, about   //
+// 90 bytes for a 5x5 match. The seeds and calls rebuild both cards and every //
+// mark exactly, so nothing else is stored. Cards stay secret while a match   //
+// runs; from protocol version 8 each player reveals its seed with MSG_CARD   //
+// once the match is decided. bingo_replay.c reads the files back.            //
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: record_put_varint                                                //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Writes a value 7 bits per byte, low group first, with the top //
+//              bit set on every byte but the last.                           //
+// Parameters: out - Destination, at least 10 bytes                           //
+//             value - Value to write                                         //
+// Returns: size_t - Bytes written                                            //
+////////////////////////////////////////////////////////////////////////////////
+size_t record_put_varint(unsigned char *out, uint64_t value){
+    size_t len = 0;
+    while(value >= 0x80){
+        out[len++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    out[len++] = value;
+    return len;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: record_get_varint                                                //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Reads a value written by record_put_varint().                 //
+// Parameters: data, len - Bytes available                                    //
+//             value - Receives the value                                     //
+// Returns: size_t - Bytes read, 0 if truncated or longer than 64 bits        //
+////////////////////////////////////////////////////////////////////////////////
+size_t record_get_varint(const unsigned char *data, size_t len, uint64_t *value){
+    *value = 0;
+    for(size_t i = 0 ; i < len && i < 10 ; i++){
+        *value |= (uint64_t)(data[i] & 0x7f) << (7 * i);
+        if(!(data[i] & 0x80))return i + 1;
+    }
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: record_encode                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Packs one match in the layout described under MACROS FOR      //
+//              GAME RECORDING.                                               //
+// Parameters: out - Destination, RECORD_MAX_SIZE(call_count) bytes           //
+//             record - Match to pack                                         //
+// Returns: size_t - Bytes written                                            //
+////////////////////////////////////////////////////////////////////////////////
+size_t record_encode(unsigned char *out, const struct game_record *record){
+    size_t len = 0;
+    uint32_t last = 0;
+    out[len++] = RECORD_MARK;
+    out[len++] = record->winner;
+    out[len++] = record->card_size;
+    out[len++] = record->max_number >> 8;
+    out[len++] = record->max_number & 0xff;
+    len += record_put_varint(out + len, record->start);
+    for(int p = 0 ; p < PLAYERS_SIZE ; p++)
+        for(int b = 0 ; b < 8 ; b++)out[len++] = record->seeds[p] >> (56 - 8*b);
+    len += record_put_varint(out + len, record->call_count);
+    for(int i = 0 ; i < record->call_count ; i++){
+        if(record->max_number > 0xff)out[len++] = record->calls[i] >> 8;
+        out[len++] = record->calls[i] & 0xff;
+        len += record_put_varint(out + len, record->call_ms[i] > last ? record->call_ms[i] - last : 0);
+        if(record->call_ms[i] > last)last = record->call_ms[i];
+    }
+    return len;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: record_decode                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Unpacks the record at the start of a buffer into the caller's //
+//              calls and call_ms arrays (MAX_CARD_NUMBER entries each).      //
+// Parameters: data, len - Bytes available                                    //
+//             record - Receives the match                                    //
+// Returns: size_t - Bytes used, 0 if the record is truncated or corrupt      //
+////////////////////////////////////////////////////////////////////////////////
+size_t record_decode(const unsigned char *data, size_t len, struct game_record *record){
+    size_t pos = 5, used;
+    uint64_t value;
+    uint32_t at = 0;
+    if(len < pos || data[0] != RECORD_MARK || data[1] > RECORD_NO_WINNER)return 0;
+    record->winner = data[1];
+    record->card_size = data[2];
+    record->max_number = (data[3] << 8) | data[4];
+    if(!valid_card_config(record->card_size, record->max_number))return 0;
+    if(!(used = record_get_varint(data + pos, len - pos, &record->start)))return 0;
+    pos += used;
+    if(len - pos < 8 * PLAYERS_SIZE)return 0;
+    for(int p = 0 ; p < PLAYERS_SIZE ; p++){
+        record->seeds[p] = 0;
+        for(int b = 0 ; b < 8 ; b++)record->seeds[p] = record->seeds[p] << 8 | data[pos++];
+    }
+    if(!(used = record_get_varint(data + pos, len - pos, &value)) || value > (uint64_t)record->max_number)return 0;
+    pos += used;
+    record->call_count = value;
+    int wide = record->max_number > 0xff;
+    for(int i = 0 ; i < record->call_count ; i++){
+        if(len - pos < (size_t)(1 + wide))return 0;
+        record->calls[i] = wide ? (data[pos] << 8) | data[pos + 1] : data[pos];
+        pos += 1 + wide;
+        if(!(used = record_get_varint(data + pos, len - pos, &value)))return 0;
+        pos += used;
+        at += value;
+        record->call_ms[i] = at;
+    }
+    return pos;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: record_open                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Opens a recording file for appending, creating it with its    //
+//              magic under flock() so that no record can land before it.     //
+//              Every record is then added with one write() on O_APPEND, so   //
+//              several processes and threads can share the file.             //
+// Parameters: path - Recording file                                          //
+// Returns: int - File descriptor, -1 on failure                              //
+////////////////////////////////////////////////////////////////////////////////
+int record_open(const char *path){
+    struct stat file_stat;
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0666);
+    if(fd < 0)return -1;
+    flock(fd, LOCK_EX);
+    if(fstat(fd, &file_stat) < 0 || (file_stat.st_size == 0 &&
+       write(fd, RECORD_FILE_MAGIC, RECORD_MAGIC_SIZE) != RECORD_MAGIC_SIZE)){
+        close(fd);
+        return -1;
+    }
+    flock(fd, LOCK_UN);
+    return fd;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: record_start                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Starts recording the match about to be played here.           //
+// Parameters: void                                                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void record_start(void){
+    recorder.started_ms = game_loop_now();
+    recorder.started_at = time(NULL);
+    recorder.peer_seed = 0;
+    recorder.call_count = 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: record_call                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Records one called number with the time since the start.      //
+// Parameters: number - Called number                                         //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void record_call(int number){
+    if(recorder.call_count >= MAX_CARD_NUMBER)return;
+    recorder.calls[recorder.call_count] = number;
+    recorder.call_ms[recorder.call_count++] = game_loop_now() - recorder.started_ms;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: reveal_card_seeds                                                //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Sends our card seed in MSG_CARD once a match is decided and   //
+//              waits up to HEARTBEAT_TIMEOUT for the opponent's, which the   //
+//              game server also reads for its own recording. Needs protocol  //
+//              version 8 on both sides; later frames stay in peer_decoder.   //
+// Parameters: void                                                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void reveal_card_seeds(void){
+    struct bingo_frame frame;
+    unsigned char seed[8];
+    int peer_fd = current_player == 1 ? player_2_fd : player_1_fd;
+    uint64_t deadline = game_loop_now() + HEARTBEAT_TIMEOUT * 1000ull;
+
+    if(caller_hall || connection_lost || protocol_version < RECORD_MIN_VERSION ||
+       (game_result != PLAYER_WIN && game_result != PLAYER_LOSE))return;
+    for(int b = 0 ; b < 8 ; b++)seed[b] = card_seed >> (56 - 8*b);
+    if(send_frame(peer_fd, MSG_CARD, seed, sizeof(seed)) < 0)return;
+    while(1){
+        int status;
+        while((status = frame_decoder_next(&peer_decoder, &frame)) == FRAME_READY){
+            if(frame.type == MSG_QUIT)return;
+            if(frame.type != MSG_CARD || frame.length < 8)continue;
+            for(int b = 0 ; b < 8 ; b++)recorder.peer_seed = recorder.peer_seed << 8 | frame.payload[b];
+            return;
+        }
+        uint64_t now = game_loop_now();
+        struct pollfd peer = { peer_fd, POLLIN, 0 };
+        if(status == FRAME_ERROR || now >= deadline || poll(&peer, 1, (int)(deadline - now)) <= 0)return;
+        size_t available;
+        unsigned char *space = frame_decoder_space(&peer_decoder, &available);
+        ssize_t bytes_read = read(peer_fd, space, available);
+        if(bytes_read <= 0)return;
+        peer_decoder.end += bytes_read;
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: record_game                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Appends the match that just ended to the recording file       //
+//              (--record, RECORD_PATH by default). Only Player 1 of a direct //
+//              match records, so each match is stored once; Player 2 calls   //
+//              first.                                                        //
+// Parameters: void                                                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void record_game(void){
+    struct game_record record;
+    unsigned char *data;
+    int fd;
+    if(current_player != 1 || joined_game_server || caller_hall || !recorder.started_ms)return;
+    record.winner = game_result == PLAYER_WIN ? RECORD_SECOND_MOVER : game_result == PLAYER_LOSE ? RECORD_FIRST_MOVER : RECORD_NO_WINNER;
+    record.card_size = card_size;
+    record.max_number = card_max_number;
+    record.start = recorder.started_at;
+    record.seeds[0] = recorder.peer_seed;
+    record.seeds[1] = card_seed;
+    record.call_count = recorder.call_count;
+    record.calls = recorder.calls;
+    record.call_ms = recorder.call_ms;
+    recorder.started_ms = 0;
+    data = malloc(RECORD_MAX_SIZE(record.call_count));
+    fd = record_open(record_path ? record_path : RECORD_PATH);
+    if(data && fd >= 0){
+        size_t len = record_encode(data, &record);
+        if(write(fd, data, len) != (ssize_t)len)perror("Recording write failed");
+    }else{
+        perror("Recording failed");
+    }
+    if(fd >= 0)close(fd);
+    free(data);
+}
+////////////////////////////////////////////////////////////////////////////////
+// GAME SERVER                                                                //
+////////////////////////////////////////////////////////////////////////////////
+// The server runs one shard per core. Each shard is an edge-triggered epoll  //
+// loop on its own thread with its own SO_REUSEPORT socket on PORT, so the    //
+// kernel spreads new connections over the shards. A room lives on one shard  //
+// for its whole life: moves, spectators and output never leave that thread   //
+// and take no lock. Only seating is shared. A short lobby lock tells which   //
+// shard holds the room waiting for a second player, and an unseated          //
+// connection is handed to that shard (or to a less loaded one) through an    //
+// eventfd inbox before its match starts. Clients on this host connect to one //
+// Unix socket instead, which every shard watches with EPOLLEXCLUSIVE.        //
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: handle_server_sigint                                             //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Stops the server event loops on SIGINT (Ctrl+C).              //
+// Parameters: sig_no - Signal number (unused in this implementation)         //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void handle_server_sigint(int sig_no){
+    server_running = DEFAULT_STATUS;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: run_game_server                                                  //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Runs the dedicated game server. Opens one shard per thread    //
+//              (--threads, one per core by default; a caller hall is a       //
+//              single room and runs on one) and, with --metrics, a thread    //
+//              answering scrapes. Runs shard 0 on this thread and wakes and  //
+//              joins the others once interrupted.                            //
+// Parameters: void                                                           //
+// Returns: int - Exit status (0 for success)                                 //
+////////////////////////////////////////////////////////////////////////////////
+int run_game_server(void){
+    struct server_group group;
+    sigset_t block, saved;
+    long rooms = 0, connections = 0;
+    int started = 0, status = 0;
+
+    memset(&group, 0, sizeof(group));
+    group.count = server_threads ? server_threads : sysconf(_SC_NPROCESSORS_ONLN);
+    if(group.count < 1)group.count = 1;
+    if(group.count > SERVER_MAX_SHARDS)group.count = SERVER_MAX_SHARDS;
+    if(caller_interval)group.count = 1;
+    group.metrics_fd = -1;
+    group.record_fd = -1;
+    group.local_fd = transport_tcp_only ? -1 : transport_listen(PORT, SOCK_NONBLOCK, SERVER_BACKLOG);
+    pthread_mutex_init(&group.lobby_lock, NULL);
+    group.shards = calloc(group.count, sizeof(*group.shards));
+    if(group.shards == NULL){
+        perror("calloc failed");
+        return 1;
+    }
+    signal(SIGINT,handle_server_sigint);
+    signal(SIGPIPE,SIG_IGN);
+    for(int i = 0 ; i < group.count ; i++){
+        struct bingo_server *server = &group.shards[i];
+        server->index = i;
+        server->group = &group;
+        server->card_size = card_size;
+        server->max_number = card_max_number;
+        server->turn_timeout = turn_timeout;
+        bingo_rng_seed(&server->rng, new_card_seed() + i);
+        if(record_path && !caller_interval && (server->record_buffer = malloc(RECORD_BUFFER_SIZE)) == NULL){
+            perror("Recording buffer allocation failed");
+            status = 1;
+            break;
+        }
+        pthread_mutex_init(&server->inbox_lock, NULL);
+        if(server_listen(server)){
+            status = 1;
+            break;
+        }
+        started++;
+    }
+    if(!status && caller_interval && (group.shards[0].hall = hall_create(card_size, card_max_number, caller_interval)) == NULL){
+        perror("Caller hall allocation failed");
+        status = 1;
+    }
+    if(!status && metrics_port && metrics_listen(&group, metrics_port))status = 1;
+    if(!status && group.shards[0].record_buffer && (group.record_fd = record_open(record_path)) < 0){
+        perror("Recording file open failed");
+        status = 1;
+    }
+    if(!status){
+        printf("Bingo game server listening on port %d, %dx%d cards with numbers 1-%d, %d event loop%s\n",PORT,card_size,card_size,
+               card_max_number,group.count,group.count == 1 ? "" : "s");
+        if(group.shards[0].hall)printf("Caller hall : one number every %d ms\n",caller_interval);
+        if(group.local_fd >= 0)printf("Clients on this host connect over the Unix socket @" LOCAL_SOCKET_NAME "\n",PORT);
+        if(group.metrics_fd >= 0)printf("Metrics on http://127.0.0.1:%d/\n",metrics_port);
+        if(group.record_fd >= 0)printf("Recording matches to %s\n",record_path);
+        fflush(stdout);
+        sigemptyset(&block);
+        sigaddset(&block, SIGINT);
+        pthread_sigmask(SIG_BLOCK, &block, &saved);  // Only this thread takes Ctrl+C
+        for(int i = 1 ; i < group.count ; i++)
+            pthread_create(&group.shards[i].thread, NULL, server_shard_main, &group.shards[i]);
+        if(group.metrics_fd >= 0)pthread_create(&group.metrics_thread, NULL, metrics_main, &group);
+        pthread_sigmask(SIG_SETMASK, &saved, NULL);
+        server_loop(&group.shards[0]);
+        for(int i = 1 ; i < group.count ; i++){
+            uint64_t wake = 1;
+            if(write(group.shards[i].inbox_fd, &wake, sizeof(wake)) < 0)perror("eventfd write failed");
+        }
+        for(int i = 1 ; i < group.count ; i++)pthread_join(group.shards[i].thread, NULL);
+        if(group.metrics_fd >= 0){
+            shutdown(group.metrics_fd, SHUT_RDWR);  // Wakes the blocked accept()
+            pthread_join(group.metrics_thread, NULL);
+        }
+    }
+    if(group.metrics_fd >= 0)close(group.metrics_fd);
+    if(group.record_fd >= 0)close(group.record_fd);
+    if(group.local_fd >= 0)close(group.local_fd);
+    for(int i = 0 ; i < started ; i++)free(group.shards[i].record_buffer);
+    for(int i = 0 ; i < started ; i++){
+        rooms += group.shards[i].active_rooms;
+        connections += group.shards[i].active_connections;
+        close(group.shards[i].listen_fd);
+        close(group.shards[i].epoll_fd);
+        close(group.shards[i].inbox_fd);
+    }
+    if(!status)printf("\nGame server stopping : %ld rooms, %ld connections\n",rooms,connections);
+    hall_free(group.shards[0].hall);
+    free(group.shards);
+    return status;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_shard_main                                                //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Thread entry point of shards 1 and up.                        //
+// Parameters: arg - The shard's bingo_server                                 //
+// Returns: void * - NULL                                                     //
+////////////////////////////////////////////////////////////////////////////////
+void *server_shard_main(void *arg){
+    server_loop(arg);
+    return NULL;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_loop                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Runs one shard's event loop until SIGINT: accepts on its own  //
+//              socket, serves its connections, adopts connections handed     //
+//              over by other shards and, at the end of every batch, ends     //
+//              seats not reclaimed in time, frees closed connections, hands  //
+//              off the leaving ones and publishes its load and gauges.       //
+// Parameters: server - Shard to run                                          //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_loop(struct bingo_server *server){
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while(server_running){
+        int wait = server->away_rooms || server->record_len ? 1000 : -1;
+        if(server->hall){
+            uint64_t now = game_loop_now();
+            wait = server->hall->next_call > now ? (int)(server->hall->next_call - now) : 0;
+        }
+        int ready = epoll_wait(server->epoll_fd, events, SERVER_MAX_EVENTS, wait);
+        if(ready < 0){
+            if(errno == EINTR)continue;
+            perror("epoll_wait failed");
+            server_running = DEFAULT_STATUS;
+            break;
+        }
+        for(int i = 0 ; i < ready ; i++){
+            struct bingo_connection *conn = events[i].data.ptr;
+            if(conn == NULL){
+                server_accept(server, server->listen_fd);
+                continue;
+            }
+            if(events[i].data.ptr == (void *)server){
+                server_adopt(server);
+                continue;
+            }
+            if(events[i].data.ptr == (void *)server->group){
+                server_accept(server, server->group->local_fd);
+                continue;
+            }
+            if(conn->closed || conn->moving)continue;
+            if(events[i].events & (EPOLLIN|EPOLLRDHUP|EPOLLHUP|EPOLLERR))server_read(server,conn);
+            if(!conn->closed && !conn->moving && (events[i].events & EPOLLOUT))server_flush(server,conn);
+        }
+        if(server->hall && game_loop_now() >= server->hall->next_call)hall_tick(server);
+        if(server->away_rooms)server_expire(server);
+        if(server->record_len && game_loop_now() - server->record_since >= RECORD_FLUSH_MS)server_record_flush(server);
+        while(server->closed){
+            struct bingo_connection *conn = server->closed;
+            server->closed = conn->next_closed;
+            free(conn);
+        }
+        while(server->moving){
+            struct bingo_connection *conn = server->moving;
+            struct bingo_server *target = &server->group->shards[conn->target];
+            uint64_t wake = 1;
+            server->moving = conn->next_moved;
+            pthread_mutex_lock(&target->inbox_lock);
+            conn->next_moved = target->inbox;
+            target->inbox = conn;
+            pthread_mutex_unlock(&target->inbox_lock);
+            if(write(target->inbox_fd, &wake, sizeof(wake)) < 0)perror("eventfd write failed");
+        }
+        __atomic_store_n(&server->load, server->active_rooms, __ATOMIC_RELAXED);
+        __atomic_store_n(&server->metrics.rooms, server->active_rooms, __ATOMIC_RELAXED);
+        __atomic_store_n(&server->metrics.away_rooms, server->away_rooms, __ATOMIC_RELAXED);
+        __atomic_store_n(&server->metrics.connections, server->active_connections, __ATOMIC_RELAXED);
+    }
+    for(struct bingo_room *room = server->rooms ; room ; room = room->next)
+        server_record(server, room);  // Decided, still waiting for a seed
+    server_record_flush(server);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_listen                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Creates the shard's non-blocking listening socket on PORT,    //
+//              shared with the other shards through SO_REUSEPORT, its inbox  //
+//              eventfd and the epoll instance that watches both and the      //
+//              group's Unix listener, if any.                                //
+// Parameters: server - Shard to initialise                                   //
+// Returns: int - 0 on success, 1 on failure                                 //
+////////////////////////////////////////////////////////////////////////////////
+int server_listen(struct bingo_server *server){
+    struct sockaddr_in address;
+    struct epoll_event event;
+    int enable = SET_VALUE;
+
+    server->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if(server->listen_fd < 0){
+        perror("Socket failed");
+        return 1;
+    }
+    setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(PORT);
+    address.sin_addr.s_addr = INADDR_ANY;
+    if(bind(server->listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0){
+        perror("Bind failed");
+        close(server->listen_fd);
+        return 1;
+    }
+    if(listen(server->listen_fd, SERVER_BACKLOG) < 0){
+        perror("Listen failed");
+        close(server->listen_fd);
+        return 1;
+    }
+    server->epoll_fd = epoll_create1(0);
+    if(server->epoll_fd < 0){
+        perror("epoll_create1 failed");
+        close(server->listen_fd);
+        return 1;
+    }
+    server->inbox_fd = eventfd(0, EFD_NONBLOCK);
+    if(server->inbox_fd < 0){
+        perror("eventfd failed");
+        close(server->listen_fd);
+        close(server->epoll_fd);
+        return 1;
+    }
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = NULL;
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &event);
+    event.data.ptr = server;
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->inbox_fd, &event);
+    if(server->group->local_fd >= 0){
+        event.events = EPOLLIN | EPOLLET | EPOLLEXCLUSIVE;  // One shard wakes per arrival
+        event.data.ptr = server->group;
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->group->local_fd, &event);
+    }
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_move                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Hands an unseated connection over to another shard. It leaves //
+//              this shard's epoll at once and the target's inbox after the   //
+//              current event batch, so stale events here never touch it.     //
+// Parameters: server - Shard giving the connection away                      //
+//             conn - Unseated connection                                     //
+//             target - Index of the shard taking it                          //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_move(struct bingo_server *server, struct bingo_connection *conn, int target){
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    conn->moving = SET_VALUE;
+    conn->target = target;
+    conn->next_moved = server->moving;
+    server->moving = conn;
+    server->active_connections--;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_adopt                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Takes the connections other shards handed over, then seats    //
+//              each player, goes on looking for each spectator's match or    //
+//              gives a returning player its seat back, and serves whatever   //
+//              the client sent in the meantime.                              //
+// Parameters: server - Shard taking the connections                          //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_adopt(struct bingo_server *server){
+    struct bingo_connection *inbox;
+    uint64_t count;
+    if(read(server->inbox_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)perror("eventfd read failed");
+    pthread_mutex_lock(&server->inbox_lock);
+    inbox = server->inbox;
+    server->inbox = NULL;
+    pthread_mutex_unlock(&server->inbox_lock);
+    while(inbox){
+        struct bingo_connection *conn = inbox;
+        struct epoll_event event;
+        inbox = conn->next_moved;
+        conn->moving = DEFAULT_STATUS;
+        server->active_connections++;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = conn;
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, conn->fd, &event);
+        if(conn->watching){
+            server_watch(server, conn);
+        }else if(conn->resume_token){
+            server_resume(server, conn);
+        }else{
+            int status = server_seat(server, conn);
+            if(status < 0)server_close(server, conn, CLOSE_NO_MEMORY);
+            else if(status == 0)server_named(server, conn);
+        }
+        if(!conn->closed && !conn->moving)server_read(server, conn);
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_accept                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Accepts every pending connection. Nobody is seated yet: the   //
+//              first message decides between playing (MSG_HELLO), watching   //
+//              (MSG_WATCH) or, with --caller, holding a hall card.           //
+// Parameters: server - Server state                                          //
+//             listen_fd - The shard's TCP socket or the group's Unix socket  //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_accept(struct bingo_server *server, int listen_fd){
+    int enable = SET_VALUE, local = listen_fd != server->listen_fd;
+    while(1){
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK);
+        if(fd < 0){
+            if(errno == EINTR || errno == ECONNABORTED)continue;
+            if(errno != EAGAIN && errno != EWOULDBLOCK)perror("Accept failed");
+            return;
+        }
+        if(!local)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        struct bingo_connection *conn = calloc(1, sizeof(*conn));
+        if(conn == NULL){
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->hall_member = conn->hall_card = -1;
+        server->active_connections++;
+        METRIC_ADD(server, accepted, 1);
+        if(local)METRIC_ADD(server, accepted_local, 1);
+
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = conn;
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_seat                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Finds a seat for a player who sent MSG_HELLO. The lobby names //
+//              the one room in the process waiting for a second player; the  //
+//              player fills it, here or on its shard. Otherwise the player   //
+//              opens a room on this shard, or on the least loaded shard once //
+//              this one holds SHARD_REBALANCE_SLACK rooms more, and takes    //
+//              seat PLAYER_NO_2 to type first.                               //
+// Parameters: server - Shard the player is on                                //
+//             conn - Unseated player with its name and version set           //
+// Returns: int - 0 when seated here, 1 when handed to another shard, -1 on   //
+//                allocation failure                                          //
+////////////////////////////////////////////////////////////////////////////////
+int server_seat(struct bingo_server *server, struct bingo_connection *conn){
+    struct server_group *group = server->group;
+    struct bingo_room *room = conn->join_room;
+    if(room){
+        conn->join_room = NULL;
+        pthread_mutex_lock(&group->lobby_lock);
+        room->expecting = DEFAULT_STATUS;
+        pthread_mutex_unlock(&group->lobby_lock);
+        if(room->players[PLAYER_NO_2] == NULL){  // Its first player left meanwhile
+            server_release_room(server, room);
+        }else{
+            server_fill(server, conn, room);
+            return 0;
+        }
+    }
+    pthread_mutex_lock(&group->lobby_lock);
+    if((room = group->waiting)){
+        int shard = group->waiting_shard;
+        group->waiting = NULL;
+        if(shard == server->index){
+            pthread_mutex_unlock(&group->lobby_lock);
+            server_fill(server, conn, room);
+            return 0;
+        }
+        room->expecting = SET_VALUE;
+        pthread_mutex_unlock(&group->lobby_lock);
+        conn->join_room = room;
+        server_move(server, conn, shard);
+        return 1;
+    }
+    int target = server->index;
+    long lightest = server->active_rooms;
+    for(int i = 0 ; !conn->hops && i < group->count ; i++){
+        long load = __atomic_load_n(&group->shards[i].load, __ATOMIC_RELAXED);
+        if(load + SHARD_REBALANCE_SLACK < lightest){
+            lightest = load + SHARD_REBALANCE_SLACK;
+            target = i;
+        }
+    }
+    if(target != server->index){
+        pthread_mutex_unlock(&group->lobby_lock);
+        conn->hops++;
+        server_move(server, conn, target);
+        return 1;
+    }
+    room = server->free_rooms;
+    if(room)server->free_rooms = room->next_free;
+    else room = malloc(sizeof(*room));
+    if(room == NULL){
+        pthread_mutex_unlock(&group->lobby_lock);
+        return -1;
+    }
+    memset(room, 0, sizeof(*room));
+    room->next = server->rooms;
+    if(server->rooms)server->rooms->prev = room;
+    server->rooms = room;
+    server->active_rooms++;
+    group->waiting = room;
+    group->waiting_shard = server->index;
+    pthread_mutex_unlock(&group->lobby_lock);
+    conn->seat = PLAYER_NO_2;
+    conn->room = room;
+    room->players[PLAYER_NO_2] = conn;
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_fill                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Seats a player as PLAYER_NO_1 in a room of this shard that    //
+//              holds its first player and was taken off the lobby.           //
+// Parameters: server - Shard owning the room                                 //
+//             conn - Second player of the room                               //
+//             room - Room to fill                                            //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_fill(struct bingo_server *server, struct bingo_connection *conn, struct bingo_room *room){
+    conn->seat = PLAYER_NO_1;
+    conn->room = room;
+    room->players[PLAYER_NO_1] = conn;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_named                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Records a seated player's nick name. Once both seats are      //
+//              named each player gets "<role>:<opponent>" and, on version 2, //
+//              the card config. Both seats are told the lower of their two   //
+//              versions, so they agree on heartbeats; --size/--numbers apply //
+//              only if both speak v2. On v7 each seat also gets a resume     //
+//              token; its top byte names this shard.                         //
+// Parameters: server - Shard of the room                                     //
+//             conn - Seated player with its name and version set             //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_named(struct bingo_server *server, struct bingo_connection *conn){
+    struct bingo_room *room = conn->room;
+    memcpy(room->player_names[conn->seat], conn->name, sizeof(room->player_names[0]));
+    room->name_transfer_flag |= 1 << conn->seat;
+    if(room->name_transfer_flag != ((1 << PLAYERS_SIZE) - 1))return;
+    int version = room->players[PLAYER_NO_1]->version < room->players[PLAYER_NO_2]->version ?
+                  room->players[PLAYER_NO_1]->version : room->players[PLAYER_NO_2]->version;
+    room->card_size = BINGO_CARD_SIZE;
+    room->max_number = MAX_NUMBER;
+    room->turn_timeout = server->turn_timeout;
+    room->started_ms = game_loop_now();
+    room->started_at = time(NULL);
+    if(version >= 2){
+        room->card_size = server->card_size;
+        room->max_number = server->max_number;
+    }
+    for(int seat = 0 ; seat < PLAYERS_SIZE ; seat++){
+        unsigned char payload[20], reply[3*FRAME_HEADER_SIZE + sizeof(payload) + 5 + 8];
+        size_t name_len = strlen(room->player_names[1 - seat]);
+        payload[0] = seat + 1;
+        memcpy(payload + 1, room->player_names[1 - seat], name_len);
+        size_t len = encode_frame(reply, version, MSG_PAIRED, payload, name_len + 1);
+        if(version >= 2)
+            len += encode_config_frame(reply + len, version, room->card_size, room->max_number, room->turn_timeout);
+        if(version >= RESUME_MIN_VERSION){
+            unsigned char token[8];
+            room->tokens[seat] = (bingo_rng_next(&server->rng) >> 8 | 1) | (uint64_t)server->index << 56;
+            for(int b = 0 ; b < 8 ; b++)token[b] = room->tokens[seat] >> (56 - 8*b);
+            len += encode_frame(reply + len, version, MSG_TOKEN, token, sizeof(token));
+        }
+        server_send(server, room->players[seat], reply, len);
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_watch                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Makes a connection a spectator of the running match of the    //
+//              named player (any match for an empty name) and sends it the   //
+//              match so far. Matches live on one shard each, so the request  //
+//              is passed on around the shards; after the last one the        //
+//              spectator gets MSG_QUIT.                                      //
+// Parameters: server - Server state                                          //
+//             conn - Unseated connection with the name it asked for          //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_watch(struct bingo_server *server, struct bingo_connection *conn){
+    struct bingo_room *room;
+    for(room = server->rooms ; room ; room = room->next){
+        if(room->name_transfer_flag != ((1 << PLAYERS_SIZE) - 1))continue;
+        if(conn->name[0] == 0 || strcmp(room->player_names[PLAYER_NO_1], conn->name) == 0 ||
+           strcmp(room->player_names[PLAYER_NO_2], conn->name) == 0)break;
+    }
+    if(room == NULL && conn->hops + 1 < server->group->count){
+        conn->hops++;
+        conn->watching = SET_VALUE;
+        server_move(server, conn, (server->index + 1) % server->group->count);
+        return;
+    }
+    conn->watching = DEFAULT_STATUS;
+    if(room == NULL){
+        unsigned char quit[FRAME_HEADER_SIZE];
+        server_send(server, conn, quit, encode_frame(quit, conn->version, MSG_QUIT, NULL, 0));
+        server_close(server, conn, CLOSE_REFUSED);
+        return;
+    }
+    conn->room = room;
+    conn->spectator = SET_VALUE;
+    conn->watch_next = room->spectators;
+    if(room->spectators)room->spectators->watch_prev = conn;
+    room->spectators = conn;
+    room->spectator_count++;
+    server_catch_up(server, conn);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_resume                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Gives a returning player the seat its token was issued for.   //
+//              The token names the shard holding the room, so the request    //
+//              is handed there first. A seat still held by the old, silent   //
+//              connection is taken over. The player gets MSG_RESUME with the //
+//              number of calls and every call, which its card is rebuilt     //
+//              from; an unknown token or a decided match gets MSG_QUIT.      //
+// Parameters: server - Server state                                          //
+//             conn - Unseated connection with resume_token set               //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_resume(struct bingo_server *server, struct bingo_connection *conn){
+    struct bingo_room *room;
+    int shard = conn->resume_token >> 56, seat = 0;
+    if(shard != server->index && shard < server->group->count && conn->hops == 0){
+        conn->hops++;
+        server_move(server, conn, shard);
+        return;
+    }
+    for(room = conn->resume_token ? server->rooms : NULL ; room ; room = room->next){
+        if(room->decided)continue;
+        if(room->tokens[PLAYER_NO_1] == conn->resume_token){
+            seat = PLAYER_NO_1;
+            break;
+        }
+        if(room->tokens[PLAYER_NO_2] == conn->resume_token){
+            seat = PLAYER_NO_2;
+            break;
+        }
+    }
+    conn->resume_token = 0;
+    if(room == NULL){
+        unsigned char quit[FRAME_HEADER_SIZE];
+        server_send(server, conn, quit, encode_frame(quit, conn->version, MSG_QUIT, NULL, 0));
+        server_close(server, conn, CLOSE_REFUSED);
+        return;
+    }
+    struct bingo_connection *old = room->players[seat];
+    if(old){
+        old->room = NULL;  // Closes on its own, the room stays
+        server_close(server, old, CLOSE_REPLACED);
+    }
+    conn->seat = seat;
+    conn->room = room;
+    room->players[seat] = conn;
+    memcpy(conn->name, room->player_names[seat], sizeof(conn->name));
+    if(room->away_until && room->players[1 - seat]){
+        room->away_until = 0;
+        server->away_rooms--;
+    }
+    unsigned char head[FRAME_HEADER_SIZE + 2], count[2] = { room->call_count >> 8, room->call_count & 0xff };
+    server_send_calls(server, conn, head, encode_frame(head, conn->version, MSG_RESUME, count, sizeof(count)), room->calls, room->call_count);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_read                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Serves the frames already buffered for a connection, then     //
+//              drains its socket, until it would block, closes or is handed  //
+//              to another shard. Moves between players are timed for the     //
+//              metrics.                                                      //
+// Parameters: server - Server state                                          //
+//             conn - Readable connection                                     //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_read(struct bingo_server *server, struct bingo_connection *conn){
+    struct bingo_frame frame;
+    while(1){
+        int status;
+        while(!conn->closed && !conn->moving && (status = frame_decoder_next(&conn->decoder, &frame)) == FRAME_READY){
+            if(frame.type != MSG_MOVE || conn->room == NULL || conn->spectator || server->hall){
+                server_frame(server, conn, &frame);
+                continue;
+            }
+            uint64_t start = metrics_now_ns();
+            server_frame(server, conn, &frame);
+            metrics_record_move(server, metrics_now_ns() - start);
+        }
+        if(conn->closed || conn->moving)return;
+        if(status == FRAME_ERROR){
+            server_close(server, conn, CLOSE_PROTOCOL);
+            return;
+        }
+        size_t available;
+        unsigned char *space = frame_decoder_space(&conn->decoder, &available);
+        ssize_t bytes_read = read(conn->fd, space, available);
+        METRIC_ADD(server, reads, 1);
+        if(bytes_read > 0)METRIC_ADD(server, bytes_read, bytes_read);
+        if(bytes_read < 0 && errno == EINTR)continue;
+        if(bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))return;
+        if(bytes_read <= 0){
+            server_close(server, conn, bytes_read == 0 ? CLOSE_HANGUP : CLOSE_SOCKET_ERROR);
+            return;
+        }
+        conn->decoder.end += bytes_read;
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_frame                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Serves one frame. The first message of a connection is its    //
+//              nick name (MSG_HELLO, to play) or the player it wants to      //
+//              watch (MSG_WATCH). Afterwards bytes are relayed as-is to the  //
+//              other seat, moves are kept for late spectators and game       //
+//              events are fanned out to the spectators. MSG_RESUME takes a   //
+//              dropped player's seat back. Once both seats have              //
+//              sent MSG_REMATCH the calls start over and spectators get the  //
+//              new match header. Spectators only listen. In a caller hall    //
+//              only MSG_HELLO counts; the server calls the numbers and       //
+//              judges BINGO itself, so claims are ignored.                   //
+// Parameters: server - Server state                                          //
+//             conn - Connection that sent the frame                          //
+//             frame - Decoded frame                                          //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_frame(struct bingo_server *server, struct bingo_connection *conn, const struct bingo_frame *frame){
+    struct bingo_room *room = conn->room;
+    if(server->hall || room == NULL){
+        if(frame->type != MSG_HELLO && ((frame->type != MSG_WATCH && frame->type != MSG_RESUME) || server->hall))return;
+        if(conn->hall_member >= 0)return;
+        memset(conn->name, 0, sizeof(conn->name));
+        memcpy(conn->name, frame->payload, frame->length < 19 ? frame->length : 19);
+        conn->version = frame->version < PROTOCOL_VERSION ? frame->version : PROTOCOL_VERSION;
+        if(server->hall){
+            hall_join(server, conn);
+        }else if(frame->type == MSG_WATCH){
+            server_watch(server, conn);
+        }else if(frame->type == MSG_RESUME){
+            conn->resume_token = 0;
+            for(int b = 0 ; b < 8 && b < frame->length ; b++)conn->resume_token = conn->resume_token << 8 | frame->payload[b];
+            server_resume(server, conn);
+        }else{
+            int status = server_seat(server, conn);
+            if(status < 0)server_close(server, conn, CLOSE_NO_MEMORY);
+            else if(status == 0)server_named(server, conn);
+        }
+        return;
+    }
+    if(conn->spectator || room->name_transfer_flag != ((1 << PLAYERS_SIZE) - 1))return;
+    struct bingo_connection *peer = room->players[1 - conn->seat];
+    if(peer)server_send(server, peer, frame->raw, FRAME_HEADER_SIZE + frame->length);
+    else if(frame->type == MSG_PING)server_send(server, conn, frame->raw, FRAME_HEADER_SIZE);  // Stand in while the seat is away
+    if(conn->closed)return;
+    if(!room->decided && (frame->type == MSG_WIN || frame->type == MSG_TIMEOUT || frame->type == MSG_QUIT)){
+        room->decided = SET_VALUE;
+        if(frame->type != MSG_QUIT)room->winner = (frame->type == MSG_WIN ? conn->seat : 1 - conn->seat) + 1;
+        if(frame->type == MSG_WIN && server->record_buffer &&   // Our own winning number never went out as a move
+           (room->call_count == 0 || room->calls[room->call_count - 1] != frame_number(frame)))
+            server_add_call(server, room, frame_number(frame));
+    }
+    if(frame->type == MSG_MOVE){
+        server_add_call(server, room, frame_number(frame));
+    }else if(frame->type == MSG_CARD && room->decided && frame->length >= 8){
+        room->seeds[conn->seat] = 0;
+        for(int b = 0 ; b < 8 ; b++)room->seeds[conn->seat] = room->seeds[conn->seat] << 8 | frame->payload[b];
+        room->revealed |= 1 << conn->seat;
+        if(room->revealed == (1 << PLAYERS_SIZE) - 1)server_record(server, room);
+    }else if(frame->type == MSG_REMATCH){
+        room->rematch |= 1 << conn->seat;
+        if(room->rematch != (1 << PLAYERS_SIZE) - 1)return;
+        server_record(server, room);
+        room->rematch = 0;
+        room->decided = room->winner = room->revealed = room->recorded = DEFAULT_STATUS;
+        room->call_count = 0;
+        room->started_ms = game_loop_now();
+        room->started_at = time(NULL);
+        for(struct bingo_connection *watcher = room->spectators, *next ; watcher ; watcher = next){
+            next = watcher->watch_next;
+            if(!watcher->lagging)server_catch_up(server, watcher);  // New match header, no calls yet
+        }
+        return;
+    }
+    if(room->spectators && frame->length <= FRAME_MAX_PAYLOAD - FRAME_HEADER_SIZE - 1 &&
+       (frame->type == MSG_MOVE || frame->type == MSG_WIN || frame->type == MSG_QUIT || frame->type == MSG_TIMEOUT)){
+        unsigned char payload[1 + FRAME_DECODER_SIZE], played[2*FRAME_HEADER_SIZE + 1 + FRAME_MAX_PAYLOAD];
+        payload[0] = conn->seat;
+        memcpy(payload + 1, frame->raw, FRAME_HEADER_SIZE + frame->length);
+        struct shared_frame *shared = shared_frame_new(played, encode_frame(played, PROTOCOL_VERSION, MSG_PLAYED, payload, 1 + FRAME_HEADER_SIZE + frame->length));
+        for(struct bingo_connection *watcher = room->spectators, *next ; shared && watcher ; watcher = next){
+            next = watcher->watch_next;
+            server_send_shared(server, watcher, shared);
+        }
+        shared_frame_release(shared);
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_add_call                                                  //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Keeps a called number of a room for resumes, spectators and,  //
+//              with --record, its time since the start of the match.         //
+// Parameters: server - Server state                                          //
+//             room - Room of the match                                       //
+//             number - Called number                                         //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_add_call(struct bingo_server *server, struct bingo_room *room, int number){
+    if(room->call_count == room->call_capacity){
+        int capacity = room->call_capacity ? 2 * room->call_capacity : 2 * MAX_NUMBER;
+        uint16_t *calls = realloc(room->calls, capacity * sizeof(uint16_t));
+        if(calls == NULL)return;
+        room->calls = calls;
+        if(server->record_buffer){
+            uint32_t *call_ms = realloc(room->call_ms, capacity * sizeof(uint32_t));
+            if(call_ms == NULL)return;
+            room->call_ms = call_ms;
+        }
+        room->call_capacity = capacity;
+    }
+    if(server->record_buffer)room->call_ms[room->call_count] = game_loop_now() - room->started_ms;
+    room->calls[room->call_count++] = number;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_record                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Adds a decided match to the shard's recording buffer, once:   //
+//              when both seeds are revealed, or at the latest when the room  //
+//              starts a rematch, is released or the server stops. A seed     //
+//              never revealed (below v8) is recorded as 0.                   //
+// Parameters: server - Server state                                          //
+//             room - Room of the match                                       //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_record(struct bingo_server *server, struct bingo_room *room){
+    struct game_record record;
+    unsigned char *data;
+    if(!server->record_buffer || !room->decided || room->recorded)return;
+    room->recorded = SET_VALUE;
+    record.winner = room->winner == 0 ? RECORD_NO_WINNER :
+                    room->winner - 1 == PLAYER_NO_2 ? RECORD_FIRST_MOVER : RECORD_SECOND_MOVER;
+    record.card_size = room->card_size;
+    record.max_number = room->max_number;
+    record.start = room->started_at;
+    record.seeds[RECORD_FIRST_MOVER] = room->seeds[PLAYER_NO_2];  // Seat 2 always calls first
+    record.seeds[RECORD_SECOND_MOVER] = room->seeds[PLAYER_NO_1];
+    record.call_count = room->call_count < room->max_number ? room->call_count : room->max_number;
+    record.calls = room->calls;
+    record.call_ms = room->call_ms;
+    if(RECORD_MAX_SIZE(record.call_count) > RECORD_BUFFER_SIZE - server->record_len)server_record_flush(server);
+    if(RECORD_MAX_SIZE(record.call_count) > RECORD_BUFFER_SIZE){
+        if((data = malloc(RECORD_MAX_SIZE(record.call_count))) == NULL)return;
+        size_t len = record_encode(data, &record);
+        if(write(server->group->record_fd, data, len) != (ssize_t)len)perror("Recording write failed");
+        free(data);
+        return;
+    }
+    if(server->record_len == 0)server->record_since = game_loop_now();
+    server->record_len += record_encode(server->record_buffer + server->record_len, &record);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_record_flush                                              //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Appends the shard's buffered matches with one write(); at     //
+//              most RECORD_FLUSH_MS after the oldest one ended.              //
+// Parameters: server - Server state                                          //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_record_flush(struct bingo_server *server){
+    if(server->record_len == 0)return;
+    if(write(server->group->record_fd, server->record_buffer, server->record_len) != (ssize_t)server->record_len)
+        perror("Recording write failed");
+    server->record_len = 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// SHARED OUTPUT FRAMES                                                       //
+////////////////////////////////////////////////////////////////////////////////
+// A message for many sockets is encoded once into a reference-counted frame. //
+// Each connection queues pointers to the frames it still owes, never copies, //
+// and server_flush() hands the whole queue to one writev(). A spectator or   //
+// hall member whose queue fills up is not allowed to hold up the rest: its   //
+// queue is dropped and it is sent a snapshot once its socket drains.         //
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: shared_frame_new                                                 //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Copies encoded bytes into a new shared frame holding one      //
+//              reference for the caller.                                     //
+// Parameters: data, len - Encoded frame(s)                                   //
+// Returns: struct shared_frame * - New frame, or NULL on allocation failure  //
+////////////////////////////////////////////////////////////////////////////////
+struct shared_frame *shared_frame_new(const void *data, size_t len){
+    struct shared_frame *frame = malloc(sizeof(*frame) + len);
+    if(frame == NULL)return NULL;
+    frame->refs = 1;
+    frame->len = len;
+    memcpy(frame->data, data, len);
+    return frame;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: shared_frame_release                                             //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Drops one reference and frees the frame with the last one.    //
+// Parameters: frame - Shared frame, may be NULL                              //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void shared_frame_release(struct shared_frame *frame){
+    if(frame && --frame->refs == 0)free(frame);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_send                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Sends bytes meant for one connection. They go straight to the //
+//              socket when nothing is queued; only what the socket does not  //
+//              take is copied into a frame of its own and queued.            //
+// Parameters: server - Server state                                          //
+//             conn - Destination connection                                  //
+//             data, len - Bytes to send                                      //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_send(struct bingo_server *server, struct bingo_connection *conn, const void *buffer, size_t len){
+    const char *data = buffer;
+    if(conn == NULL || conn->closed || conn->lagging)return;
+    if(conn->out_count == 0){
+        ssize_t bytes_sent = write(conn->fd, data, len);
+        METRIC_ADD(server, writes, 1);
+        if(bytes_sent > 0)METRIC_ADD(server, bytes_written, bytes_sent);
+        if(bytes_sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+            server_close(server, conn, CLOSE_SOCKET_ERROR);
+            return;
+        }
+        if(bytes_sent > 0){
+            data += bytes_sent;
+            len -= bytes_sent;
+        }
+    }
+    if(len == 0)return;
+    struct shared_frame *frame = shared_frame_new(data, len);
+    if(frame == NULL){
+        server_close(server, conn, CLOSE_NO_MEMORY);
+        return;
+    }
+    server_queue(server, conn, frame, 0);
+    shared_frame_release(frame);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_send_shared                                               //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Sends a shared frame to one of its many destinations. It is   //
+//              written directly when nothing is queued, otherwise the        //
+//              connection takes a reference to it.                           //
+// Parameters: server - Server state                                          //
+//             conn - Destination connection                                  //
+//             frame - Shared frame (the caller keeps its reference)          //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_send_shared(struct bingo_server *server, struct bingo_connection *conn, struct shared_frame *frame){
+    size_t offset = 0;
+    if(conn == NULL || conn->closed || conn->lagging)return;
+    if(conn->out_count == 0){
+        ssize_t bytes_sent = write(conn->fd, frame->data, frame->len);
+        METRIC_ADD(server, writes, 1);
+        if(bytes_sent > 0)METRIC_ADD(server, bytes_written, bytes_sent);
+        if(bytes_sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+            server_close(server, conn, CLOSE_SOCKET_ERROR);
+            return;
+        }
+        if(bytes_sent > 0)offset = bytes_sent;
+        if(offset == frame->len)return;
+    }
+    server_queue(server, conn, frame, offset);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_queue                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Queues a frame until EPOLLOUT. A full queue means a slow      //
+//              consumer: players are disconnected, spectators and hall       //
+//              members drop their queue and catch up from a snapshot.        //
+// Parameters: server - Server state                                          //
+//             conn - Destination connection                                  //
+//             frame - Frame to queue, gains a reference                      //
+//             offset - Bytes of it already written (empty queue only)        //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_queue(struct bingo_server *server, struct bingo_connection *conn, struct shared_frame *frame, size_t offset){
+    if(conn->out_count == SERVER_OUT_FRAMES){
+        if(!conn->spectator && conn->hall_member < 0){
+            server_close(server, conn, CLOSE_SLOW);
+            return;
+        }
+        int keep = conn->out_offset > 0;
+        for(int i = keep ; i < conn->out_count ; i++)
+            shared_frame_release(conn->out_queue[(conn->out_head + i) % SERVER_OUT_FRAMES]);
+        conn->out_count = keep;
+        conn->lagging = SET_VALUE;
+        return;
+    }
+    if(conn->out_count == 0){
+        conn->out_head = 0;
+        conn->out_offset = offset;
+    }
+    frame->refs++;
+    conn->out_queue[(conn->out_head + conn->out_count++) % SERVER_OUT_FRAMES] = frame;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_flush                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Writes the queued frames with writev() once the socket        //
+//              becomes writable. A lagging connection whose queue has        //
+//              drained is sent a snapshot to catch up.                       //
+// Parameters: server - Server state                                          //
+//             conn - Writable connection                                     //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_flush(struct bingo_server *server, struct bingo_connection *conn){
+    struct iovec iov[SERVER_OUT_FRAMES];
+    while(conn->out_count){
+        for(int i = 0 ; i < conn->out_count ; i++){
+            struct shared_frame *frame = conn->out_queue[(conn->out_head + i) % SERVER_OUT_FRAMES];
+            size_t skip = i == 0 ? conn->out_offset : 0;
+            iov[i].iov_base = frame->data + skip;
+            iov[i].iov_len = frame->len - skip;
+        }
+        ssize_t bytes_sent = writev(conn->fd, iov, conn->out_count);
+        METRIC_ADD(server, writes, 1);
+        if(bytes_sent > 0)METRIC_ADD(server, bytes_written, bytes_sent);
+        if(bytes_sent < 0){
+            if(errno == EINTR)continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK)return;
+            server_close(server, conn, CLOSE_SOCKET_ERROR);
+            return;
+        }
+        size_t sent = conn->out_offset + bytes_sent;
+        while(conn->out_count && sent >= conn->out_queue[conn->out_head]->len){
+            sent -= conn->out_queue[conn->out_head]->len;
+            shared_frame_release(conn->out_queue[conn->out_head]);
+            conn->out_head = (conn->out_head + 1) % SERVER_OUT_FRAMES;
+            conn->out_count--;
+        }
+        conn->out_offset = conn->out_count ? sent : 0;
+    }
+    if(conn->lagging){
+        conn->lagging = DEFAULT_STATUS;
+        server_catch_up(server, conn);
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_catch_up                                                  //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Sends a snapshot as one frame: to a spectator the players and //
+//              card config (MSG_WATCHING) and every move so far; to a hall   //
+//              member its card (MSG_CARD) and every number called this       //
+//              round. MSG_SNAPSHOT carries the numbers in chunks.            //
+// Parameters: server - Server state                                          //
+//             conn - Spectator or hall member                                //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_catch_up(struct bingo_server *server, struct bingo_connection *conn){
+    unsigned char head[FRAME_HEADER_SIZE + 3 + 2*20];
+    const uint16_t *calls;
+    int count;
+    size_t head_len;
+    if(conn->spectator){
+        struct bingo_room *room = conn->room;
+        unsigned char payload[3 + 2*20];
+        size_t first = strlen(room->player_names[PLAYER_NO_2]), second = strlen(room->player_names[PLAYER_NO_1]);
+        payload[0] = room->card_size;
+        payload[1] = room->max_number >> 8;
+        payload[2] = room->max_number & 0xff;
+        memcpy(payload + 3, room->player_names[PLAYER_NO_2], first + 1);
+        memcpy(payload + 4 + first, room->player_names[PLAYER_NO_1], second);
+        head_len = encode_frame(head, conn->version, MSG_WATCHING, payload, 4 + first + second);
+        calls = room->calls;
+        count = room->call_count;
+    }else if(server->hall && server->hall->active && conn->hall_card >= 0){
+        unsigned char seed[8];
+        for(int b = 0 ; b < 8 ; b++)seed[b] = server->hall->cards[conn->hall_card].seed >> (56 - 8*b);
+        head_len = encode_frame(head, conn->version, MSG_CARD, seed, sizeof(seed));
+        calls = server->hall->calls;
+        count = server->hall->call_count;
+    }else{
+        return;
+    }
+    server_send_calls(server, conn, head, head_len, calls, count);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_send_calls                                                //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Sends a header frame and the called numbers after it as one   //
+//              shared frame, the numbers in MSG_SNAPSHOT chunks.             //
+// Parameters: server - Server state                                          //
+//             conn - Receiving connection                                    //
+//             head, head_len - Encoded header frame                          //
+//             calls, count - Numbers called so far                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_send_calls(struct bingo_server *server, struct bingo_connection *conn, const unsigned char *head, size_t head_len, const uint16_t *calls, int count){
+    int per_frame = FRAME_MAX_PAYLOAD / 2, frames = (count + per_frame - 1) / per_frame;
+    struct shared_frame *snapshot = malloc(sizeof(*snapshot) + head_len + frames * FRAME_HEADER_SIZE + 2 * count);
+    if(snapshot == NULL){
+        server_close(server, conn, CLOSE_NO_MEMORY);
+        return;
+    }
+    snapshot->refs = 1;
+    memcpy(snapshot->data, head, head_len);
+    snapshot->len = head_len;
+    for(int i = 0 ; i < count ; i += per_frame){
+        unsigned char payload[FRAME_MAX_PAYLOAD];
+        int chunk = count - i < per_frame ? count - i : per_frame;
+        for(int k = 0 ; k < chunk ; k++){
+            payload[2*k] = calls[i + k] >> 8;
+            payload[2*k + 1] = calls[i + k] & 0xff;
+        }
+        snapshot->len += encode_frame(snapshot->data + snapshot->len, conn->version, MSG_SNAPSHOT, payload, 2 * chunk);
+    }
+    server_send_shared(server, conn, snapshot);
+    shared_frame_release(snapshot);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_close                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Closes a connection and ends its room. The opponent and the   //
+//              spectators get their pending bytes flushed and are then       //
+//              closed too, which the client reports as a disconnect. Memory  //
+//              is released after the current event batch so stale events     //
+//              stay harmless. A spectator or hall member just leaves. A      //
+//              waiting room another shard already sent a player to is kept   //
+//              for that player to release. A player with a resume token      //
+//              dropping out of an undecided match leaves its seat open for   //
+//              RESUME_GRACE seconds instead.                                 //
+// Parameters: server - Server state                                          //
+//             conn - Connection to close                                     //
+//             reason - CLOSE_* reason, counted in the shard's metrics        //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_close(struct bingo_server *server, struct bingo_connection *conn, int reason){
+    struct bingo_room *room = conn->room;
+    if(conn->closed)return;
+    conn->closed = SET_VALUE;
+    METRIC_ADD(server, disconnects[reason], 1);
+    close(conn->fd);
+    conn->next_closed = server->closed;
+    server->closed = conn;
+    server->active_connections--;
+    for(int i = 0 ; i < conn->out_count ; i++)
+        shared_frame_release(conn->out_queue[(conn->out_head + i) % SERVER_OUT_FRAMES]);
+    conn->out_count = 0;
+    if(room == NULL){
+        if(server->hall)hall_leave(server, conn);
+        return;
+    }
+    if(conn->spectator){
+        if(conn->watch_prev)conn->watch_prev->watch_next = conn->watch_next;
+        else room->spectators = conn->watch_next;
+        if(conn->watch_next)conn->watch_next->watch_prev = conn->watch_prev;
+        room->spectator_count--;
+        return;
+    }
+    room->players[conn->seat] = NULL;
+    if(room->tokens[conn->seat] && !room->decided && server_running){  // Keep the seat for a MSG_RESUME
+        if(!room->away_until)server->away_rooms++;
+        if(!room->away_until || room->players[1 - conn->seat])room->away_until = game_loop_now() + RESUME_GRACE * 1000ull;
+        return;
+    }
+
+    struct bingo_connection *peer = room->players[1 - conn->seat];
+    if(peer){
+        server_flush(server, peer);
+        if(!peer->closed)server_close(server, peer, CLOSE_OPPONENT);
+        return;
+    }
+    while(room->spectators){
+        struct bingo_connection *watcher = room->spectators;
+        server_flush(server, watcher);
+        if(!watcher->closed)server_close(server, watcher, CLOSE_OPPONENT);
+    }
+    if(!(room->name_transfer_flag & (1 << PLAYER_NO_1))){  // Never had its second player
+        struct server_group *group = server->group;
+        pthread_mutex_lock(&group->lobby_lock);
+        if(group->waiting == room)group->waiting = NULL;
+        int expecting = room->expecting;
+        pthread_mutex_unlock(&group->lobby_lock);
+        if(expecting)return;  // The player on its way finds it empty and frees it
+    }
+    server_release_room(server, room);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_release_room                                              //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Returns an empty room to the shard's free list.               //
+// Parameters: server - Shard owning the room                                 //
+//             room - Room without players or spectators                      //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_release_room(struct bingo_server *server, struct bingo_room *room){
+    if(room->prev)room->prev->next = room->next;
+    else server->rooms = room->next;
+    if(room->next)room->next->prev = room->prev;
+    if(room->away_until)server->away_rooms--;
+    server_record(server, room);
+    free(room->calls);
+    free(room->call_ms);
+    room->next_free = server->free_rooms;
+    server->free_rooms = room;
+    server->active_rooms--;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: server_expire                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Ends the matches whose dropped player did not come back       //
+//              within RESUME_GRACE: the player still there gets MSG_QUIT,    //
+//              as if the opponent had left, and the room is closed.          //
+// Parameters: server - Shard holding away rooms                              //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void server_expire(struct bingo_server *server){
+    uint64_t now = game_loop_now();
+    for(struct bingo_room *room = server->rooms, *next ; room ; room = next){
+        next = room->next;
+        if(!room->away_until || now < room->away_until)continue;
+        room->away_until = 0;
+        server->away_rooms--;
+        room->decided = SET_VALUE;
+        struct bingo_connection *left = room->players[PLAYER_NO_1] ? room->players[PLAYER_NO_1] : room->players[PLAYER_NO_2];
+        if(left){
+            unsigned char quit[FRAME_HEADER_SIZE];
+            server_send(server, left, quit, encode_frame(quit, left->version, MSG_QUIT, NULL, 0));
+            server_flush(server, left);
+            if(!left->closed)server_close(server, left, CLOSE_EXPIRED);
+            continue;
+        }
+        while(room->spectators){
+            struct bingo_connection *watcher = room->spectators;
+            server_flush(server, watcher);
+            if(!watcher->closed)server_close(server, watcher, CLOSE_EXPIRED);
+        }
+        server_release_room(server, room);
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// SERVER METRICS                                                             //
+////////////////////////////////////////////////////////////////////////////////
+// Each shard counts its own accepts, moves, syscalls, bytes and disconnects  //
+// in its bingo_server and times every relayed move into a log-linear         //
+// histogram. Only the shard writes its counters, with plain relaxed atomic   //
+// stores, so the move path takes no lock and never writes another shard's    //
+// memory. With --metrics <port> a thread of its own answers each connection  //
+// to 127.0.0.1:<port> with every shard summed up, as Prometheus style text   //
+// over HTTP/1.0, so a slow scraper never holds up an event loop.             //
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: metrics_listen                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Opens the blocking scrape listener on 127.0.0.1 only.         //
+// Parameters: group - Server process                                         //
+//             port - Local port to serve metrics on                          //
+// Returns: int - 0 on success, 1 on failure                                  //
+////////////////////////////////////////////////////////////////////////////////
+int metrics_listen(struct server_group *group, int port){
+    struct sockaddr_in address;
+    int enable = SET_VALUE;
+
+    group->metrics_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(group->metrics_fd < 0){
+        perror("Metrics socket failed");
+        return 1;
+    }
+    setsockopt(group->metrics_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(bind(group->metrics_fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(group->metrics_fd, PLAYERS_SIZE) < 0){
+        perror("Metrics bind failed");
+        close(group->metrics_fd);
+        group->metrics_fd = -1;
+        return 1;
+    }
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: metrics_main                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Thread answering scrapes one at a time until the listener is  //
+//              shut down. The request itself is not parsed: any path, or     //
+//              none within METRICS_SEND_TIMEOUT (as with nc), gets the text. //
+// Parameters: arg - The server_group                                         //
+// Returns: void * - NULL                                                     //
+////////////////////////////////////////////////////////////////////////////////
+void *metrics_main(void *arg){
+    struct server_group *group = arg;
+    struct timeval timeout = { 0, METRICS_SEND_TIMEOUT * 1000 };
+    uint64_t last_time = metrics_now_ns();
+    long last_moves = 0;
+    char *text = malloc(METRICS_REPLY_SIZE);
+    if(text == NULL){
+        perror("malloc failed");
+        return NULL;
+    }
+    while(server_running){
+        char request[BUF_SIZE*10], head[BUF_SIZE*2];
+        int fd = accept(group->metrics_fd, NULL, NULL);
+        if(fd < 0){
+            if(errno == EINTR || errno == ECONNABORTED)continue;
+            break;  // shutdown() by run_game_server()
+        }
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        if(read(fd, request, sizeof(request)) < 0 && errno != EAGAIN)perror("Metrics read failed");
+        size_t len = metrics_format(group, text, METRICS_REPLY_SIZE, &last_moves, &last_time);
+        struct iovec reply[2] = {
+            { head, snprintf(head, sizeof(head), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                                 "Content-Length: %zu\r\nConnection: close\r\n\r\n", len) },
+            { text, len }
+        };
+        if(writev(fd, reply, 2) < 0)perror("Metrics write failed");
+        close(fd);
+    }
+    free(text);
+    return NULL;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: metrics_append                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Appends formatted text to a scrape, dropping what would not   //
+//              fit.                                                          //
+// Parameters: text, size - Scrape buffer                                     //
+//             len - Bytes used so far, advanced                              //
+//             format, ... - printf style format and arguments                //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void metrics_append(char *text, size_t size, size_t *len, const char *format, ...){
+    va_list args;
+    va_start(args, format);
+    int added = vsnprintf(text + *len, size - *len, format, args);
+    va_end(args);
+    if(added > 0)*len += (size_t)added < size - *len ? (size_t)added : size - *len - 1;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: metrics_format                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Sums every shard's counters without stopping them and writes  //
+//              the totals, per move ratios, move handling percentiles,       //
+//              disconnects by reason and the load of each shard. The move    //
+//              rate covers the time since the previous scrape.               //
+// Parameters: group - Server process                                         //
+//             text, size - Output buffer                                     //
+//             last_moves, last_time - Moves and time of the previous scrape, //
+//                                     updated                                //
+// Returns: size_t - Bytes written                                            //
+////////////////////////////////////////////////////////////////////////////////
+size_t metrics_format(struct server_group *group, char *text, size_t size, long *last_moves, uint64_t *last_time){
+    static const char *reasons[CLOSE_REASONS] = { "hangup", "socket_error", "protocol", "slow_consumer",
+        "opponent_left", "resume_expired", "refused", "replaced", "no_memory" };
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    struct server_metrics *total = calloc(1, sizeof(*total));
+    uint64_t now = metrics_now_ns();
+    size_t len = 0;
+    if(total == NULL)return 0;
+    for(int i = 0 ; i < group->count ; i++){
+        struct server_metrics *shard = &group->shards[i].metrics;
+        total->rooms += __atomic_load_n(&shard->rooms, __ATOMIC_RELAXED);
+        total->away_rooms += __atomic_load_n(&shard->away_rooms, __ATOMIC_RELAXED);
+        total->connections += __atomic_load_n(&shard->connections, __ATOMIC_RELAXED);
+        total->accepted += __atomic_load_n(&shard->accepted, __ATOMIC_RELAXED);
+        total->accepted_local += __atomic_load_n(&shard->accepted_local, __ATOMIC_RELAXED);
+        total->moves += __atomic_load_n(&shard->moves, __ATOMIC_RELAXED);
+        total->reads += __atomic_load_n(&shard->reads, __ATOMIC_RELAXED);
+        total->writes += __atomic_load_n(&shard->writes, __ATOMIC_RELAXED);
+        total->bytes_read += __atomic_load_n(&shard->bytes_read, __ATOMIC_RELAXED);
+        total->bytes_written += __atomic_load_n(&shard->bytes_written, __ATOMIC_RELAXED);
+        for(int r = 0 ; r < CLOSE_REASONS ; r++)total->disconnects[r] += __atomic_load_n(&shard->disconnects[r], __ATOMIC_RELAXED);
+        for(int b = 0 ; b < METRICS_HIST_BUCKETS ; b++)total->move_ns[b] += __atomic_load_n(&shard->move_ns[b], __ATOMIC_RELAXED);
+        total->move_ns_sum += __atomic_load_n(&shard->move_ns_sum, __ATOMIC_RELAXED);
+        long max = __atomic_load_n(&shard->move_ns_max, __ATOMIC_RELAXED);
+        if(max > total->move_ns_max)total->move_ns_max = max;
+    }
+    double moves = total->moves ? total->moves : 1, seconds = (now - *last_time) / 1e9;
+    long timed = 0;
+    for(int b = 0 ; b < METRICS_HIST_BUCKETS ; b++)timed += total->move_ns[b];
+    metrics_append(text, size, &len,
+        "# TYPE bingo_shards gauge\nbingo_shards %d\n"
+        "# TYPE bingo_rooms gauge\nbingo_rooms %ld\n"
+        "# TYPE bingo_rooms_away gauge\nbingo_rooms_away %ld\n"
+        "# TYPE bingo_connections gauge\nbingo_connections %ld\n"
+        "# TYPE bingo_connections_accepted_total counter\nbingo_connections_accepted_total %ld\n"
+        "# TYPE bingo_connections_local_total counter\nbingo_connections_local_total %ld\n"
+        "# TYPE bingo_moves_total counter\nbingo_moves_total %ld\n"
+        "# TYPE bingo_moves_per_second gauge\nbingo_moves_per_second %.1f\n"
+        "# TYPE bingo_read_calls_total counter\nbingo_read_calls_total %ld\n"
+        "# TYPE bingo_write_calls_total counter\nbingo_write_calls_total %ld\n"
+        "# TYPE bingo_bytes_read_total counter\nbingo_bytes_read_total %ld\n"
+        "# TYPE bingo_bytes_written_total counter\nbingo_bytes_written_total %ld\n"
+        "# TYPE bingo_read_calls_per_move gauge\nbingo_read_calls_per_move %.2f\n"
+        "# TYPE bingo_write_calls_per_move gauge\nbingo_write_calls_per_move %.2f\n"
+        "# TYPE bingo_bytes_per_move gauge\nbingo_bytes_per_move %.1f\n"
+        "# TYPE bingo_move_handling_ns summary\n",
+        group->count, total->rooms, total->away_rooms, total->connections, total->accepted, total->accepted_local, total->moves,
+        seconds > 0 ? (total->moves - *last_moves) / seconds : 0.0, total->reads, total->writes,
+        total->bytes_read, total->bytes_written, total->reads / moves, total->writes / moves,
+        (total->bytes_read + total->bytes_written) / moves);
+    for(size_t q = 0 ; q < sizeof(quantiles) / sizeof(quantiles[0]) ; q++)
+        metrics_append(text, size, &len, "bingo_move_handling_ns{quantile=\"%g\"} %llu\n", quantiles[q],
+                       (unsigned long long)metrics_percentile(total->move_ns, timed, quantiles[q]));
+    metrics_append(text, size, &len, "bingo_move_handling_ns_sum %ld\nbingo_move_handling_ns_count %ld\n"
+                   "# TYPE bingo_move_handling_ns_max gauge\nbingo_move_handling_ns_max %ld\n"
+                   "# TYPE bingo_disconnects_total counter\n", total->move_ns_sum, timed, total->move_ns_max);
+    for(int r = 0 ; r < CLOSE_REASONS ; r++)
+        metrics_append(text, size, &len, "bingo_disconnects_total{reason=\"%s\"} %ld\n", reasons[r], total->disconnects[r]);
+    metrics_append(text, size, &len, "# TYPE bingo_shard_rooms gauge\n# TYPE bingo_shard_connections gauge\n"
+                   "# TYPE bingo_shard_moves_total counter\n");
+    for(int i = 0 ; i < group->count ; i++){
+        struct server_metrics *shard = &group->shards[i].metrics;
+        metrics_append(text, size, &len, "bingo_shard_rooms{shard=\"%d\"} %ld\nbingo_shard_connections{shard=\"%d\"} %ld\n"
+                       "bingo_shard_moves_total{shard=\"%d\"} %ld\n", i, __atomic_load_n(&shard->rooms, __ATOMIC_RELAXED),
+                       i, __atomic_load_n(&shard->connections, __ATOMIC_RELAXED), i, __atomic_load_n(&shard->moves, __ATOMIC_RELAXED));
+    }
+    *last_moves = total->moves;
+    *last_time = now;
+    free(total);
+    return len;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: metrics_record_move                                              //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Counts one relayed move and the time it took to handle.       //
+// Parameters: server - Shard that handled it                                 //
+//             ns - Handling time in nanoseconds                              //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void metrics_record_move(struct bingo_server *server, uint64_t ns){
+    int bucket = metrics_bucket(ns);
+    METRIC_ADD(server, moves, 1);
+    METRIC_ADD(server, move_ns[bucket], 1);
+    METRIC_ADD(server, move_ns_sum, ns);
+    if((long)ns > server->metrics.move_ns_max)__atomic_store_n(&server->metrics.move_ns_max, ns, __ATOMIC_RELAXED);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: metrics_bucket                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Maps a value to its histogram bucket: one bucket per          //
+//              nanosecond up to METRICS_HIST_LINEAR, then METRICS_HIST_STEPS //
+//              buckets per power of two, so every bucket is within 12.5%.    //
+// Parameters: ns - Value in nanoseconds                                      //
+// Returns: int - Bucket index                                                //
+////////////////////////////////////////////////////////////////////////////////
+int metrics_bucket(uint64_t ns){
+    if(ns < METRICS_HIST_LINEAR)return ns;
+    int exponent = 63 - __builtin_clzll(ns);  // 4 and up
+    int bucket = METRICS_HIST_LINEAR + (exponent - 4) * METRICS_HIST_STEPS + ((ns >> (exponent - 3)) & (METRICS_HIST_STEPS - 1));
+    return bucket < METRICS_HIST_BUCKETS ? bucket : METRICS_HIST_BUCKETS - 1;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: metrics_bucket_value                                             //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Smallest value that falls into a bucket.                      //
+// Parameters: bucket - Bucket index                                          //
+// Returns: uint64_t - Nanoseconds                                            //
+////////////////////////////////////////////////////////////////////////////////
+uint64_t metrics_bucket_value(int bucket){
+    if(bucket < METRICS_HIST_LINEAR)return bucket;
+    int exponent = 4 + (bucket - METRICS_HIST_LINEAR) / METRICS_HIST_STEPS;
+    return (uint64_t)(METRICS_HIST_STEPS + (bucket - METRICS_HIST_LINEAR) % METRICS_HIST_STEPS) << (exponent - 3);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: metrics_percentile                                               //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Finds the bucket holding the q-th quantile sample.            //
+// Parameters: buckets - Histogram of METRICS_HIST_BUCKETS counts             //
+//             count - Samples in it                                          //
+//             quantile - 0 to 1                                              //
+// Returns: uint64_t - Lower bound of that bucket, 0 without samples          //
+////////////////////////////////////////////////////////////////////////////////
+uint64_t metrics_percentile(const long *buckets, long count, double quantile){
+    long rank = (long)((count - 1) * quantile), seen = 0;
+    for(int i = 0 ; count > 0 && i < METRICS_HIST_BUCKETS ; i++){
+        seen += buckets[i];
+        if(seen > rank)return metrics_bucket_value(i);
+    }
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: metrics_now_ns                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Reads the monotonic clock in nanoseconds, through the vDSO.   //
+// Parameters: void                                                           //
+// Returns: uint64_t - Nanoseconds since an arbitrary start                   //
+////////////////////////////////////////////////////////////////////////////////
+uint64_t metrics_now_ns(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+////////////////////////////////////////////////////////////////////////////////
+// CALLER HALL                                                                //
+////////////////////////////////////////////////////////////////////////////////
+// With --caller every client of the server holds one card in a single hall   //
+// and the server calls a number every interval. When a round starts each     //
+// member is dealt a card from a fresh seed and an inverted index lists, per  //
+// number, every (card, row, column) holding it, stored contiguously. A call  //
+// walks only its own entries and bumps per-card line counters, so it costs   //
+// one step per card holding the number, however large the hall. Completed    //
+// lines and winners come out of the same pass, and the server alone decides  //
+// who has BINGO.                                                             //
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: hall_create                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Allocates an empty caller hall. The first tick is one         //
+//              interval away, so early members share the first round.        //
+// Parameters: size - Cells per row (N) of every card                         //
+//             max_number - Highest number on a card                          //
+//             interval - Milliseconds between calls                          //
+// Returns: struct bingo_hall * - New hall, or NULL on allocation failure     //
+////////////////////////////////////////////////////////////////////////////////
+struct bingo_hall *hall_create(int size, int max_number, int interval){
+    struct bingo_hall *hall = calloc(1, sizeof(*hall));
+    if(hall == NULL)return NULL;
+    hall->size = size;
+    hall->max_number = max_number;
+    hall->interval = interval;
+    hall->index_start = malloc((max_number + 2) * sizeof(uint32_t));
+    hall->calls = malloc(max_number * sizeof(uint16_t));
+    if(hall->index_start == NULL || hall->calls == NULL){
+        hall_free(hall);
+        return NULL;
+    }
+    bingo_rng_seed(&hall->rng, new_card_seed());
+    hall->next_call = game_loop_now() + interval;
+    return hall;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: hall_free                                                        //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Releases a hall and every array it owns.                      //
+// Parameters: hall - Hall to release, may be NULL                            //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void hall_free(struct bingo_hall *hall){
+    if(hall == NULL)return;
+    free(hall->members);
+    free(hall->cards);
+    free(hall->line_counts);
+    free(hall->entries);
+    free(hall->changed);
+    free(hall->index_start);
+    free(hall->calls);
+    free(hall);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: hall_reserve                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Makes room for a round of `count` cards. Arrays only grow,    //
+//              so steady rounds allocate nothing.                            //
+// Parameters: hall - Caller hall                                             //
+//             count - Cards in the coming round                              //
+// Returns: int - 0 on success, 1 on allocation failure                       //
+////////////////////////////////////////////////////////////////////////////////
+int hall_reserve(struct bingo_hall *hall, long count){
+    if(count <= hall->card_capacity)return 0;
+    size_t lines = 2 * hall->size + 2, cells = hall->size * hall->size;
+    free(hall->cards);
+    free(hall->line_counts);
+    free(hall->entries);
+    free(hall->changed);
+    hall->cards = malloc(count * sizeof(*hall->cards));
+    hall->line_counts = malloc(count * lines);
+    hall->entries = malloc(count * cells * sizeof(*hall->entries));
+    hall->changed = malloc(count * sizeof(*hall->changed));
+    hall->card_capacity = count;
+    if(hall->cards && hall->line_counts && hall->entries && hall->changed)return 0;
+    hall->card_capacity = 0;
+    return 1;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: hall_build_index                                                 //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Builds every card of the round from its seed and fills the    //
+//              inverted index with a counting sort: one pass counts the      //
+//              cells of each number, a second pass places them.              //
+// Parameters: hall - Hall with card_count seeded cards                       //
+// Returns: int - 0 on success, 1 if the card config cannot be allocated      //
+////////////////////////////////////////////////////////////////////////////////
+int hall_build_index(struct bingo_hall *hall){
+    struct bingo_card card;
+    int size = hall->size, cells = size * size;
+    uint32_t *start = hall->index_start;
+    memset(&card, 0, sizeof(card));
+    if(bingo_card_init(&card, size, hall->max_number))return 1;
+    memset(start, 0, (hall->max_number + 2) * sizeof(uint32_t));
+    memset(hall->line_counts, 0, hall->card_count * (2 * size + 2));
+    for(long i = 0 ; i < hall->card_count ; i++){
+        bingo_card_generate(&card, hall->cards[i].seed);
+        for(int cell = 0 ; cell < cells ; cell++)start[card.cells[cell]]++;
+        hall->cards[i].lines = 0;
+    }
+    for(int number = 1 ; number <= hall->max_number + 1 ; number++)start[number] += start[number - 1];
+    for(long i = 0 ; i < hall->card_count ; i++){
+        bingo_card_generate(&card, hall->cards[i].seed);
+        for(int cell = 0 ; cell < cells ; cell++){
+            struct hall_entry *entry = &hall->entries[--start[card.cells[cell]]];
+            entry->card = i;
+            entry->row = cell / size;
+            entry->col = cell % size;
+        }
+    }
+    bingo_card_free(&card);
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: hall_mark                                                        //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Applies one call to every card holding the number. Each entry //
+//              bumps the marked count of its row, column and diagonals; a    //
+//              count reaching N completes that line. Cards that completed a  //
+//              line are listed in hall->changed (a number is on a card at    //
+//              most once, so no card is listed twice).                       //
+// Parameters: hall - Hall with a built index                                 //
+//             number - Called number                                         //
+// Returns: long - Number of cards listed in hall->changed                    //
+////////////////////////////////////////////////////////////////////////////////
+long hall_mark(struct bingo_hall *hall, int number){
+    int size = hall->size, lines = 2 * size + 2;
+    long changed = 0;
+    const struct hall_entry *entry = hall->entries + hall->index_start[number];
+    const struct hall_entry *end = hall->entries + hall->index_start[number + 1];
+    for( ; entry < end ; entry++){
+        uint8_t *count = hall->line_counts + (size_t)entry->card * lines;
+        int completed = (++count[entry->row] == size) + (++count[size + entry->col] == size);
+        if(entry->row == entry->col)completed += ++count[2 * size] == size;
+        if(entry->row + entry->col == size - 1)completed += ++count[2 * size + 1] == size;
+        if(!completed)continue;
+        hall->cards[entry->card].lines += completed;
+        hall->changed[changed++] = entry->card;
+    }
+    return changed;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: hall_join                                                        //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Adds a named connection to the hall and sends it role         //
+//              HALL_SEAT and the card config. Its first card comes with the  //
+//              next round. Clients older than HALL_MIN_VERSION are closed.   //
+// Parameters: server - Server state                                          //
+//             conn - Connection that sent MSG_HELLO                          //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void hall_join(struct bingo_server *server, struct bingo_connection *conn){
+    struct bingo_hall *hall = server->hall;
+    unsigned char payload[sizeof(HALL_CALLER_NAME)], reply[2*FRAME_HEADER_SIZE + sizeof(payload) + 5];
+    if(conn->version < HALL_MIN_VERSION){
+        server_close(server, conn, CLOSE_REFUSED);
+        return;
+    }
+    if(hall->member_count == hall->member_capacity){
+        long capacity = hall->member_capacity ? 2 * hall->member_capacity : SERVER_MAX_EVENTS;
+        struct bingo_connection **members = realloc(hall->members, capacity * sizeof(*members));
+        if(members == NULL){
+            server_close(server, conn, CLOSE_NO_MEMORY);
+            return;
+        }
+        hall->members = members;
+        hall->member_capacity = capacity;
+    }
+    conn->hall_member = hall->member_count;
+    hall->members[hall->member_count++] = conn;
+    payload[0] = HALL_SEAT;
+    memcpy(payload + 1, HALL_CALLER_NAME, sizeof(payload) - 1);
+    size_t len = encode_frame(reply, conn->version, MSG_PAIRED, payload, sizeof(payload));
+    len += encode_config_frame(reply + len, conn->version, hall->size, hall->max_number, 0);
+    server_send(server, conn, reply, len);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: hall_leave                                                       //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Removes a closing connection from the members (the last       //
+//              member takes its slot) and orphans its card, which can no     //
+//              longer win.                                                   //
+// Parameters: server - Server state                                          //
+//             conn - Closing connection                                      //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void hall_leave(struct bingo_server *server, struct bingo_connection *conn){
+    struct bingo_hall *hall = server->hall;
+    if(conn->hall_card >= 0)hall->cards[conn->hall_card].conn = NULL;
+    if(conn->hall_member >= 0){
+        struct bingo_connection *last = hall->members[--hall->member_count];
+        hall->members[conn->hall_member] = last;
+        last->hall_member = conn->hall_member;
+    }
+    conn->hall_member = conn->hall_card = -1;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: hall_tick                                                        //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Runs once per interval: calls the next number of the round,   //
+//              or deals a new round when none is running.                    //
+// Parameters: server - Server state                                          //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void hall_tick(struct bingo_server *server){
+    struct bingo_hall *hall = server->hall;
+    hall->next_call = game_loop_now() + hall->interval;
+    if(hall->active && hall->member_count)hall_call(server);
+    else hall_start_round(server);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: hall_start_round                                                 //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Deals a card to every member, builds the index and sends      //
+//              each member the seed of its card in MSG_CARD.                 //
+// Parameters: server - Server state                                          //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void hall_start_round(struct bingo_server *server){
+    struct bingo_hall *hall = server->hall;
+    unsigned char frame[FRAME_HEADER_SIZE + 8], seed[8];
+    hall->active = DEFAULT_STATUS;
+    if(hall->member_count == 0)return;
+    if(hall_reserve(hall, hall->member_count)){
+        perror("Caller hall allocation failed");
+        return;
+    }
+    hall->card_count = hall->member_count;
+    for(long i = 0 ; i < hall->card_count ; i++){
+        hall->cards[i].conn = hall->members[i];
+        hall->cards[i].seed = bingo_rng_next(&hall->rng);
+        hall->members[i]->hall_card = i;
+    }
+    if(hall_build_index(hall))return;
+    for(long i = 0 ; i < hall->card_count ; i++){
+        if(hall->cards[i].conn == NULL)continue;
+        for(int b = 0 ; b < 8 ; b++)seed[b] = hall->cards[i].seed >> (56 - 8*b);
+        server_send(server, hall->cards[i].conn, frame, encode_frame(frame, PROTOCOL_VERSION, MSG_CARD, seed, sizeof(seed)));
+    }
+    for(int i = 0 ; i < hall->max_number ; i++)hall->calls[i] = i + 1;
+    hall->call_count = 0;
+    hall->active = SET_VALUE;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: hall_call                                                        //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Calls a random number not called yet this round, sends it to  //
+//              every card holder as one shared frame, tells the cards that   //
+//              completed lines their new count and, once somebody has BINGO, //
+//              ends the round with the list of winners sent to every member. //
+// Parameters: server - Server state                                          //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void hall_call(struct bingo_server *server){
+    struct bingo_hall *hall = server->hall;
+    unsigned char frame[FRAME_DECODER_SIZE], result[FRAME_MAX_PAYLOAD];
+    size_t result_len = 4;
+    int winners = 0;
+
+    int index = hall->call_count + bingo_rng_below(&hall->rng, hall->max_number - hall->call_count);
+    int number = hall->calls[index];
+    hall->calls[index] = hall->calls[hall->call_count];
+    hall->calls[hall->call_count++] = number;
+    long changed = hall_mark(hall, number);
+
+    struct shared_frame *call = shared_frame_new(frame, encode_number_frame(frame, PROTOCOL_VERSION, MSG_CALL, number));
+    for(long i = 0 ; call && i < hall->card_count ; i++)
+        if(hall->cards[i].conn)server_send_shared(server, hall->cards[i].conn, call);
+    shared_frame_release(call);
+    for(long i = 0 ; i < changed ; i++){
+        struct hall_card *card = &hall->cards[hall->changed[i]];
+        if(card->conn == NULL)continue;
+        unsigned char payload[3] = { card->lines >> 8, card->lines & 0xff, card->lines >= hall->size };
+        if(payload[2]){
+            size_t name_len = strlen(card->conn->name);
+            if(result_len + name_len + 2 <= sizeof(result)){
+                if(winners)result[result_len++] = ',', result[result_len++] = ' ';
+                memcpy(result + result_len, card->conn->name, name_len);
+                result_len += name_len;
+            }
+            winners++;
+        }
+        server_send(server, card->conn, frame, encode_frame(frame, PROTOCOL_VERSION, MSG_LINES, payload, sizeof(payload)));
+    }
+    if(!winners && hall->call_count < hall->max_number)return;
+
+    result[0] = hall->call_count >> 8;
+    result[1] = hall->call_count & 0xff;
+    result[2] = winners >> 8;
+    result[3] = winners & 0xff;
+    struct shared_frame *end = shared_frame_new(frame, encode_frame(frame, PROTOCOL_VERSION, MSG_ROUND_END, result, result_len));
+    for(long i = hall->member_count - 1 ; end && i >= 0 ; i--)server_send_shared(server, hall->members[i], end);
+    shared_frame_release(end);
+    for(long i = 0 ; i < hall->card_count ; i++)
+        if(hall->cards[i].conn)hall->cards[i].conn->hall_card = -1;
+    printf("Round over after %d calls : %ld cards, %d winners\n", hall->call_count, hall->card_count, winners);
+    fflush(stdout);
+    hall->card_count = 0;
+    hall->active = DEFAULT_STATUS;
+}
+////////////////////////////////////////////////////////////////////////////////
+// HEADLESS SIMULATOR                                                         //
+////////////////////////////////////////////////////////////////////////////////
+// Bots play complete games with the card engine behind mark_number() and     //
+// check_for_win(), without terminal output or sockets. Every worker thread   //
+// owns its cards and generator and only its results are merged at the end.   //
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: run_simulation                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Parses "--simulate <games> [--players N] [--threads N]        //
+//              [--seed hex] [--bots random,greedy,..] [--size N]             //
+//              [--numbers M] [--record file]", runs the games on worker      //
+//              threads and prints aggregate statistics. Two-bot games can be //
+//              appended to a recording file for bingo_replay.                //
+// Parameters: argc, argv - Arguments after "--simulate"                      //
+// Returns: int - Exit status (0 for success)                                 //
+////////////////////////////////////////////////////////////////////////////////
+int run_simulation(int argc, char **argv){
+    long games = argc > 0 ? atol(argv[0]) : 0;
+    int players = PLAYERS_SIZE;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t seed = new_card_seed();
+    int strategies[SIM_MAX_PLAYERS] = {0};
+    char *bots = NULL;
+    int numbers = 0, record_fd = -1;
+
+    for(int i = 1 ; i + 1 < argc ; i += 2){
+        if(strcmp(argv[i],"--players") == 0)players = atoi(argv[i+1]);
+        else if(strcmp(argv[i],"--threads") == 0)threads = atoi(argv[i+1]);
+        else if(strcmp(argv[i],"--seed") == 0)seed = strtoull(argv[i+1], NULL, 16);
+        else if(strcmp(argv[i],"--bots") == 0)bots = argv[i+1];
+        else if(strcmp(argv[i],"--size") == 0)card_size = atoi(argv[i+1]);
+        else if(strcmp(argv[i],"--numbers") == 0)numbers = atoi(argv[i+1]);
+        else if(strcmp(argv[i],"--record") == 0)record_path = argv[i+1];
+    }
+    card_max_number = numbers ? numbers : card_size * card_size;
+    if(games <= 0 || players < 2 || players > SIM_MAX_PLAYERS || threads < 1 || threads > SIM_MAX_THREADS ||
+       !valid_card_config(card_size, card_max_number) || (record_path && players != PLAYERS_SIZE)){
+        printf("Usage: --simulate <games> [--players 2-%d] [--threads 1-%d] [--seed hex] [--bots random,greedy,..]"
+               " [--size %d-%d] [--numbers size*size-%d] [--record file, 2 players]\n",SIM_MAX_PLAYERS,SIM_MAX_THREADS,
+               MIN_CARD_SIZE,MAX_CARD_SIZE,MAX_CARD_NUMBER);
+        return 1;
+    }
+    if(record_path && (record_fd = record_open(record_path)) < 0){
+        perror("Recording file open failed");
+        return 1;
+    }
+    for(int seat = 0 ; bots && seat < players ; seat++){
+        strategies[seat] = strncmp(bots,"greedy",6) == 0 ? BOT_GREEDY : BOT_RANDOM;
+        char *next = strchr(bots, ',');
+        if(next)bots = next + 1;
+    }
+    if(threads > games)threads = games;
+
+    struct simulation_worker *workers = calloc(threads, sizeof(*workers));
+    struct simulation_stats total;
+    struct timespec start, end;
+    memset(&total, 0, sizeof(total));
+    total.length = calloc(card_max_number + 1, sizeof(long));
+    if(workers == NULL || total.length == NULL){
+        perror("calloc failed");
+        free(workers);
+        free(total.length);
+        if(record_fd >= 0)close(record_fd);
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int i = 0 ; i < threads ; i++){
+        workers[i].games = games / threads + (i < games % threads);
+        workers[i].players = players;
+        workers[i].strategies = strategies;
+        workers[i].seed = seed + i * 0x9e3779b97f4a7c15ull;
+        workers[i].record_fd = record_fd;
+        pthread_create(&workers[i].thread, NULL, simulation_worker_main, &workers[i]);
+    }
+    for(int i = 0 ; i < threads ; i++){
+        pthread_join(workers[i].thread, NULL);
+        total.games += workers[i].stats.games;
+        total.shared_wins += workers[i].stats.shared_wins;
+        for(int seat = 0 ; seat < players ; seat++)total.wins[seat] += workers[i].stats.wins[seat];
+        for(int calls = 0 ; workers[i].stats.length && calls <= card_max_number ; calls++)total.length[calls] += workers[i].stats.length[calls];
+        free(workers[i].stats.length);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    free(workers);
+    if(record_fd >= 0)close(record_fd);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    double mean_length = 0;
+    printf("Simulated %ld games, %d bots, %d threads, seed %016llx, %dx%d cards with numbers 1-%d\n", total.games, players, threads,
+           (unsigned long long)seed, card_size, card_size, card_max_number);
+    printf("Elapsed %.3f s | %.0f games per second\n", seconds, total.games / seconds);
+    for(int seat = 0 ; seat < players ; seat++)
+        printf("Seat %d (%s%s) win rate : %.4f\n", seat + 1, strategies[seat] == BOT_GREEDY ? "greedy" : "random",
+               seat == 0 ? ", first mover" : "", (double)total.wins[seat] / total.games);
+    printf("Games with more than one BINGO on the winning call : %.4f\n", (double)total.shared_wins / total.games);
+    printf("Game length (calls) distribution :\n");
+    for(int calls = 1 ; calls <= card_max_number ; calls++){
+        if(!total.length[calls])continue;
+        mean_length += (double)calls * total.length[calls] / total.games;
+        printf("  %2d : %.4f\n", calls, (double)total.length[calls] / total.games);
+    }
+    printf("Mean game length : %.2f calls\n", mean_length);
+    if(record_fd >= 0)printf("Recorded to %s\n", record_path);
+    free(total.length);
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: simulation_worker_main                                           //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Worker thread body. Sizes its cards once, then plays its      //
+//              share of games with its own generator and records results in  //
+//              its own stats block; with --record it buffers its games and   //
+//              appends them RECORD_BUFFER_SIZE bytes at a time.              //
+// Parameters: arg - struct simulation_worker of this thread                  //
+// Returns: void * - NULL                                                     //
+////////////////////////////////////////////////////////////////////////////////
+void *simulation_worker_main(void *arg){
+    struct simulation_worker *worker = arg;
+    struct bingo_card cards[SIM_MAX_PLAYERS];
+    struct bingo_rng rng;
+    struct game_record record, *recording = NULL;
+    uint16_t calls[MAX_CARD_NUMBER];
+    uint32_t call_ms[MAX_CARD_NUMBER] = {0};  // Simulated games take no time
+    unsigned char *buffer = NULL;
+    size_t buffer_len = 0;
+    uint16_t *remaining = malloc(card_max_number * sizeof(uint16_t));
+    worker->stats.length = calloc(card_max_number + 1, sizeof(long));
+    memset(cards, 0, sizeof(cards));
+    for(int seat = 0 ; seat < worker->players ; seat++)
+        if(bingo_card_init(&cards[seat], card_size, card_max_number))worker->games = 0;
+    if(remaining == NULL || worker->stats.length == NULL)worker->games = 0;
+    if(worker->record_fd >= 0){
+        if((buffer = malloc(RECORD_BUFFER_SIZE)) == NULL)worker->games = 0;
+        record.card_size = card_size;
+        record.max_number = card_max_number;
+        record.start = time(NULL);
+        record.calls = calls;
+        record.call_ms = call_ms;
+        recording = &record;
+    }
+    bingo_rng_seed(&rng, worker->seed);
+    for(long i = 0 ; i < worker->games ; i++){
+        int length;
+        int winner = simulate_game(cards, worker->players, worker->strategies, remaining, &rng, &length, recording);
+        worker->stats.games++;
+        worker->stats.wins[winner & 0xff]++;
+        worker->stats.shared_wins += winner >> 8;
+        worker->stats.length[length]++;
+        if(recording == NULL)continue;
+        if(buffer_len + RECORD_MAX_SIZE(record.call_count) > RECORD_BUFFER_SIZE){
+            if(write(worker->record_fd, buffer, buffer_len) != (ssize_t)buffer_len)perror("Recording write failed");
+            buffer_len = 0;
+        }
+        buffer_len += record_encode(buffer + buffer_len, &record);
+    }
+    if(buffer_len && write(worker->record_fd, buffer, buffer_len) != (ssize_t)buffer_len)perror("Recording write failed");
+    for(int seat = 0 ; seat < worker->players ; seat++)bingo_card_free(&cards[seat]);
+    free(remaining);
+    free(buffer);
+    return NULL;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: simulate_game                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Plays one game. Seats call in turn starting with seat 0,      //
+//              every card is marked after each call, and the caller is       //
+//              checked first followed by the other seats in order, the same  //
+//              way the interactive game lets the caller claim BINGO first.   //
+// Parameters: cards - One sized card per seat, refilled for this game        //
+//             players - Number of bots                                       //
+//             strategies - BOT_* strategy per seat                           //
+//             remaining - Scratch space for max_number open numbers          //
+//             rng - Generator for cards and bot choices                      //
+//             length - Receives the number of calls made                     //
+//             record - Receives seeds, calls and winner of a two-bot game,   //
+//                      NULL to skip; its calls array holds max_number        //
+// Returns: int - Winning seat; bit 8 set when another seat also had BINGO    //
+////////////////////////////////////////////////////////////////////////////////
+int simulate_game(struct bingo_card *cards, int players, const int *strategies, uint16_t *remaining, struct bingo_rng *rng, int *length,
+                  struct game_record *record){
+    int max_number = cards[0].max_number, remaining_count = max_number;
+
+    for(int seat = 0 ; seat < players ; seat++){
+        uint64_t seed = bingo_rng_next(rng);
+        if(record)record->seeds[seat] = seed;  // Seat 0 is RECORD_FIRST_MOVER
+        bingo_card_generate(&cards[seat], seed);
+    }
+    for(int i = 0 ; i < max_number ; i++)remaining[i] = i + 1;
+    for(int calls = 1 ; remaining_count ; calls++){
+        int caller = (calls - 1) % players;
+        int index = bot_choose_number(&cards[caller], remaining, remaining_count, strategies[caller], rng);
+        int number = remaining[index];
+        remaining[index] = remaining[--remaining_count];
+        if(record)record->calls[calls - 1] = number;
+
+        int winner = -1, shared = 0;
+        for(int i = 0 ; i < players ; i++){
+            int seat = (caller + i) % players;
+            bingo_card_mark(&cards[seat], number);
+            if(bingo_card_lines(&cards[seat]) >= LINES_TO_WIN(&cards[seat])){
+                if(winner < 0)winner = seat;
+                else shared = 1;
+            }
+        }
+        if(winner >= 0){
+            *length = calls;
+            if(record){
+                record->winner = winner;
+                record->call_count = calls;
+            }
+            return winner | (shared << 8);
+        }
+    }
+    *length = max_number;
+    if(record){
+        record->winner = 0;
+        record->call_count = max_number;
+    }
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bot_choose_number                                                //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Picks the next number for a bot. BOT_RANDOM takes any open    //
+//              number; BOT_GREEDY scores each open number by how far the     //
+//              lines through its cell are already marked.                    //
+// Parameters: card - Bot's card                                              //
+//             remaining, remaining_count - Numbers not yet called            //
+//             strategy - BOT_RANDOM or BOT_GREEDY                            //
+//             rng - Generator for random picks and tie breaks                //
+// Returns: int - Index into `remaining` of the chosen number                 //
+////////////////////////////////////////////////////////////////////////////////
+int bot_choose_number(const struct bingo_card *card, const uint16_t *remaining, int remaining_count, int strategy, struct bingo_rng *rng){
+    if(strategy == BOT_RANDOM)return bingo_rng_below(rng, remaining_count);
+    int start = bingo_rng_below(rng, remaining_count);
+    int best = start, best_score = -1;
+    for(int k = 0 ; k < remaining_count ; k++){
+        int i = (start + k) % remaining_count;
+        int cell = card->cell_of[remaining[i]] - 1;
+        if(cell < 0)continue;
+        int score = bingo_card_cell_score(card, cell);
+        if(score > best_score){
+            best = i;
+            best_score = score;
+        }
+    }
+    return best;
+}
+////////////////////////////////////////////////////////////////////////////////
+// MOVE ADVISOR                                                               //
+////////////////////////////////////////////////////////////////////////////////
+// Weighs every open number by Monte-Carlo: each simulated finish deals the   //
+// opponent a random card holding the calls so far (but no BINGO yet), calls  //
+// the candidate, then lets both sides call random open numbers until someone //
+// has BINGO, with the caller claiming first as in a live match. A pool of    //
+// one worker per core, started on first use, spreads the finishes over the   //
+// candidates until the time budget runs out; each worker keeps its own       //
+// counts, merged once it stops. It answers hints typed at the prompt and     //
+// plays for the computer opponent, in single-player matches and with --bot.  //
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: advise_move                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Picks the open number whose simulated finishes we win most    //
+//              often. Callers share the pool one move at a time. Falls back  //
+//              to BOT_GREEDY if the budget allowed no simulation at all.     //
+// Parameters: seed, card_size, max_number - Our card                         //
+//             calls, call_count - Numbers called so far, by both sides       //
+//             budget_ms - Time to spend                                      //
+//             result - Receives the advice                                   //
+// Returns: int - 0 on success, 1 if no number is open                        //
+////////////////////////////////////////////////////////////////////////////////
+int advise_move(uint64_t seed, int card_size, int max_number, const uint16_t *calls, int call_count, int budget_ms,
+                struct advisor_result *result){
+    unsigned char *called = calloc(max_number + 1, 1);
+    uint16_t *open = malloc(max_number * sizeof(uint16_t));
+    int open_count = 0;
+
+    memset(result, 0, sizeof(*result));
+    if(called == NULL || open == NULL){
+        free(called);
+        free(open);
+        return 1;
+    }
+    for(int i = 0 ; i < call_count ; i++)if(calls[i] >= 1 && calls[i] <= max_number)called[calls[i]] = 1;
+    for(int number = 1 ; number <= max_number ; number++)if(!called[number])open[open_count++] = number;
+    free(called);
+    if(open_count == 0){
+        free(open);
+        return 1;
+    }
+    pthread_once(&advisor_once, advisor_start);
+    pthread_mutex_lock(&advisor_lock);
+    pthread_mutex_lock(&advisor.lock);
+    advisor.seed = seed;
+    advisor.card_size = card_size;
+    advisor.max_number = max_number;
+    advisor.calls = calls;
+    advisor.call_count = call_count;
+    advisor.open = open;
+    advisor.open_count = open_count;
+    advisor.deadline = game_loop_now() + budget_ms;
+    advisor.running = advisor.threads;
+    advisor.generation++;
+    pthread_cond_broadcast(&advisor.wake);
+    while(advisor.running)pthread_cond_wait(&advisor.done, &advisor.lock);
+    pthread_mutex_unlock(&advisor.lock);
+
+    long best_plays = 0, best_wins = 0;
+    result->candidates = open_count;
+    for(int i = 0 ; i < open_count ; i++){
+        long plays = 0, wins = 0;
+        for(int t = 0 ; t < advisor.threads ; t++){
+            if(advisor.workers[t].capacity < max_number)continue;  // Could not size its arrays
+            plays += advisor.workers[t].plays[open[i]];
+            wins += advisor.workers[t].wins[open[i]];
+        }
+        result->simulations += plays;
+        if(plays && (!best_plays || wins * best_plays > best_wins * plays)){
+            result->number = open[i];
+            best_plays = plays;
+            best_wins = wins;
+        }
+    }
+    if(best_plays){
+        result->win_rate = (double)best_wins / best_plays;
+    }else{
+        struct advisor_worker *worker = &advisor.workers[0];
+        result->number = open[bot_choose_number(&worker->base, open, open_count, BOT_GREEDY, &worker->rng)];
+    }
+    pthread_mutex_unlock(&advisor_lock);
+    free(open);
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: advisor_start                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Starts one worker per online core; runs once per process.     //
+// Parameters: void                                                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void advisor_start(void){
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t seed = new_card_seed();
+    if(threads < 1)threads = 1;
+    if(threads > ADVISOR_MAX_THREADS)threads = ADVISOR_MAX_THREADS;
+    pthread_mutex_init(&advisor.lock, NULL);
+    pthread_cond_init(&advisor.wake, NULL);
+    pthread_cond_init(&advisor.done, NULL);
+    advisor.workers = calloc(threads, sizeof(*advisor.workers));
+    if(advisor.workers == NULL){
+        perror("calloc failed");
+        exit(1);
+    }
+    for(int t = 0 ; t < threads ; t++){
+        struct advisor_worker *worker = &advisor.workers[t];
+        bingo_rng_seed(&worker->rng, seed + t * 0x9e3779b97f4a7c15ull);
+        if(pthread_create(&worker->thread, NULL, advisor_worker_main, worker) != 0)break;
+        pthread_detach(worker->thread);
+        advisor.threads++;
+    }
+    if(advisor.threads == 0){
+        perror("Advisor thread creation failed");
+        exit(1);
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: advisor_worker_main                                              //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Worker thread body. Sleeps until a move is posted, then       //
+//              simulates finishes for the open numbers in turn, starting at  //
+//              a random one, until the deadline, and reports back.           //
+// Parameters: arg - struct advisor_worker of this thread                     //
+// Returns: void * - Never returns                                            //
+////////////////////////////////////////////////////////////////////////////////
+void *advisor_worker_main(void *arg){
+    struct advisor_worker *worker = arg;
+    unsigned long generation = 0;
+    while(1){
+        pthread_mutex_lock(&advisor.lock);
+        while(advisor.generation == generation)pthread_cond_wait(&advisor.wake, &advisor.lock);
+        generation = advisor.generation;
+        pthread_mutex_unlock(&advisor.lock);
+
+        advisor_prepare(worker);
+        if(worker->capacity >= advisor.max_number){
+            int next = bingo_rng_below(&worker->rng, advisor.open_count);
+            while(game_loop_now() < advisor.deadline){
+                int number = advisor.open[next];
+                worker->plays[number]++;
+                worker->wins[number] += advisor_finish(worker, next);
+                if(++next == advisor.open_count)next = 0;
+            }
+        }
+
+        pthread_mutex_lock(&advisor.lock);
+        if(--advisor.running == 0)pthread_cond_signal(&advisor.done);
+        pthread_mutex_unlock(&advisor.lock);
+    }
+    return NULL;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: advisor_prepare                                                  //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Sizes the worker's cards and counters for the posted move,    //
+//              builds our card twice (marked base, scratch copy) and clears  //
+//              the counters of the open numbers. capacity stays below        //
+//              max_number if memory runs out, which sits the move out.       //
+// Parameters: worker - Worker to set up                                      //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void advisor_prepare(struct advisor_worker *worker){
+    int max_number = advisor.max_number;
+    if(worker->base.size != advisor.card_size || worker->base.max_number != max_number){
+        worker->capacity = 0;
+        if(bingo_card_init(&worker->base, advisor.card_size, max_number) ||
+           bingo_card_init(&worker->mine, advisor.card_size, max_number) ||
+           bingo_card_init(&worker->theirs, advisor.card_size, max_number)){
+            worker->base.size = 0;
+            return;
+        }
+    }
+    if(worker->capacity < max_number){
+        uint16_t *pool = realloc(worker->pool, max_number * sizeof(uint16_t));
+        long *plays = pool ? realloc(worker->plays, (max_number + 1) * sizeof(long)) : NULL;
+        long *wins = plays ? realloc(worker->wins, (max_number + 1) * sizeof(long)) : NULL;
+        if(pool)worker->pool = pool;
+        if(plays)worker->plays = plays;
+        if(wins == NULL)return;
+        worker->wins = wins;
+        worker->capacity = max_number;
+    }
+    bingo_card_generate(&worker->base, advisor.seed);
+    bingo_card_generate(&worker->mine, advisor.seed);
+    for(int i = 0 ; i < advisor.call_count ; i++)bingo_card_mark(&worker->base, advisor.calls[i]);
+    for(int i = 0 ; i < advisor.open_count ; i++)worker->plays[advisor.open[i]] = worker->wins[advisor.open[i]] = 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: advisor_finish                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Simulates one finish of the match after we call an open       //
+//              number, against a random opponent card that holds the calls   //
+//              so far without BINGO (after ADVISOR_DRAW_TRIES draws the last //
+//              is used anyway). A number only counts toward lines on the     //
+//              cards it is on, so the line kernel runs for those alone.      //
+// Parameters: worker - Worker with prepared cards                            //
+//             pick - Index into advisor.open of the number we call           //
+// Returns: int - 1 if we win the finish, 0 otherwise                         //
+////////////////////////////////////////////////////////////////////////////////
+int advisor_finish(struct advisor_worker *worker, int pick){
+    struct bingo_card *mine = &worker->mine, *theirs = &worker->theirs;
+    uint16_t *pool = worker->pool;
+    int remaining = advisor.open_count, number;
+
+    bingo_card_copy_marks(mine, &worker->base);
+    for(int tries = 1 ; ; tries++){
+        bingo_card_generate(theirs, bingo_rng_next(&worker->rng));
+        for(int i = 0 ; i < advisor.call_count ; i++)bingo_card_mark(theirs, advisor.calls[i]);
+        if(tries >= ADVISOR_DRAW_TRIES || bingo_card_lines(theirs) < LINES_TO_WIN(theirs))break;
+    }
+    memcpy(pool, advisor.open, remaining * sizeof(uint16_t));
+    number = pool[pick];
+    pool[pick] = pool[--remaining];
+    for(int turn = 0 ; ; turn++){
+        int we_win = bingo_card_mark(mine, number) && bingo_card_lines(mine) >= LINES_TO_WIN(mine);
+        int they_win = bingo_card_mark(theirs, number) && bingo_card_lines(theirs) >= LINES_TO_WIN(theirs);
+        if(we_win && (turn % 2 == 0 || !they_win))return 1;  // On our own call we claim first
+        if(they_win || remaining == 0)return 0;
+        int index = bingo_rng_below(&worker->rng, remaining);
+        number = pool[index];
+        pool[index] = pool[--remaining];
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: start_computer_opponent                                          //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Single-player match: the computer plays Player 2 on a thread  //
+//              of its own at the other end of a socket pair, so the match    //
+//              runs exactly like one against a remote player.                //
+// Parameters: void                                                           //
+// Returns: int - 0 once the computer is connected, 1 on failure              //
+////////////////////////////////////////////////////////////////////////////////
+int start_computer_opponent(void){
+    int fds[2];
+    pthread_t thread;
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0){
+        perror("socketpair failed");
+        return 1;
+    }
+    if(pthread_create(&thread, NULL, computer_opponent_main, (void *)(intptr_t)fds[1]) != 0){
+        perror("pthread_create failed");
+        close(fds[0]);
+        close(fds[1]);
+        return 1;
+    }
+    pthread_detach(thread);
+    player_2_fd = fds[0];
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: computer_opponent_main                                           //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Thread body of the single-player computer opponent.           //
+// Parameters: arg - Its end of the socket pair                               //
+// Returns: void * - NULL                                                     //
+////////////////////////////////////////////////////////////////////////////////
+void *computer_opponent_main(void *arg){
+    int fd = (intptr_t)arg;
+    bot_play(fd, DEFAULT_STATUS);
+    close(fd);
+    return NULL;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: run_bot                                                          //
+////////////////////////////////////////////////////////////////////////////////
+// Description: "--bot <ip>": joins the game server at <ip> as the computer,  //
+//              plays whoever it is paired with, accepts every rematch and    //
+//              joins again once a session ends, until interrupted. Moves are //
+//              weighed in this process, so the server never waits on them.   //
+// Parameters: host - Game server address                                     //
+// Returns: int - Exit status, 1 on a bad address                             //
+////////////////////////////////////////////////////////////////////////////////
+int run_bot(const char *host){
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(PORT);
+    if(inet_pton(AF_INET, host, &address.sin_addr) <= 0){
+        printf("Usage: --bot <game server IP>\n");
+        return 1;
+    }
+    signal(SIGPIPE,SIG_IGN);
+    printf("%s joins the game server at %s:%d\n", BOT_NAME, host, PORT);
+    fflush(stdout);
+    while(1){
+        int fd = transport_connect(&address, NULL);
+        if(fd < 0){
+            sleep(3);
+            continue;
+        }
+        bot_play(fd, SET_VALUE);
+        close(fd);
+    }
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bot_play                                                         //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Plays one session as the computer on a connected socket: the  //
+//              name exchange (as Player 2 of a direct match, or as a game    //
+//              server player), then matches with a move from advise_move()   //
+//              on each turn, heartbeats while the opponent thinks, the card  //
+//              seed reveal and a rematch offer after every decided match.    //
+//              All state is local, so it can run beside an interactive game. //
+// Parameters: fd - Connected socket                                          //
+//             joined - Set when fd leads to a game server; results are then  //
+//                      printed, one line per match                           //
+// Returns: int - Matches decided                                             //
+////////////////////////////////////////////////////////////////////////////////
+int bot_play(int fd, int joined){
+    struct frame_decoder decoder;
+    struct bingo_frame frame;
+    struct bingo_card card;
+    struct advisor_result advice;
+    uint16_t calls[MAX_CARD_NUMBER];
+    char opponent[20];
+    int version, seat = 2, size = BINGO_CARD_SIZE, max_number = MAX_NUMBER, matches = 0;
+
+    memset(&decoder, 0, sizeof(decoder));
+    memset(&card, 0, sizeof(card));
+    memset(opponent, 0, sizeof(opponent));
+    if(send_frame(fd, MSG_HELLO, BOT_NAME, strlen(BOT_NAME)) < 0 || read_frame(fd, &decoder, &frame) != FRAME_READY)return 0;
+    if(joined){
+        if(frame.type != MSG_PAIRED || frame.length < 1 || (frame.payload[0] != 1 && frame.payload[0] != 2))return 0;
+        seat = frame.payload[0];
+        memcpy(opponent, frame.payload + 1, frame.length - 1 < 19 ? frame.length - 1 : 19);
+    }else{
+        if(frame.type != MSG_HELLO)return 0;
+        memcpy(opponent, frame.payload, frame.length < 19 ? frame.length : 19);
+    }
+    version = frame.version < PROTOCOL_VERSION ? frame.version : PROTOCOL_VERSION;
+    while(version >= 2){  // The config comes next; a token may follow and is skipped later
+        if(read_frame(fd, &decoder, &frame) != FRAME_READY)return 0;
+        if(frame.type != MSG_CONFIG)continue;
+        if(frame.length < 3 || !valid_card_config(frame.payload[0], (frame.payload[1] << 8) | frame.payload[2]))return 0;
+        size = frame.payload[0];
+        max_number = (frame.payload[1] << 8) | frame.payload[2];
+        break;
+    }
+
+    while(1){
+        uint64_t seed = new_card_seed(), last_heard = game_loop_now(), last_sent = last_heard;
+        int call_count = 0, my_turn = seat == 2, result = DEFAULT_STATUS, status;
+        if(bingo_card_init(&card, size, max_number))break;
+        bingo_card_generate(&card, seed);
+        while(result == DEFAULT_STATUS){
+            if(my_turn){
+                if(advise_move(seed, size, max_number, calls, call_count, ADVISOR_BUDGET_MS, &advice))break;
+                calls[call_count++] = advice.number;
+                my_turn = DEFAULT_STATUS;
+                last_sent = game_loop_now();
+                if(bingo_card_mark(&card, advice.number) && bingo_card_lines(&card) >= LINES_TO_WIN(&card)){
+                    send_number(fd, MSG_WIN, advice.number);
+                    result = PLAYER_WIN;
+                }else if(send_number(fd, MSG_MOVE, advice.number) < 0){
+                    break;
+                }
+                continue;
+            }
+            while(result == DEFAULT_STATUS && !my_turn && (status = frame_decoder_next(&decoder, &frame)) == FRAME_READY){
+                last_heard = game_loop_now();
+                if(frame.type == MSG_MOVE && call_count < max_number){
+                    int number = frame_number(&frame);
+                    calls[call_count++] = number;
+                    if(bingo_card_mark(&card, number) && bingo_card_lines(&card) >= LINES_TO_WIN(&card)){
+                        send_number(fd, MSG_WIN, number);
+                        result = PLAYER_WIN;
+                    }else{
+                        my_turn = SET_VALUE;
+                    }
+                }else if(frame.type == MSG_WIN){
+                    result = PLAYER_LOSE;
+                }else if(frame.type == MSG_TIMEOUT){
+                    result = PLAYER_WIN;
+                }else if(frame.type == MSG_QUIT){
+                    bingo_card_free(&card);
+                    return matches;
+                }
+            }
+            if(result != DEFAULT_STATUS || my_turn)continue;
+            if(status == FRAME_ERROR)break;
+
+            uint64_t now = game_loop_now();
+            if(version >= 3 && now - last_heard > HEARTBEAT_TIMEOUT * 1000ull)break;
+            if(version >= 3 && now - last_sent >= HEARTBEAT_INTERVAL * 1000ull){
+                if(send_frame(fd, MSG_PING, NULL, 0) < 0)break;
+                last_sent = now;
+            }
+            struct pollfd peer = { fd, POLLIN, 0 };
+            if(poll(&peer, 1, version >= 3 ? HEARTBEAT_INTERVAL * 1000 - (int)(now - last_sent) : -1) < 0 && errno != EINTR)break;
+            if(!(peer.revents & (POLLIN|POLLHUP|POLLERR)))continue;
+            size_t available;
+            unsigned char *space = frame_decoder_space(&decoder, &available);
+            ssize_t bytes_read = read(fd, space, available);
+            if(bytes_read <= 0 && !(bytes_read < 0 && errno == EINTR))break;
+            if(bytes_read > 0)decoder.end += bytes_read;
+        }
+        if(result == DEFAULT_STATUS)break;  // Connection lost mid-match
+        matches++;
+        if(joined){
+            printf("%s %s against %s after %d calls\n", BOT_NAME, result == PLAYER_WIN ? "won" : "lost", opponent, call_count);
+            fflush(stdout);
+        }
+        if(version >= RECORD_MIN_VERSION){
+            unsigned char revealed[8];
+            for(int b = 0 ; b < 8 ; b++)revealed[b] = seed >> (56 - 8*b);
+            send_frame(fd, MSG_CARD, revealed, sizeof(revealed));
+        }
+        if(version < REMATCH_MIN_VERSION || send_frame(fd, MSG_REMATCH, NULL, 0) < 0)break;
+        do{
+            if(read_frame(fd, &decoder, &frame) != FRAME_READY || frame.type == MSG_QUIT){
+                bingo_card_free(&card);
+                return matches;
+            }
+        }while(frame.type != MSG_REMATCH);
+    }
+    bingo_card_free(&card);
+    return matches;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// LOCAL TRANSPORT                                                            //
+////////////////////////////////////////////////////////////////////////////////
+// Whoever listens on PORT also listens on an abstract Unix socket named      //
+// after the port. A client whose peer address is one of this host's own      //
+// tries that socket first and falls back to TCP, so same-host matches skip   //
+// the loopback TCP stack while every other path keeps working on plain file  //
+// descriptors. Abstract names need no file and vanish with their process.    //
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: transport_local_name                                             //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Builds the abstract Unix address standing for a TCP port.     //
+// Parameters: address - Receives the address                                 //
+//             port - TCP port it stands for                                  //
+// Returns: socklen_t - Length of the address                                 //
+////////////////////////////////////////////////////////////////////////////////
+socklen_t transport_local_name(struct sockaddr_un *address, int port){
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    int len = snprintf(address->sun_path + 1, sizeof(address->sun_path) - 1, LOCAL_SOCKET_NAME, port);
+    return offsetof(struct sockaddr_un, sun_path) + 1 + len;  // Leading 0: abstract
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: transport_is_local                                               //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Tells whether an address reaches this host: any loopback      //
+//              address or one of the addresses of our interfaces.            //
+// Parameters: address - IPv4 address of the peer                             //
+// Returns: int - SET_VALUE if local, DEFAULT_STATUS otherwise                //
+////////////////////////////////////////////////////////////////////////////////
+int transport_is_local(struct in_addr address){
+    struct ifaddrs *list;
+    int local = (ntohl(address.s_addr) >> 24) == 127 ? SET_VALUE : DEFAULT_STATUS;
+    if(local || getifaddrs(&list) < 0)return local;
+    for(struct ifaddrs *entry = list ; entry && !local ; entry = entry->ifa_next)
+        if(entry->ifa_addr && entry->ifa_addr->sa_family == AF_INET &&
+           ((struct sockaddr_in *)entry->ifa_addr)->sin_addr.s_addr == address.s_addr)local = SET_VALUE;
+    freeifaddrs(list);
+    return local;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: transport_listen                                                 //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Opens the Unix listener of a port next to its TCP one. A      //
+//              failure is not an error: clients then come over TCP.          //
+// Parameters: port - TCP port it stands for                                  //
+//             flags - Extra socket() type flags, such as SOCK_NONBLOCK       //
+//             backlog - Pending connections queued by listen()               //
+// Returns: int - Listening descriptor, -1 if none                            //
+////////////////////////////////////////////////////////////////////////////////
+int transport_listen(int port, int flags, int backlog){
+    struct sockaddr_un address;
+    socklen_t len = transport_local_name(&address, port);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | flags, 0);
+    if(fd < 0)return -1;
+    if(bind(fd, (struct sockaddr *)&address, len) < 0 || listen(fd, backlog) < 0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: transport_connect                                                //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Connects to a peer, over its Unix socket when the address is  //
+//              local (unless --tcp) and over TCP otherwise or when nobody    //
+//              listens there, such as a peer from before this transport.     //
+// Parameters: address - Peer's IPv4 address and port                         //
+//             local - Set when the Unix socket was used, may be NULL         //
+// Returns: int - Connected blocking descriptor, -1 on failure                //
+////////////////////////////////////////////////////////////////////////////////
+int transport_connect(const struct sockaddr_in *address, int *local){
+    int fd;
+    if(local)*local = DEFAULT_STATUS;
+    if(!transport_tcp_only && transport_is_local(address->sin_addr)){
+        struct sockaddr_un name;
+        socklen_t len = transport_local_name(&name, ntohs(address->sin_port));
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd >= 0 && connect(fd, (struct sockaddr *)&name, len) == 0){
+            if(local)*local = SET_VALUE;
+            return fd;
+        }
+        if(fd >= 0)close(fd);
+    }
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd >= 0 && connect(fd, (const struct sockaddr *)address, sizeof(*address)) == 0)return fd;
+    if(fd >= 0)close(fd);
+    return -1;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: transport_accept                                                 //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Waits on Player 1's TCP and Unix listeners and accepts from   //
+//              whichever is ready, the Unix one first.                       //
+// Parameters: tcp_fd - TCP listener                                          //
+//             local_fd - Unix listener, -1 if none                           //
+//             timeout - Milliseconds to wait, -1 for ever                    //
+// Returns: int - Connected descriptor, -1 on time-out or failure             //
+////////////////////////////////////////////////////////////////////////////////
+int transport_accept(int tcp_fd, int local_fd, int timeout){
+    struct pollfd listeners[2] = { { local_fd, POLLIN, 0 }, { tcp_fd, POLLIN, 0 } };
+    if(poll(listeners, 2, timeout) <= 0)return -1;  // poll() skips a -1 descriptor
+    return accept(listeners[0].revents & POLLIN ? local_fd : tcp_fd, NULL, NULL);
+}
@@ -0,0 +1,422 @@
+////////////////////////////////////////////////////////////////////////////////
+// BENCHMARK DESCRIPTION                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Times the hot paths of bingo_2_0.c: card generation, marking, win checks   //
+// on the default 5x5 card and on the largest 64x64 card, move frame          //
+// encode/decode, a caller-hall call across many cards and the round trip of  //
+// a move over a loopback TCP connection and over the local Unix socket.      //
+// Every benchmark prints one JSON line with nanoseconds per operation and    //
+// p50/p99 over samples, so runs can be compared by scripts.                  //
+////////////////////////////////////////////////////////////////////////////////
+// Build: gcc -O2 bingo_bench.c -o bingo_bench -pthread                       //
+// Usage: ./bingo_bench [--samples N] [--batch N]                             //
+////////////////////////////////////////////////////////////////////////////////
+
+#define BINGO_NO_MAIN
+#include "bingo_2_0.c"
+
+////////////////////////////////////////////////////////////////////////////////
+// MACROS FOR BENCHMARK                                                       //
+////////////////////////////////////////////////////////////////////////////////
+#define BENCH_SAMPLES 2000     // Timed samples per benchmark
+#define BENCH_BATCH 1000       // Operations per sample for in-memory paths
+#define BENCH_PORT (PORT + 1)  // Loopback port used by the round-trip test
+#define BENCH_MAX_SAMPLES 1000000 // Upper bound accepted for --samples
+#define BENCH_HALL_CARDS 10000 // Cards in the caller-hall benchmark
+#define BENCH_HALL_NUMBERS 75  // Number range of the caller-hall cards
+
+////////////////////////////////////////////////////////////////////////////////
+// STRUCTURES FOR BENCHMARK                                                   //
+////////////////////////////////////////////////////////////////////////////////
+struct bench_result{
+    const char *name;                    // Benchmark name in the JSON output
+    long operations;                     // Operations timed in total
+    double total_ns;                     // Time of all samples
+    double *samples;                     // Nanoseconds per operation per sample
+    int sample_count;                    // Number of samples taken
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION DECLARATIONS FOR BENCHMARK                                        //
+////////////////////////////////////////////////////////////////////////////////
+uint64_t bench_now_ns(void);                               // Monotonic clock
+int      compare_double(const void *,const void *);        // qsort comparator
+void     bench_report(struct bench_result *);              // Prints JSON line
+void     bench_card_generate(struct bench_result *,int);   // bingo_card_generate
+void     bench_card_mark(struct bench_result *,int);       // bingo_card_mark
+void     bench_card_lines(struct bench_result *,int);      // bingo_card_lines
+void     bench_card_lines_large(struct bench_result *,int);// 64x64 line check
+void     bench_move_codec(struct bench_result *,int);      // Frame encode+decode
+void     bench_hall_mark(struct bench_result *,int);       // One call, many cards
+void     bench_loopback_rtt(struct bench_result *,int);    // Move round trip
+void    *bench_echo_main(void *);                          // Echo peer thread
+
+////////////////////////////////////////////////////////////////////////////////
+// GLOBAL VARIABLES FOR BENCHMARK                                             //
+////////////////////////////////////////////////////////////////////////////////
+volatile uint64_t bench_sink;         // Keeps results alive past the optimiser
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: main                                                             //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Runs every benchmark and prints one JSON line per benchmark.  //
+// Parameters: argc, argv - Optional --samples and --batch overrides          //
+// Returns: int - Exit status (0 for success)                                 //
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char *argv[]){
+    int samples = BENCH_SAMPLES, batch = BENCH_BATCH;
+    for(int i = 1 ; i + 1 < argc ; i += 2){
+        if(strcmp(argv[i],"--samples") == 0)samples = atoi(argv[i+1]);
+        else if(strcmp(argv[i],"--batch") == 0)batch = atoi(argv[i+1]);
+    }
+    if(samples < 1 || samples > BENCH_MAX_SAMPLES || batch < 1){
+        printf("Usage: %s [--samples 1-%d] [--batch N]\n", argv[0], BENCH_MAX_SAMPLES);
+        return 1;
+    }
+    signal(SIGPIPE,SIG_IGN);
+
+    struct bench_result result;
+    double *buffer = malloc(samples * sizeof(double));
+    if(buffer == NULL){
+        perror("malloc failed");
+        return 1;
+    }
+    void (*benchmarks[])(struct bench_result *,int) = {
+        bench_card_generate, bench_card_mark, bench_card_lines, bench_card_lines_large, bench_move_codec,
+        bench_hall_mark
+    };
+    for(size_t i = 0 ; i < sizeof(benchmarks)/sizeof(benchmarks[0]) ; i++){
+        memset(&result, 0, sizeof(result));
+        result.samples = buffer;
+        result.sample_count = samples;
+        benchmarks[i](&result, batch);
+        bench_report(&result);
+    }
+    for(int local = DEFAULT_STATUS ; local <= SET_VALUE ; local++){
+        memset(&result, 0, sizeof(result));
+        result.samples = buffer;
+        result.sample_count = samples;
+        bench_loopback_rtt(&result, local);
+        bench_report(&result);
+    }
+    free(buffer);
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bench_now_ns                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Reads the monotonic clock.                                    //
+// Parameters: void                                                           //
+// Returns: uint64_t - Nanoseconds                                            //
+////////////////////////////////////////////////////////////////////////////////
+uint64_t bench_now_ns(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: compare_double                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: qsort comparator for sample values.                           //
+// Parameters: a, b - Pointers to the doubles to compare                      //
+// Returns: int - Negative, zero or positive like strcmp                      //
+////////////////////////////////////////////////////////////////////////////////
+int compare_double(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bench_report                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Sorts the samples and prints the result as one JSON line.     //
+// Parameters: result - Finished benchmark                                    //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void bench_report(struct bench_result *result){
+    if(result->sample_count == 0 || result->operations == 0){
+        printf("{\"benchmark\":\"%s\",\"error\":\"no samples\"}\n", result->name);
+        return;
+    }
+    qsort(result->samples, result->sample_count, sizeof(double), compare_double);
+    int p50 = (result->sample_count - 1) * 50 / 100;
+    int p99 = (result->sample_count - 1) * 99 / 100;
+    printf("{\"benchmark\":\"%s\",\"operations\":%ld,\"ns_per_op\":%.2f,\"p50_ns\":%.2f,\"p99_ns\":%.2f}\n",
+           result->name, result->operations, result->total_ns / result->operations,
+           result->samples[p50], result->samples[p99]);
+    fflush(stdout);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bench_card_generate                                              //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Times building a card from a seed (what initialize_bingo_game //
+//              does apart from the terminal output).                         //
+// Parameters: result - Receives the samples                                  //
+//             batch - Operations per sample                                  //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void bench_card_generate(struct bench_result *result, int batch){
+    struct bingo_card card;
+    uint64_t seed = 1;
+    memset(&card, 0, sizeof(card));
+    result->name = "card_generate";
+    for(int s = 0 ; s < result->sample_count ; s++){
+        uint64_t start = bench_now_ns();
+        for(int i = 0 ; i < batch ; i++){
+            bingo_card_generate(&card, seed++);
+            bench_sink += card.cells[0];
+        }
+        uint64_t elapsed = bench_now_ns() - start;
+        result->samples[s] = (double)elapsed / batch;
+        result->total_ns += elapsed;
+        result->operations += batch;
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bench_card_mark                                                  //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Times marking called numbers on a card (the engine behind     //
+//              mark_number, without the redraw).                             //
+// Parameters: result - Receives the samples                                  //
+//             batch - Operations per sample                                  //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void bench_card_mark(struct bench_result *result, int batch){
+    struct bingo_card card;
+    memset(&card, 0, sizeof(card));
+    bingo_card_generate(&card, 7);
+    result->name = "card_mark";
+    for(int s = 0 ; s < result->sample_count ; s++){
+        uint64_t start = bench_now_ns();
+        for(int i = 0 ; i < batch ; i++){
+            if((i % MAX_NUMBER) == 0)card.marked = 0;
+            bench_sink += bingo_card_mark(&card, i % MAX_NUMBER + 1);
+        }
+        uint64_t elapsed = bench_now_ns() - start;
+        result->samples[s] = (double)elapsed / batch;
+        result->total_ns += elapsed;
+        result->operations += batch;
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bench_card_lines                                                 //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Times counting completed lines (check_for_win) on cards with  //
+//              random marked masks prepared outside the timed loop.          //
+// Parameters: result - Receives the samples                                  //
+//             batch - Operations per sample                                  //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void bench_card_lines(struct bench_result *result, int batch){
+    struct bingo_card card;
+    struct bingo_rng rng;
+    uint32_t masks[1024];
+    memset(&card, 0, sizeof(card));
+    bingo_card_generate(&card, 11);
+    bingo_rng_seed(&rng, 11);
+    for(int i = 0 ; i < 1024 ; i++)masks[i] = bingo_rng_next(&rng) & bingo_rng_next(&rng) & ((1u << CARD_CELLS) - 1);
+    result->name = "card_lines";
+    for(int s = 0 ; s < result->sample_count ; s++){
+        uint64_t start = bench_now_ns();
+        for(int i = 0 ; i < batch ; i++){
+            card.marked = masks[i & 1023];
+            bench_sink += bingo_card_lines(&card);
+        }
+        uint64_t elapsed = bench_now_ns() - start;
+        result->samples[s] = (double)elapsed / batch;
+        result->total_ns += elapsed;
+        result->operations += batch;
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bench_card_lines_large                                           //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Times counting completed lines on a 64x64 card whose rows are //
+//              random words, mostly full, switched outside the timed loop    //
+//              by swapping the row pointer.                                  //
+// Parameters: result - Receives the samples                                  //
+//             batch - Operations per sample                                  //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void bench_card_lines_large(struct bench_result *result, int batch){
+    struct bingo_card card;
+    struct bingo_rng rng;
+    uint64_t *rows = malloc(64 * MAX_CARD_SIZE * sizeof(uint64_t));
+    memset(&card, 0, sizeof(card));
+    if(rows == NULL || bingo_card_init(&card, MAX_CARD_SIZE, MAX_CARD_CELLS)){
+        free(rows);
+        result->name = "card_lines_64x64";
+        return;
+    }
+    uint64_t *own_rows = card.marked_rows;
+    bingo_rng_seed(&rng, 13);
+    for(int i = 0 ; i < 64 * MAX_CARD_SIZE ; i++)
+        rows[i] = (bingo_rng_next(&rng) & 7) ? ~0ull : bingo_rng_next(&rng);
+    result->name = "card_lines_64x64";
+    for(int s = 0 ; s < result->sample_count ; s++){
+        uint64_t start = bench_now_ns();
+        for(int i = 0 ; i < batch ; i++){
+            card.marked_rows = rows + (i & 63) * MAX_CARD_SIZE;
+            bench_sink += bingo_card_lines(&card);
+        }
+        uint64_t elapsed = bench_now_ns() - start;
+        result->samples[s] = (double)elapsed / batch;
+        result->total_ns += elapsed;
+        result->operations += batch;
+    }
+    card.marked_rows = own_rows;
+    bingo_card_free(&card);
+    free(rows);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bench_move_codec                                                 //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Times encoding a MSG_MOVE frame and decoding it back through  //
+//              a frame decoder, as one operation.                            //
+// Parameters: result - Receives the samples                                  //
+//             batch - Operations per sample                                  //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void bench_move_codec(struct bench_result *result, int batch){
+    struct frame_decoder decoder;
+    struct bingo_frame frame;
+    memset(&decoder, 0, sizeof(decoder));
+    result->name = "move_encode_decode";
+    for(int s = 0 ; s < result->sample_count ; s++){
+        uint64_t start = bench_now_ns();
+        for(int i = 0 ; i < batch ; i++){
+            size_t available;
+            unsigned char *space = frame_decoder_space(&decoder, &available);
+            decoder.end += encode_number_frame(space, PROTOCOL_VERSION, MSG_MOVE, i % MAX_NUMBER + 1);
+            if(frame_decoder_next(&decoder, &frame) == FRAME_READY)bench_sink += frame_number(&frame);
+        }
+        uint64_t elapsed = bench_now_ns() - start;
+        result->samples[s] = (double)elapsed / batch;
+        result->total_ns += elapsed;
+        result->operations += batch;
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bench_hall_mark                                                  //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Times one caller-hall call (hall_mark) over BENCH_HALL_CARDS  //
+//              5x5 cards with numbers 1-BENCH_HALL_NUMBERS. Once every       //
+//              number is called the line counters are cleared and calling    //
+//              starts over, inside the timed loop.                           //
+// Parameters: result - Receives the samples                                  //
+//             batch - Operations per sample                                  //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void bench_hall_mark(struct bench_result *result, int batch){
+    struct bingo_hall *hall = hall_create(BINGO_CARD_SIZE, BENCH_HALL_NUMBERS, 1);
+    result->name = "hall_call_10k_cards";
+    if(hall == NULL || hall_reserve(hall, BENCH_HALL_CARDS)){
+        hall_free(hall);
+        result->sample_count = 0;
+        return;
+    }
+    hall->card_count = BENCH_HALL_CARDS;
+    for(long i = 0 ; i < hall->card_count ; i++){
+        hall->cards[i].conn = NULL;
+        hall->cards[i].seed = i + 1;
+    }
+    hall_build_index(hall);
+    int number = 0;
+    for(int s = 0 ; s < result->sample_count ; s++){
+        uint64_t start = bench_now_ns();
+        for(int i = 0 ; i < batch ; i++){
+            if(number == BENCH_HALL_NUMBERS){
+                memset(hall->line_counts, 0, hall->card_count * (2 * BINGO_CARD_SIZE + 2));
+                number = 0;
+            }
+            bench_sink += hall_mark(hall, ++number);
+        }
+        uint64_t elapsed = bench_now_ns() - start;
+        result->samples[s] = (double)elapsed / batch;
+        result->total_ns += elapsed;
+        result->operations += batch;
+    }
+    hall_free(hall);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bench_echo_main                                                  //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Echo peer for the round-trip benchmark. Decodes every frame   //
+//              and sends it straight back until the connection closes.       //
+// Parameters: arg - Pointer to the connected socket descriptor               //
+// Returns: void * - NULL                                                     //
+////////////////////////////////////////////////////////////////////////////////
+void *bench_echo_main(void *arg){
+    int fd = *(int *)arg;
+    struct frame_decoder decoder;
+    struct bingo_frame frame;
+    memset(&decoder, 0, sizeof(decoder));
+    while(read_frame(fd, &decoder, &frame) == FRAME_READY){
+        if(send_frame(fd, frame.type, frame.payload, frame.length) < 0)break;
+    }
+    close(fd);
+    return NULL;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: bench_loopback_rtt                                               //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Times one MSG_MOVE round trip over a loopback TCP connection  //
+//              or the local Unix socket to an echo thread, one sample per    //
+//              move.                                                         //
+// Parameters: result - Receives the samples                                  //
+//             local - Use the Unix socket (see LOCAL TRANSPORT)              //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void bench_loopback_rtt(struct bench_result *result, int local){
+    struct sockaddr_in address;
+    struct frame_decoder decoder;
+    struct bingo_frame frame;
+    pthread_t echo_thread;
+    int enable = SET_VALUE;
+    int listen_fd, client_fd, echo_fd = -1, connected = DEFAULT_STATUS;
+
+    result->name = local ? "local_move_rtt" : "loopback_move_rtt";
+    memset(&decoder, 0, sizeof(decoder));
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(BENCH_PORT);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(local){
+        listen_fd = transport_listen(BENCH_PORT, 0, 1);
+        client_fd = listen_fd < 0 ? -1 : transport_connect(&address, &connected);
+    }else{
+        listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+        if(bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listen_fd, 1) < 0)client_fd = -1;
+        else if((client_fd = socket(AF_INET, SOCK_STREAM, 0)) >= 0 &&
+                connect(client_fd, (struct sockaddr *)&address, sizeof(address)) == 0)connected = SET_VALUE;
+    }
+    if(!connected || (echo_fd = accept(listen_fd, NULL, NULL)) < 0){
+        perror("Loopback setup failed");
+        result->sample_count = 0;
+        if(listen_fd >= 0)close(listen_fd);
+        if(client_fd >= 0)close(client_fd);
+        return;
+    }
+    close(listen_fd);
+    if(!local){
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        setsockopt(echo_fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    }
+    pthread_create(&echo_thread, NULL, bench_echo_main, &echo_fd);
+
+    for(int s = 0 ; s < result->sample_count ; s++){
+        uint64_t start = bench_now_ns();
+        if(send_number(client_fd, MSG_MOVE, s % MAX_NUMBER + 1) < 0 ||
+           read_frame(client_fd, &decoder, &frame) != FRAME_READY){
+            result->sample_count = s;
+            break;
+        }
+        uint64_t elapsed = bench_now_ns() - start;
+        bench_sink += frame_number(&frame);
+        result->samples[s] = elapsed;
+        result->total_ns += elapsed;
+        result->operations++;
+    }
+    close(client_fd);
+    pthread_join(echo_thread, NULL);
+}
@@ -0,0 +1,770 @@
+////////////////////////////////////////////////////////////////////////////////
+// LOAD GENERATOR DESCRIPTION                                                 //
+////////////////////////////////////////////////////////////////////////////////
+// Simulates many concurrent players against a running game server (--server) //
+// so it can be capacity-planned before real players arrive. Every bot opens  //
+// its own connection, sends its nick name, builds the card the server        //
+// configures and plays legal moves after a think time until its match ends,  //
+// then reconnects for the next match. Connections are opened at a fixed      //
+// ramp-up rate and spread over worker threads with one epoll loop each. Bots //
+// stamp their moves, so round trips through the server are measured without  //
+// the opponent's think time. The report holds per-move round-trip,           //
+// connection setup and pairing time histograms and the error counts. A       //
+// server on this host is loaded over its Unix socket unless --tcp is given.  //
+////////////////////////////////////////////////////////////////////////////////
+// Build: gcc -O2 bingo_load.c -o bingo_load -pthread                         //
+// Usage: ./bingo_load [--host IP] [--players N] [--ramp N] [--think ms]      //
+//                     [--duration s] [--threads N] [--tcp]                   //
+////////////////////////////////////////////////////////////////////////////////
+
+#define BINGO_NO_MAIN
+#include "bingo_2_0.c"
+#include <sys/resource.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// MACROS FOR LOAD GENERATOR                                                  //
+////////////////////////////////////////////////////////////////////////////////
+#define LOAD_HOST "127.0.0.1"  // Default server address
+#define LOAD_PLAYERS 1000      // Default concurrent bots
+#define LOAD_RAMP 200          // Default new connections per second
+#define LOAD_THINK_MS 500      // Default mean think time per move
+#define LOAD_DURATION 30       // Default seconds of load
+#define LOAD_MAX_THREADS 256   // Upper bound on worker threads
+#define LOAD_MAX_EVENTS 256    // Events handled per epoll_wait call
+#define LOAD_MOVE_PAYLOAD 18   // Number (16-bit) + stamp (64-bit) + echo (64-bit)
+#define LOAD_HIST_LINEAR 16    // Histogram buckets of one microsecond each
+#define LOAD_HIST_STEPS 8      // Buckets per power of two above that
+#define LOAD_HIST_BUCKETS (LOAD_HIST_LINEAR + 40*LOAD_HIST_STEPS) // Up to 2^44 us
+
+#define LOAD_IDLE 0            // Waiting for its ramp-up slot or next match
+#define LOAD_CONNECTING 1      // Non-blocking connect in progress
+#define LOAD_PAIRING 2         // MSG_HELLO sent, waiting for MSG_PAIRED
+#define LOAD_CONFIG 3          // Paired, waiting for MSG_CONFIG (version 2+)
+#define LOAD_PLAYING 4         // Match running
+
+////////////////////////////////////////////////////////////////////////////////
+// STRUCTURES FOR LOAD GENERATOR                                              //
+////////////////////////////////////////////////////////////////////////////////
+struct load_histogram{
+    long counts[LOAD_HIST_BUCKETS];      // Samples per log-linear bucket
+    long total;                          // Samples taken
+    uint64_t max_us;                     // Largest sample
+};
+
+struct load_stats{
+    long moves;                          // Moves sent (MOVE and WIN)
+    long games;                          // Matches played to a result
+    long connects;                       // Connections established
+    long connect_errors;                 // connect() failures
+    long disconnects;                    // Server closed a connection mid-match
+    long protocol_errors;                // Unexpected or malformed frames
+    long peer_quits;                     // Opponents leaving (MSG_QUIT)
+    long timeouts;                       // Matches ended by MSG_TIMEOUT
+    long unpaired;                       // Bots still waiting when load stopped
+    struct load_histogram rtt;           // Move round trip without think time
+    struct load_histogram connect;       // Connection setup
+    struct load_histogram pairing;       // MSG_HELLO to MSG_PAIRED
+};
+
+struct load_bot{
+    int fd;                              // Socket, -1 while idle
+    int state;                           // LOAD_* state
+    int role;                            // 2 moves first, 1 waits first
+    int my_turn;                         // Set while a move is due from us
+    uint32_t generation;                 // Invalidates older timers
+    char name[20];                       // Nick name sent in MSG_HELLO
+    uint64_t started_us;                 // Start of connect or pairing
+    uint64_t peer_stamp;                 // Stamp of the opponent's last move
+    uint64_t peer_stamp_at;              // When that move arrived
+    struct bingo_card card;              // Card of the current match
+    uint16_t *pool;                      // Numbers not called yet
+    uint16_t *position;                  // Index of every number in pool
+    int remaining;                       // Numbers left in pool
+    struct frame_decoder decoder;        // Receive buffer
+};
+
+struct load_timer{
+    uint64_t due_us;                     // When the timer fires
+    struct load_bot *bot;                // Bot to act
+    uint32_t generation;                 // Bot generation it was set for
+};
+
+struct load_worker{
+    pthread_t thread;                    // Worker thread
+    int index;                           // Worker number
+    int epoll_fd;                        // Event loop of this worker's bots
+    struct load_bot *bots;               // Bots owned by this worker
+    int bot_count;                       // Number of bots
+    struct load_timer *timers;           // Min-heap on due_us
+    int timer_count, timer_capacity;     // Used and allocated heap slots
+    struct bingo_rng rng;                // Think times and move choice
+    struct load_stats stats;             // Results, merged after join
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION DECLARATIONS FOR LOAD GENERATOR                                   //
+////////////////////////////////////////////////////////////////////////////////
+uint64_t load_now_us(void);                                      // Monotonic clock
+void  handle_load_sigint(int);                                   // Stops early
+int   load_hist_bucket(uint64_t);                                // Bucket of a value
+uint64_t load_hist_value(int);                                   // Bucket lower bound
+void  load_hist_add(struct load_histogram *,uint64_t);           // Records a sample
+void  load_hist_merge(struct load_histogram *,const struct load_histogram *);
+uint64_t load_hist_percentile(const struct load_histogram *,double); // p-th sample
+void  load_hist_report(const char *,const struct load_histogram *);  // Prints one
+void  load_schedule(struct load_worker *,struct load_bot *,uint64_t); // Sets timer
+void  load_connect(struct load_worker *,struct load_bot *);      // Opens connection
+void  load_connected(struct load_worker *,struct load_bot *);    // Sends MSG_HELLO
+void  load_start_match(struct load_worker *,struct load_bot *,int,int); // New card
+void  load_move(struct load_worker *,struct load_bot *);         // Plays one move
+int   load_send(struct load_worker *,struct load_bot *,int,int); // MOVE or WIN
+void  load_read(struct load_worker *,struct load_bot *);         // Drains socket
+void  load_frame(struct load_worker *,struct load_bot *,const struct bingo_frame *);
+void  load_called(struct load_bot *,int);                        // Marks a call
+void  load_end(struct load_worker *,struct load_bot *,long *);   // Ends match
+void *load_worker_main(void *);                                  // Worker thread
+
+////////////////////////////////////////////////////////////////////////////////
+// GLOBAL VARIABLES FOR LOAD GENERATOR                                        //
+////////////////////////////////////////////////////////////////////////////////
+struct sockaddr_in load_address;      // Server to load
+struct sockaddr_un load_local_name;   // Its Unix socket, used when load_local
+socklen_t load_local_len;             // Length of load_local_name
+int load_local = DEFAULT_STATUS;      // The server is on this host and listens locally
+int load_players = LOAD_PLAYERS;      // Concurrent bots (--players)
+int load_ramp = LOAD_RAMP;            // New connections per second (--ramp)
+int load_think_ms = LOAD_THINK_MS;    // Mean think time (--think)
+int load_threads = 1;                 // Worker threads (--threads)
+uint64_t load_start_us;               // When the load started
+uint64_t load_stop_us;                // When the load stops
+volatile sig_atomic_t load_running = SET_VALUE; // Cleared by SIGINT
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: main                                                             //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Parses the options, runs the workers while printing one       //
+//              progress line per second, then merges and prints the report.  //
+// Parameters: argc, argv - Command line options                              //
+// Returns: int - Exit status (0 for success)                                 //
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char *argv[]){
+    const char *host = LOAD_HOST;
+    int duration = LOAD_DURATION;
+    for(int i = 1 ; i < argc ; i++){
+        if(strcmp(argv[i],"--tcp") == 0)transport_tcp_only = SET_VALUE;
+        else if(i + 1 == argc)break;
+        else if(strcmp(argv[i],"--host") == 0)host = argv[++i];
+        else if(strcmp(argv[i],"--players") == 0)load_players = atoi(argv[++i]);
+        else if(strcmp(argv[i],"--ramp") == 0)load_ramp = atoi(argv[++i]);
+        else if(strcmp(argv[i],"--think") == 0)load_think_ms = atoi(argv[++i]);
+        else if(strcmp(argv[i],"--duration") == 0)duration = atoi(argv[++i]);
+        else if(strcmp(argv[i],"--threads") == 0)load_threads = atoi(argv[++i]);
+    }
+    memset(&load_address, 0, sizeof(load_address));
+    load_address.sin_family = AF_INET;
+    load_address.sin_port = htons(PORT);
+    if(inet_pton(AF_INET, host, &load_address.sin_addr) <= 0 || load_players < 1 || load_ramp < 1 ||
+       load_think_ms < 0 || duration < 1 || load_threads < 1 || load_threads > LOAD_MAX_THREADS){
+        printf("Usage: %s [--host IP] [--players N] [--ramp connections/s] [--think ms] [--duration s] [--threads 1-%d] [--tcp]\n",
+               argv[0], LOAD_MAX_THREADS);
+        return 1;
+    }
+    if(load_threads > load_players)load_threads = load_players;
+    if(!transport_tcp_only && transport_is_local(load_address.sin_addr)){
+        int probe = transport_connect(&load_address, &load_local);  // Does the server listen locally?
+        if(probe >= 0)close(probe);
+        load_local_len = transport_local_name(&load_local_name, PORT);
+    }
+
+    struct rlimit files;  // One descriptor per bot, so lift the soft limit
+    if(getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max){
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+    if(getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < (rlim_t)load_players + 64)
+        printf("Warning: open-file limit %ld is below %d bots, raise it with ulimit -n\n",(long)files.rlim_cur,load_players);
+    signal(SIGINT,handle_load_sigint);
+    signal(SIGPIPE,SIG_IGN);
+
+    struct load_worker *workers = calloc(load_threads, sizeof(*workers));
+    if(workers == NULL){
+        perror("calloc failed");
+        return 1;
+    }
+    printf("Loading %s:%d over %s with %d players, %d connections/s, %d ms think time, %d s, %d threads\n",
+           host, PORT, load_local ? "its Unix socket" : "TCP", load_players, load_ramp, load_think_ms, duration, load_threads);
+    load_start_us = load_now_us();
+    load_stop_us = load_start_us + duration * 1000000ull;
+    uint64_t seed = new_card_seed();
+    for(int i = 0 ; i < load_threads ; i++){
+        workers[i].index = i;
+        bingo_rng_seed(&workers[i].rng, seed + i * 0x9e3779b97f4a7c15ull);
+        pthread_create(&workers[i].thread, NULL, load_worker_main, &workers[i]);
+    }
+    long last_moves = 0;
+    for(int second = 1 ; load_running && second <= duration ; second++){
+        sleep(1);
+        long moves = 0, games = 0, connects = 0, errors = 0;
+        for(int i = 0 ; i < load_threads ; i++){
+            moves += __atomic_load_n(&workers[i].stats.moves, __ATOMIC_RELAXED);
+            games += __atomic_load_n(&workers[i].stats.games, __ATOMIC_RELAXED);
+            connects += __atomic_load_n(&workers[i].stats.connects, __ATOMIC_RELAXED);
+            errors += __atomic_load_n(&workers[i].stats.connect_errors, __ATOMIC_RELAXED) +
+                      __atomic_load_n(&workers[i].stats.disconnects, __ATOMIC_RELAXED) +
+                      __atomic_load_n(&workers[i].stats.protocol_errors, __ATOMIC_RELAXED);
+        }
+        printf("t=%3ds  connections %7ld  games %7ld  moves/s %8ld  errors %ld\n",second,connects,games,moves - last_moves,errors);
+        fflush(stdout);
+        last_moves = moves;
+    }
+    load_running = DEFAULT_STATUS;
+
+    struct load_stats total;
+    memset(&total, 0, sizeof(total));
+    for(int i = 0 ; i < load_threads ; i++){
+        pthread_join(workers[i].thread, NULL);
+        struct load_stats *stats = &workers[i].stats;
+        total.moves += stats->moves;
+        total.games += stats->games;
+        total.connects += stats->connects;
+        total.connect_errors += stats->connect_errors;
+        total.disconnects += stats->disconnects;
+        total.protocol_errors += stats->protocol_errors;
+        total.peer_quits += stats->peer_quits;
+        total.timeouts += stats->timeouts;
+        total.unpaired += stats->unpaired;
+        load_hist_merge(&total.rtt, &stats->rtt);
+        load_hist_merge(&total.connect, &stats->connect);
+        load_hist_merge(&total.pairing, &stats->pairing);
+    }
+    free(workers);
+    double seconds = (load_now_us() - load_start_us) / 1e6;
+    printf("\nMoves %ld (%.0f per second), games %ld, connections %ld over %.1f s\n",
+           total.moves, total.moves / seconds, total.games, total.connects, seconds);
+    printf("Errors : connect %ld, disconnected %ld, protocol %ld | opponent quit %ld, timed out %ld, unpaired at stop %ld\n",
+           total.connect_errors, total.disconnects, total.protocol_errors, total.peer_quits, total.timeouts, total.unpaired);
+    load_hist_report("move_rtt", &total.rtt);
+    load_hist_report("connect", &total.connect);
+    load_hist_report("pairing", &total.pairing);
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: load_now_us                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Reads the monotonic clock.                                    //
+// Parameters: void                                                           //
+// Returns: uint64_t - Microseconds                                           //
+////////////////////////////////////////////////////////////////////////////////
+uint64_t load_now_us(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000u + now.tv_nsec / 1000;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: handle_load_sigint                                               //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Stops the load on SIGINT (Ctrl+C); the report still prints.   //
+// Parameters: sig_no - Signal number (unused in this implementation)         //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void handle_load_sigint(int sig_no){
+    load_running = DEFAULT_STATUS;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: load_hist_bucket                                                 //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Maps a value to its histogram bucket: one bucket per          //
+//              microsecond up to LOAD_HIST_LINEAR, then LOAD_HIST_STEPS      //
+//              buckets per power of two, so every bucket is within 12.5%.    //
+// Parameters: us - Value in microseconds                                     //
+// Returns: int - Bucket index                                                //
+////////////////////////////////////////////////////////////////////////////////
+int load_hist_bucket(uint64_t us){
+    if(us < LOAD_HIST_LINEAR)return us;
+    int exponent = 63 - __builtin_clzll(us);  // 4 and up
+    int bucket = LOAD_HIST_LINEAR + (exponent - 4) * LOAD_HIST_STEPS + ((us >> (exponent - 3)) & (LOAD_HIST_STEPS - 1));
+    return bucket < LOAD_HIST_BUCKETS ? bucket : LOAD_HIST_BUCKETS - 1;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: load_hist_value                                                  //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Smallest value that falls into a bucket.                      //
+// Parameters: bucket - Bucket index                                          //
+// Returns: uint64_t - Microseconds                                           //
+////////////////////////////////////////////////////////////////////////////////
+uint64_t load_hist_value(int bucket){
+    if(bucket < LOAD_HIST_LINEAR)return bucket;
+    int exponent = 4 + (bucket - LOAD_HIST_LINEAR) / LOAD_HIST_STEPS;
+    return (uint64_t)(LOAD_HIST_STEPS + (bucket - LOAD_HIST_LINEAR) % LOAD_HIST_STEPS) << (exponent - 3);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: load_hist_add                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Records one sample.                                           //
+// Parameters: hist - Histogram                                               //
+//             us - Sample in microseconds                                    //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void load_hist_add(struct load_histogram *hist, uint64_t us){
+    hist->counts[load_hist_bucket(us)]++;
+    hist->total++;
+    if(us > hist->max_us)hist->max_us = us;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: load_hist_merge                                                  //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Adds a worker's histogram into the total.                     //
+// Parameters: total - Merged histogram                                       //
+//             hist - Worker histogram                                        //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void load_hist_merge(struct load_histogram *total, const struct load_histogram *hist){
+    for(int i = 0 ; i < LOAD_HIST_BUCKETS ; i++)total->counts[i] += hist->counts[i];
+    total->total += hist->total;
+    if(hist->max_us > total->max_us)total->max_us = hist->max_us;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: load_hist_percentile                                             //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Finds the bucket holding the p-th percentile sample.          //
+// Parameters: hist - Histogram                                               //
+//             percentile - 0 to 100                                          //
+// Returns: uint64_t - Lower bound of that bucket in microseconds             //
+////////////////////////////////////////////////////////////////////////////////
+uint64_t load_hist_percentile(const struct load_histogram *hist, double percentile){
+    long rank = (long)((hist->total - 1) * percentile / 100), seen = 0;
+    for(int i = 0 ; i < LOAD_HIST_BUCKETS ; i++){
+        seen += hist->counts[i];
+        if(seen > rank)return load_hist_value(i);
+    }
+    return hist->max_us;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: load_hist_report                                                 //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Prints a histogram folded to powers of two with a bar per     //
+//              row, then its percentiles as one JSON line for scripts.       //
+// Parameters: name - Histogram name                                          //
+//             hist - Histogram                                               //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void load_hist_report(const char *name, const struct load_histogram *hist){
+    long rows[64] = {0}, widest = 1;
+    int first = 64, last = -1;
+    if(hist->total == 0){
+        printf("{\"load\":\"%s\",\"count\":0}\n", name);
+        return;
+    }
+    for(int i = 0 ; i < LOAD_HIST_BUCKETS ; i++){
+        if(!hist->counts[i])continue;
+        uint64_t value = load_hist_value(i);
+        int row = value ? 64 - __builtin_clzll(value) : 0;  // [2^(row-1), 2^row)
+        rows[row] += hist->counts[i];
+        if(row < first)first = row;
+        if(row > last)last = row;
+    }
+    for(int row = first ; row <= last ; row++)if(rows[row] > widest)widest = rows[row];
+    printf("\n%s (microseconds)\n", name);
+    for(int row = first ; row <= last ; row++){
+        char bar[41];
+        int width = rows[row] * 40 / widest;
+        memset(bar, '#', width);
+        bar[width] = 0;
+        printf("  %9llu - %-9llu %9ld %6.2f%% %s\n", row ? 1ull << (row - 1) : 0ull, (1ull << row) - 1,
+               rows[row], 100.0 * rows[row] / hist->total, bar);
+    }
+    printf("{\"load\":\"%s\",\"count\":%ld,\"p50_us\":%llu,\"p90_us\":%llu,\"p99_us\":%llu,\"p999_us\":%llu,\"max_us\":%llu}\n",
+           name, hist->total, (unsigned long long)load_hist_percentile(hist, 50), (unsigned long long)load_hist_percentile(hist, 90),
+           (unsigned long long)load_hist_percentile(hist, 99), (unsigned long long)load_hist_percentile(hist, 99.9),
+           (unsigned long long)hist->max_us);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: load_schedule                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Sets the bot's only timer, replacing any earlier one: older   //
+//              heap entries are skipped when their generation is stale.      //
+// Parameters: worker - Owning worker                                         //
+//             bot - Bot to wake                                              //
+//             due_us - When to wake it                                       //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void load_schedule(struct load_worker *worker, struct load_bot *bot, uint64_t due_us){
+    if(worker->timer_count == worker->timer_capacity){
+        int capacity = worker->timer_capacity ? 2 * worker->timer_capacity : 2 * worker->bot_count + 16;
+        struct load_timer *timers = realloc(worker->timers, capacity * sizeof(*timers));
+        if(timers == NULL){
+            perror("realloc failed");
+            load_running = DEFAULT_STATUS;
+            return;
+        }
+        worker->timers = timers;
+        worker->timer_capacity = capacity;
+    }
+    int i = worker->timer_count++;
+    struct load_timer timer = { due_us, bot, ++bot->generation };
+    while(i > 0 && worker->timers[(i - 1) / 2].due_us > due_us){
+        worker->timers[i] = worker->timers[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    worker->timers[i] = timer;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: load_connect                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Starts a non-blocking connect, over the server's Unix socket  //
+//              when it is local; EPOLLOUT reports the result.                //
+// Parameters: worker - Owning worker                                         //
+//             bot - Idle bot                                                 //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void load_connect(struct load_worker *worker, struct load_bot *bot){
+    struct epoll_event event;
+    int enable = SET_VALUE;
+    bot->fd = socket(load_local ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if(bot->fd < 0){
+        worker->stats.connect_errors++;
+        load_schedule(worker, bot, load_now_us() + 1000000);
+        return;
+    }
+    if(!load_local)setsockopt(bot->fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    bot->started_us = load_now_us();
+    int status = load_local ? connect(bot->fd, (struct sockaddr *)&load_local_name, load_local_len) :
+                              connect(bot->fd, (struct sockaddr *)&load_address, sizeof(load_address));
+    if(status < 0 && errno != EINPROGRESS){  // A full Unix backlog fails with EAGAIN: retried
+        close(bot->fd);
+        bot->fd = -1;
+        worker->stats.connect_errors++;
+        load_schedule(worker, bot, load_now_us() + 1000000);
+        return;
+    }
+    bot->state = LOAD_CONNECTING;
+    memset(&bot->decoder, 0, sizeof(bot->decoder));
+    event.events = EPOLLOUT;
+    event.data.ptr = bot;
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, bot->fd, &event);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: load_connected                                                   //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Finishes a connect: records the setup time and sends the nick //
+//              name, or counts the failure and retries a second later.       //
+// Parameters: worker - Owning worker                                         //
+//             bot - Connecting bot                                           //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void load_connected(struct load_worker *worker, struct load_bot *bot){
+    struct epoll_event event;
+    unsigned char frame[FRAME_HEADER_SIZE + sizeof(bot->name)];
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    uint64_t now = load_now_us();
+    getsockopt(bot->fd, SOL_SOCKET, SO_ERROR, &error, &error_len);
+    size_t len = encode_frame(frame, PROTOCOL_VERSION, MSG_HELLO, bot->name, strlen(bot->name));
+    if(error || write(bot->fd, frame, len) != (ssize_t)len){
+        close(bot->fd);
+        bot->fd = -1;
+        bot->state = LOAD_IDLE;
+        worker->stats.connect_errors++;
+        load_schedule(worker, bot, now + 1000000);
+        return;
+    }
+    load_hist_add(&worker->stats.connect, now - bot->started_us);
+    __atomic_add_fetch(&worker->stats.connects, 1, __ATOMIC_RELAXED);
+    bot->started_us = now;
+    bot->state = LOAD_PAIRING;
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.ptr = bot;
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, bot->fd, &event);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: load_start_match                                                 //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Deals the bot a fresh card of the configured shape and, for   //
+//              the first mover, schedules its first move.                    //
+// Parameters: worker - Owning worker                                         //
+//             bot - Paired bot                                               //
+//             size, max_number - Card config of the match                    //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void load_start_match(struct load_worker *worker, struct load_bot *bot, int size, int max_number){
+    if(bot->card.max_number != max_number){
+        free(bot->pool);
+        free(bot->position);
+        bot->pool = malloc(max_number * sizeof(uint16_t));
+        bot->position = malloc((max_number + 1) * sizeof(uint16_t));
+    }
+    if(bot->pool == NULL || bot->position == NULL || bingo_card_init(&bot->card, size, max_number)){
+        bot->card.max_number = 0;
+        worker->stats.protocol_errors++;
+        load_end(worker, bot, NULL);
+        return;
+    }
+    bingo_card_generate(&bot->card, bingo_rng_next(&worker->rng));
+    for(int i = 0 ; i < max_number ; i++){
+        bot->pool[i] = i + 1;
+        bot->position[i + 1] = i;
+    }
+    bot->remaining = max_number;
+    bot->peer_stamp = 0;
+    bot->state = LOAD_PLAYING;
+    bot->my_turn = bot->role == 2;
+    if(bot->my_turn)load_schedule(worker, bot, load_now_us() + load_think_ms * (500 + bingo_rng_below(&worker->rng, 1001)));
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: load_called                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Marks a called number on the card and takes it out of the     //
+//              pool of legal moves.                                          //
+// Parameters: bot - Playing bot                                              //
+//             number - Called number                                         //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void load_called(struct load_bot *bot, int number){
+    if(number < 1 || number > bot->card.max_number)return;
+    int index = bot->position[number];
+    if(index >= bot->remaining || bot->pool[index] != number)return;
+    int last = bot->pool[--bot->remaining];
+    bot->pool[index] = last;
+    bot->position[last] = index;
+    bingo_card_mark(&bot->card, number);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: load_send                                                        //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Sends MSG_MOVE or MSG_WIN. The payload carries the number,    //
+//              our send time and the opponent's last stamp moved on by how   //
+//              long we held it, so the opponent reads its round trip off     //
+//              its own clock. The server relays the extra bytes untouched.   //
+// Parameters: worker - Owning worker                                         //
+//             bot - Playing bot                                              //
+//             type - MSG_MOVE or MSG_WIN                                     //
+//             number - Number to send                                        //
+// Returns: int - 0 on success, -1 on a failed write                          //
+////////////////////////////////////////////////////////////////////////////////
+int load_send(struct load_worker *worker, struct load_bot *bot, int type, int number){
+    unsigned char payload[LOAD_MOVE_PAYLOAD], frame[FRAME_HEADER_SIZE + LOAD_MOVE_PAYLOAD];
+    uint64_t now = load_now_us();
+    uint64_t echo = bot->peer_stamp ? bot->peer_stamp + (now - bot->peer_stamp_at) : 0;
+    payload[0] = number >> 8;
+    payload[1] = number & 0xff;
+    for(int b = 0 ; b < 8 ; b++){
+        payload[2 + b] = now >> (56 - 8*b);
+        payload[10 + b] = echo >> (56 - 8*b);
+    }
+    size_t len = encode_frame(frame, PROTOCOL_VERSION, type, payload, sizeof(payload));
+    if(write(bot->fd, frame, len) != (ssize_t)len)return -1;
+    __atomic_add_fetch(&worker->stats.moves, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: load_move                                                        //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Plays a random number not called yet. A move that completes   //
+//              the card is sent as MSG_WIN and ends the match, like the      //
+//              interactive client does.                                      //
+// Parameters: worker - Owning worker                                         //
+//             bot - Bot whose turn it is                                     //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void load_move(struct load_worker *worker, struct load_bot *bot){
+    if(bot->remaining == 0){
+        worker->stats.protocol_errors++;
+        load_end(worker, bot, NULL);
+        return;
+    }
+    int number = bot->pool[bingo_rng_below(&worker->rng, bot->remaining)];
+    load_called(bot, number);
+    int won = bingo_card_lines(&bot->card) >= LINES_TO_WIN(&bot->card);
+    if(load_send(worker, bot, won ? MSG_WIN : MSG_MOVE, number) < 0){
+        worker->stats.disconnects++;
+        load_end(worker, bot, NULL);
+        return;
+    }
+    bot->my_turn = DEFAULT_STATUS;
+    if(won)load_end(worker, bot, &worker->stats.games);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: load_frame                                                       //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Handles one frame from the server: pairing, the card config   //
+//              and the opponent's moves, which yield a round-trip sample     //
+//              when they echo one of our stamps. Other types, such as the    //
+//              resume token, are skipped like the client does.               //
+// Parameters: worker - Owning worker                                         //
+//             bot - Receiving bot                                            //
+//             frame - Decoded frame                                          //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void load_frame(struct load_worker *worker, struct load_bot *bot, const struct bingo_frame *frame){
+    uint64_t now = load_now_us();
+    if(frame->type == MSG_PING)return;
+    if(bot->state == LOAD_PAIRING){
+        if(frame->type != MSG_PAIRED || frame->length < 1 || (frame->payload[0] != 1 && frame->payload[0] != 2)){
+            worker->stats.protocol_errors++;
+            load_end(worker, bot, NULL);
+            return;
+        }
+        load_hist_add(&worker->stats.pairing, now - bot->started_us);
+        bot->role = frame->payload[0];
+        if(frame->version >= 2)bot->state = LOAD_CONFIG;
+        else load_start_match(worker, bot, BINGO_CARD_SIZE, MAX_NUMBER);
+        return;
+    }
+    if(bot->state == LOAD_CONFIG){
+        int size = frame->length >= 3 ? frame->payload[0] : 0;
+        int max_number = frame->length >= 3 ? (frame->payload[1] << 8) | frame->payload[2] : 0;
+        if(frame->type != MSG_CONFIG || !valid_card_config(size, max_number)){
+            worker->stats.protocol_errors++;
+            load_end(worker, bot, NULL);
+            return;
+        }
+        load_start_match(worker, bot, size, max_number);
+        return;
+    }
+    if(frame->type == MSG_WIN){
+        load_end(worker, bot, &worker->stats.games);
+    }else if(frame->type == MSG_TIMEOUT){
+        load_end(worker, bot, &worker->stats.timeouts);
+    }else if(frame->type == MSG_QUIT){
+        load_end(worker, bot, &worker->stats.peer_quits);
+    }else if(frame->type == MSG_MOVE && !bot->my_turn && frame->length >= 2){
+        if(frame->length >= LOAD_MOVE_PAYLOAD){
+            uint64_t stamp = 0, echo = 0;
+            for(int b = 0 ; b < 8 ; b++){
+                stamp = stamp << 8 | frame->payload[2 + b];
+                echo = echo << 8 | frame->payload[10 + b];
+            }
+            if(echo && echo <= now)load_hist_add(&worker->stats.rtt, now - echo);
+            bot->peer_stamp = stamp;
+            bot->peer_stamp_at = now;
+        }
+        int number = frame_number(frame);
+        load_called(bot, number);
+        if(bingo_card_lines(&bot->card) >= LINES_TO_WIN(&bot->card)){
+            if(load_send(worker, bot, MSG_WIN, number) < 0)worker->stats.disconnects++;
+            load_end(worker, bot, &worker->stats.games);
+            return;
+        }
+        bot->my_turn = SET_VALUE;
+        load_schedule(worker, bot, now + load_think_ms * (500 + bingo_rng_below(&worker->rng, 1001)));
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: load_read                                                        //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Reads what the server sent and handles every whole frame. A   //
+//              close by the server while the bot is still in a match counts  //
+//              as a disconnect, except once the load is stopping and another //
+//              worker has already closed the opponent.                       //
+// Parameters: worker - Owning worker                                         //
+//             bot - Readable bot                                             //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void load_read(struct load_worker *worker, struct load_bot *bot){
+    struct bingo_frame frame;
+    size_t available;
+    unsigned char *space = frame_decoder_space(&bot->decoder, &available);
+    ssize_t bytes_read = read(bot->fd, space, available);
+    if(bytes_read < 0 && (errno == EAGAIN || errno == EINTR))return;
+    if(bytes_read <= 0){
+        if(load_running && load_now_us() < load_stop_us)worker->stats.disconnects++;  // Not a peer worker stopping
+        load_end(worker, bot, NULL);
+        return;
+    }
+    bot->decoder.end += bytes_read;
+    int status;
+    while(bot->fd >= 0 && (status = frame_decoder_next(&bot->decoder, &frame)) == FRAME_READY)
+        load_frame(worker, bot, &frame);
+    if(bot->fd >= 0 && status == FRAME_ERROR){
+        worker->stats.protocol_errors++;
+        load_end(worker, bot, NULL);
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: load_end                                                         //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Ends the bot's match and connection, counts the outcome and   //
+//              schedules its next match after one think time.                //
+// Parameters: worker - Owning worker                                         //
+//             bot - Bot whose match is over                                  //
+//             counter - Outcome counter to bump, NULL if already counted     //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void load_end(struct load_worker *worker, struct load_bot *bot, long *counter){
+    if(counter)__atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+    if(bot->fd >= 0)close(bot->fd);
+    bot->fd = -1;
+    bot->state = LOAD_IDLE;
+    bot->my_turn = DEFAULT_STATUS;
+    load_schedule(worker, bot, load_now_us() + load_think_ms * 1000ull);
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: load_worker_main                                                 //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Runs one worker: its share of the bots starts at the ramp-up  //
+//              rate (bot i of all at i / ramp seconds), then the epoll loop  //
+//              serves sockets and fires the earliest timers until the load   //
+//              stops.                                                        //
+// Parameters: arg - The worker's load_worker                                 //
+// Returns: void * - NULL                                                     //
+////////////////////////////////////////////////////////////////////////////////
+void *load_worker_main(void *arg){
+    struct load_worker *worker = arg;
+    struct epoll_event events[LOAD_MAX_EVENTS];
+    worker->bot_count = load_players / load_threads + (worker->index < load_players % load_threads);
+    worker->bots = calloc(worker->bot_count, sizeof(*worker->bots));
+    worker->epoll_fd = epoll_create1(0);
+    if(worker->bots == NULL || worker->epoll_fd < 0){
+        perror("Worker setup failed");
+        free(worker->bots);
+        return NULL;
+    }
+    for(int i = 0 ; i < worker->bot_count ; i++){
+        struct load_bot *bot = &worker->bots[i];
+        int id = i * load_threads + worker->index;
+        bot->fd = -1;
+        snprintf(bot->name, sizeof(bot->name), "load%d", id);
+        load_schedule(worker, bot, load_start_us + id * 1000000ull / load_ramp);
+    }
+    while(load_running){
+        uint64_t now = load_now_us();
+        if(now >= load_stop_us)break;
+        while(worker->timer_count && worker->timers[0].due_us <= now){
+            struct load_timer timer = worker->timers[0];
+            struct load_timer last = worker->timers[--worker->timer_count];
+            int i = 0;
+            while(2*i + 1 < worker->timer_count){
+                int child = 2*i + 1;
+                if(child + 1 < worker->timer_count && worker->timers[child + 1].due_us < worker->timers[child].due_us)child++;
+                if(worker->timers[child].due_us >= last.due_us)break;
+                worker->timers[i] = worker->timers[child];
+                i = child;
+            }
+            if(worker->timer_count)worker->timers[i] = last;
+            if(timer.generation != timer.bot->generation)continue;
+            if(timer.bot->state == LOAD_IDLE)load_connect(worker, timer.bot);
+            else if(timer.bot->state == LOAD_PLAYING && timer.bot->my_turn)load_move(worker, timer.bot);
+        }
+        int wait = worker->timer_count ? (int)((worker->timers[0].due_us - now + 999) / 1000) : 100;
+        if(wait > 100)wait = 100;
+        int ready = epoll_wait(worker->epoll_fd, events, LOAD_MAX_EVENTS, wait);
+        for(int i = 0 ; i < ready ; i++){
+            struct load_bot *bot = events[i].data.ptr;
+            if(bot->fd < 0)continue;
+            if(bot->state == LOAD_CONNECTING)load_connected(worker, bot);
+            else load_read(worker, bot);
+        }
+    }
+    for(int i = 0 ; i < worker->bot_count ; i++){
+        struct load_bot *bot = &worker->bots[i];
+        if(bot->state == LOAD_PAIRING)worker->stats.unpaired++;
+        if(bot->fd >= 0)close(bot->fd);
+        bingo_card_free(&bot->card);
+        free(bot->pool);
+        free(bot->position);
+    }
+    close(worker->epoll_fd);
+    free(worker->timers);
+    free(worker->bots);
+    return NULL;
+}
@@ -0,0 +1,470 @@
+////////////////////////////////////////////////////////////////////////////////
+// REPLAY TOOL DESCRIPTION                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Reads the game recordings written by bingo_2_0.c (Player 1, "--server      //
+// --record" and "--simulate --record"). "show" rebuilds one match from its   //
+// two card seeds and prints every call with its timing and both cards.       //
+// "stats" maps any number of recording files, cuts them into chunks of       //
+// REPLAY_CHUNK_RECORDS records and replays the chunks on worker threads: it  //
+// reports outcomes, match length, time per call, the first mover's win rate  //
+// for every opening number, and checks each recorded winner against the      //
+// cards rebuilt from the seeds. The last line repeats the totals as JSON.    //
+////////////////////////////////////////////////////////////////////////////////
+// Build: gcc -O2 bingo_replay.c -o bingo_replay -pthread                     //
+// Usage: ./bingo_replay show <file> <n>                                      //
+//        ./bingo_replay stats [--threads N] [--top N] <file>...              //
+////////////////////////////////////////////////////////////////////////////////
+
+#define BINGO_NO_MAIN
+#include "bingo_2_0.c"
+
+////////////////////////////////////////////////////////////////////////////////
+// MACROS FOR REPLAY TOOL                                                     //
+////////////////////////////////////////////////////////////////////////////////
+#define REPLAY_MAX_THREADS 256 // Upper bound on worker threads
+#define REPLAY_TOP 10          // Opening numbers listed by default
+#define REPLAY_CHUNK_RECORDS 4096 // Records handed to a worker at a time
+#define REPLAY_MIN_OPENING 30  // Games an opening needs before it is ranked
+
+#define REPLAY_VERIFIED 0      // Replayed winner and length match the record
+#define REPLAY_MISMATCH 1      // Replayed cards disagree with the record
+#define REPLAY_NO_LINE 2       // Winner without BINGO: a time-out
+#define REPLAY_NO_SEEDS 3      // A seed was never revealed
+#define REPLAY_RESULTS 4
+
+////////////////////////////////////////////////////////////////////////////////
+// STRUCTURES FOR REPLAY TOOL                                                 //
+////////////////////////////////////////////////////////////////////////////////
+struct replay_file{
+    const char *path;                    // File name
+    const unsigned char *data;           // Mapped file
+    size_t size;                         // Bytes mapped
+};
+
+struct replay_chunk{
+    const unsigned char *data;           // First record of the chunk
+    size_t len;                          // Bytes of whole records
+};
+
+struct replay_stats{
+    long games;                          // Records replayed
+    long corrupt;                        // Records record_decode() refused
+    long wins[RECORD_NO_WINNER + 1];     // Outcomes by RECORD_* winner
+    long results[REPLAY_RESULTS];        // Verification by REPLAY_* result
+    long calls;                          // Calls over all games
+    long timed_calls;                    // Calls with a time from the previous one
+    uint64_t think_ms;                   // Sum of those times
+    long opening_games[MAX_CARD_NUMBER + 1]; // Games by first number called
+    long opening_wins[MAX_CARD_NUMBER + 1];  // Of those, won by the first mover
+};
+
+struct replay_worker{
+    pthread_t thread;                    // Worker thread
+    struct replay_stats stats;           // Results, merged after join
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION DECLARATIONS FOR REPLAY TOOL                                      //
+////////////////////////////////////////////////////////////////////////////////
+int    replay_map(struct replay_file *,const char *);           // Maps a file
+size_t replay_skip(const unsigned char *,size_t);               // Record length
+int    replay_game(struct bingo_card *,const struct game_record *,int *); // Winner
+int    replay_verify(struct bingo_card *,const struct game_record *); // REPLAY_*
+int    replay_show(const char *,long);                          // "show"
+int    replay_stats(int,char **);                               // "stats"
+void  *replay_worker_main(void *);                              // Worker thread
+void   replay_print_card(const struct bingo_card *,const char *); // One card
+
+////////////////////////////////////////////////////////////////////////////////
+// GLOBAL VARIABLES FOR REPLAY TOOL                                           //
+////////////////////////////////////////////////////////////////////////////////
+struct replay_chunk *replay_chunks;   // Work of all files
+long replay_chunk_count;              // Entries in replay_chunks
+long replay_next_chunk;               // Next chunk to take, shared by the workers
+
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: main                                                             //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Runs the "show" or "stats" command.                           //
+// Parameters: argc, argv - Command line arguments                            //
+// Returns: int - Exit status (0 for success)                                 //
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char *argv[]){
+    if(argc == 4 && strcmp(argv[1],"show") == 0)return replay_show(argv[2], atol(argv[3]));
+    if(argc > 2 && strcmp(argv[1],"stats") == 0)return replay_stats(argc - 2, argv + 2);
+    printf("Usage: %s show <file> <n>\n       %s stats [--threads 1-%d] [--top N] <file>...\n",
+           argv[0], argv[0], REPLAY_MAX_THREADS);
+    return 1;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: replay_map                                                       //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Maps a recording file read-only and checks its magic. A torn  //
+//              record at the end (a writer stopped mid-write) is left out.   //
+// Parameters: file - Receives the mapping                                    //
+//             path - Recording file                                          //
+// Returns: int - 0 on success, 1 on failure                                  //
+////////////////////////////////////////////////////////////////////////////////
+int replay_map(struct replay_file *file, const char *path){
+    struct stat file_stat;
+    int fd = open(path, O_RDONLY);
+    memset(file, 0, sizeof(*file));
+    file->path = path;
+    if(fd < 0 || fstat(fd, &file_stat) < 0){
+        perror(path);
+        if(fd >= 0)close(fd);
+        return 1;
+    }
+    file->size = file_stat.st_size;
+    if(file->size < RECORD_MAGIC_SIZE ||
+       (file->data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED){
+        printf("%s : not a recording\n", path);
+        close(fd);
+        file->data = NULL;
+        return 1;
+    }
+    close(fd);
+    madvise((void *)file->data, file->size, MADV_SEQUENTIAL);
+    if(memcmp(file->data, RECORD_FILE_MAGIC, RECORD_MAGIC_SIZE) != 0){
+        printf("%s : not a recording\n", path);
+        munmap((void *)file->data, file->size);
+        file->data = NULL;
+        return 1;
+    }
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: replay_skip                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Finds the length of the record at the start of a buffer       //
+//              without decoding it, which is all that cutting files into     //
+//              chunks needs.                                                 //
+// Parameters: data, len - Bytes available                                    //
+// Returns: size_t - Record length, 0 if truncated or corrupt                 //
+////////////////////////////////////////////////////////////////////////////////
+size_t replay_skip(const unsigned char *data, size_t len){
+    size_t pos = 5, used;
+    uint64_t value;
+    if(len < pos || data[0] != RECORD_MARK)return 0;
+    int wide = ((data[3] << 8) | data[4]) > 0xff;
+    if(!(used = record_get_varint(data + pos, len - pos, &value)))return 0;
+    pos += used + 8 * PLAYERS_SIZE;
+    if(pos > len || !(used = record_get_varint(data + pos, len - pos, &value)) || value > MAX_CARD_NUMBER)return 0;
+    pos += used;
+    for(uint64_t i = 0 ; i < value ; i++){
+        pos += 1 + wide;
+        while(pos < len && data[pos] & 0x80)pos++;
+        if(++pos > len)return 0;
+    }
+    return pos;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: replay_game                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Rebuilds both cards from their seeds and plays the calls in   //
+//              order. As in a live match, the caller of a number claims      //
+//              BINGO before the opponent marking it.                         //
+// Parameters: cards - Two cards sized for the record's config                //
+//             record - Decoded match with both seeds                         //
+//             at - Receives the 1-based call that decided it, 0 if none      //
+// Returns: int - RECORD_FIRST_MOVER, RECORD_SECOND_MOVER or RECORD_NO_WINNER //
+////////////////////////////////////////////////////////////////////////////////
+int replay_game(struct bingo_card *cards, const struct game_record *record, int *at){
+    for(int p = 0 ; p < PLAYERS_SIZE ; p++)bingo_card_generate(&cards[p], record->seeds[p]);
+    for(int i = 0 ; i < record->call_count ; i++){
+        int caller = i % PLAYERS_SIZE;
+        for(int k = 0 ; k < PLAYERS_SIZE ; k++)bingo_card_mark(&cards[k], record->calls[i]);
+        for(int k = 0 ; k < PLAYERS_SIZE ; k++){
+            int p = (caller + k) % PLAYERS_SIZE;
+            if(bingo_card_lines(&cards[p]) >= LINES_TO_WIN(&cards[p])){
+                *at = i + 1;
+                return p;
+            }
+        }
+    }
+    *at = 0;
+    return RECORD_NO_WINNER;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: replay_verify                                                    //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Checks a record's winner against its replayed cards.          //
+// Parameters: cards - Two cards sized for the record's config                //
+//             record - Decoded match                                         //
+// Returns: int - REPLAY_* result                                             //
+////////////////////////////////////////////////////////////////////////////////
+int replay_verify(struct bingo_card *cards, const struct game_record *record){
+    int at;
+    if(!record->seeds[RECORD_FIRST_MOVER] || !record->seeds[RECORD_SECOND_MOVER])return REPLAY_NO_SEEDS;
+    int winner = replay_game(cards, record, &at);
+    if(winner == RECORD_NO_WINNER)return record->winner == RECORD_NO_WINNER ? REPLAY_VERIFIED : REPLAY_NO_LINE;
+    return winner == record->winner && at == record->call_count ? REPLAY_VERIFIED : REPLAY_MISMATCH;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: replay_print_card                                                //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Prints a card with its marked cells as X.                     //
+// Parameters: card - Card to print                                           //
+//             title - Line printed above it                                  //
+// Returns: void                                                              //
+////////////////////////////////////////////////////////////////////////////////
+void replay_print_card(const struct bingo_card *card, const char *title){
+    int width = card->max_number > 999 ? 5 : card->max_number > 99 ? 4 : 3;
+    printf("%s, %d lines\n", title, bingo_card_lines(card));
+    for(int row = 0 ; row < card->size ; row++){
+        for(int col = 0 ; col < card->size ; col++){
+            int number = bingo_card_number(card, row * card->size + col);
+            if(number)printf("%*d", width, number);
+            else printf("%*s", width, "X");
+        }
+        printf("\n");
+    }
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: replay_show                                                      //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Prints match n (from 1) of a recording call by call, then     //
+//              both cards as they ended and whether the replay agrees.       //
+// Parameters: path - Recording file                                          //
+//             n - Match to show                                              //
+// Returns: int - Exit status (0 for success)                                 //
+////////////////////////////////////////////////////////////////////////////////
+int replay_show(const char *path, long n){
+    struct replay_file file;
+    struct game_record record;
+    struct bingo_card cards[PLAYERS_SIZE];
+    uint16_t calls[MAX_CARD_NUMBER];
+    uint32_t call_ms[MAX_CARD_NUMBER];
+    size_t pos = RECORD_MAGIC_SIZE, len = 0;
+    long found = 0;
+    static const char *names[] = { "first mover (Player 2)", "second mover (Player 1)", "nobody" };
+
+    if(replay_map(&file, path))return 1;
+    while(pos < file.size && (len = replay_skip(file.data + pos, file.size - pos)) && ++found < n)pos += len;
+    record.calls = calls;
+    record.call_ms = call_ms;
+    if(n < 1 || found != n || !record_decode(file.data + pos, len, &record)){
+        printf("%s has no match %ld\n", path, n);
+        return 1;
+    }
+    time_t start = record.start;
+    printf("Match %ld of %s : %dx%d cards, numbers 1-%d, started %s", n, path, record.card_size, record.card_size,
+           record.max_number, ctime(&start));
+    printf("Seeds : first mover %016llx, second mover %016llx\n", (unsigned long long)record.seeds[0],
+           (unsigned long long)record.seeds[1]);
+    memset(cards, 0, sizeof(cards));
+    int replayable = record.seeds[0] && record.seeds[1];
+    for(int p = 0 ; p < PLAYERS_SIZE ; p++){
+        if(bingo_card_init(&cards[p], record.card_size, record.max_number)){
+            perror("Card allocation failed");
+            return 1;
+        }
+        bingo_card_generate(&cards[p], record.seeds[p]);
+    }
+    for(int i = 0 ; i < record.call_count ; i++){
+        printf("%4d  %-6s calls %4d  %+8ld ms", i + 1, i % PLAYERS_SIZE ? "second" : "first", calls[i],
+               (long)call_ms[i] - (i ? (long)call_ms[i-1] : 0));
+        for(int p = 0 ; p < PLAYERS_SIZE ; p++)bingo_card_mark(&cards[p], calls[i]);
+        if(replayable)printf("  lines %d / %d", bingo_card_lines(&cards[0]), bingo_card_lines(&cards[1]));
+        printf("\n");
+    }
+    printf("Recorded winner : %s after %d calls\n", names[record.winner], record.call_count);
+    if(!replayable){
+        printf("A card seed was never revealed, the cards cannot be rebuilt\n");
+        return 0;
+    }
+    replay_print_card(&cards[0], "First mover's card");
+    replay_print_card(&cards[1], "Second mover's card");
+    int at, winner = replay_game(cards, &record, &at);
+    if(winner == RECORD_NO_WINNER)printf("Replay : nobody has BINGO%s\n", record.winner == RECORD_NO_WINNER ? "" : ", decided by a time-out");
+    else printf("Replay : %s has BINGO on call %d, %s\n", names[winner], at,
+                winner == record.winner && at == record.call_count ? "matches the record" : "DOES NOT match the record");
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: replay_stats                                                     //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Maps every file, cuts them into chunks of whole records, runs //
+//              the workers over the chunks and prints the merged statistics. //
+// Parameters: argc, argv - Options and files after "stats"                   //
+// Returns: int - Exit status (0 for success)                                 //
+////////////////////////////////////////////////////////////////////////////////
+int replay_stats(int argc, char **argv){
+    int threads = sysconf(_SC_NPROCESSORS_ONLN), top = REPLAY_TOP, file_count = 0;
+    long chunk_capacity = 0, torn = 0;
+    size_t bytes = 0;
+    struct timespec start, end;
+    struct replay_file *files = calloc(argc, sizeof(*files));
+    if(files == NULL){
+        perror("calloc failed");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int i = 0 ; i < argc ; i++){
+        if(i + 1 < argc && strcmp(argv[i],"--threads") == 0)threads = atoi(argv[++i]);
+        else if(i + 1 < argc && strcmp(argv[i],"--top") == 0)top = atoi(argv[++i]);
+        else if(replay_map(&files[file_count], argv[i]) == 0)file_count++;
+    }
+    if(threads < 1 || threads > REPLAY_MAX_THREADS || top < 0 || file_count == 0){
+        printf("Usage: stats [--threads 1-%d] [--top N] <file>...\n", REPLAY_MAX_THREADS);
+        return 1;
+    }
+    for(int f = 0 ; f < file_count ; f++){
+        struct replay_file *file = &files[f];
+        size_t pos = RECORD_MAGIC_SIZE, len;
+        while(pos < file->size){
+            size_t chunk_start = pos;
+            for(int r = 0 ; r < REPLAY_CHUNK_RECORDS && pos < file->size ; r++, pos += len)
+                if(!(len = replay_skip(file->data + pos, file->size - pos)))break;
+            if(pos > chunk_start){
+                if(replay_chunk_count == chunk_capacity){
+                    chunk_capacity = chunk_capacity ? 2 * chunk_capacity : 1024;
+                    struct replay_chunk *chunks = realloc(replay_chunks, chunk_capacity * sizeof(*chunks));
+                    if(chunks == NULL){
+                        perror("realloc failed");
+                        return 1;
+                    }
+                    replay_chunks = chunks;
+                }
+                replay_chunks[replay_chunk_count].data = file->data + chunk_start;
+                replay_chunks[replay_chunk_count++].len = pos - chunk_start;
+            }
+            if(pos < file->size && !len)break;
+        }
+        bytes += pos;
+        if(pos < file->size){
+            printf("%s : %zu bytes after offset %zu are not a whole record, skipped\n", file->path, file->size - pos, pos);
+            torn++;
+        }
+    }
+
+    struct replay_worker *workers = calloc(threads, sizeof(*workers));
+    struct replay_stats *total = calloc(1, sizeof(*total));
+    if(workers == NULL || total == NULL){
+        perror("calloc failed");
+        return 1;
+    }
+    for(int i = 0 ; i < threads ; i++)pthread_create(&workers[i].thread, NULL, replay_worker_main, &workers[i]);
+    for(int i = 0 ; i < threads ; i++){
+        struct replay_stats *stats = &workers[i].stats;
+        pthread_join(workers[i].thread, NULL);
+        total->games += stats->games;
+        total->corrupt += stats->corrupt;
+        total->calls += stats->calls;
+        total->timed_calls += stats->timed_calls;
+        total->think_ms += stats->think_ms;
+        for(int w = 0 ; w <= RECORD_NO_WINNER ; w++)total->wins[w] += stats->wins[w];
+        for(int r = 0 ; r < REPLAY_RESULTS ; r++)total->results[r] += stats->results[r];
+        for(int number = 0 ; number <= MAX_CARD_NUMBER ; number++){
+            total->opening_games[number] += stats->opening_games[number];
+            total->opening_wins[number] += stats->opening_wins[number];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    free(workers);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    long games = total->games ? total->games : 1;
+    long decided = total->wins[RECORD_FIRST_MOVER] + total->wins[RECORD_SECOND_MOVER];
+    printf("Replayed %ld matches from %d file%s (%.1f MB) in %.3f s, %d threads | %.0f matches per second\n",
+           total->games, file_count, file_count == 1 ? "" : "s", bytes / 1e6, seconds, threads, total->games / seconds);
+    if(total->corrupt || torn)printf("Corrupt records %ld, files with a torn tail %ld\n", total->corrupt, torn);
+    printf("Outcomes : first mover %ld (%.4f), second mover %ld (%.4f), no winner %ld\n",
+           total->wins[RECORD_FIRST_MOVER], (double)total->wins[RECORD_FIRST_MOVER] / games,
+           total->wins[RECORD_SECOND_MOVER], (double)total->wins[RECORD_SECOND_MOVER] / games, total->wins[RECORD_NO_WINNER]);
+    printf("Mean length : %.2f calls", (double)total->calls / games);
+    if(total->timed_calls)printf(" | mean time per call : %.0f ms", (double)total->think_ms / total->timed_calls);
+    printf("\nWinners checked against the replayed cards : %ld agree, %ld disagree, %ld decided by a time-out,"
+           " %ld without both seeds\n", total->results[REPLAY_VERIFIED], total->results[REPLAY_MISMATCH],
+           total->results[REPLAY_NO_LINE], total->results[REPLAY_NO_SEEDS]);
+
+    int ranked[MAX_CARD_NUMBER], ranked_count = 0;
+    for(int number = 1 ; number <= MAX_CARD_NUMBER ; number++)
+        if(total->opening_games[number] >= REPLAY_MIN_OPENING)ranked[ranked_count++] = number;
+    for(int i = 1 ; i < ranked_count ; i++){  // Insertion sort on win rate, at most MAX_CARD_NUMBER entries
+        int number = ranked[i], k = i;
+        double rate = (double)total->opening_wins[number] / total->opening_games[number];
+        while(k > 0 && (double)total->opening_wins[ranked[k-1]] / total->opening_games[ranked[k-1]] < rate){
+            ranked[k] = ranked[k-1];
+            k--;
+        }
+        ranked[k] = number;
+    }
+    if(ranked_count && top){
+        printf("Opening numbers by first mover win rate (at least %d matches) :\n", REPLAY_MIN_OPENING);
+        for(int i = 0 ; i < ranked_count && i < top ; i++)
+            printf("  %4d : %.4f over %ld matches\n", ranked[i],
+                   (double)total->opening_wins[ranked[i]] / total->opening_games[ranked[i]], total->opening_games[ranked[i]]);
+        if(ranked_count > top)printf("  ..\n  %4d : %.4f (lowest)\n", ranked[ranked_count-1],
+                                     (double)total->opening_wins[ranked[ranked_count-1]] / total->opening_games[ranked[ranked_count-1]]);
+    }
+    printf("{\"matches\":%ld,\"first_mover_wins\":%ld,\"second_mover_wins\":%ld,\"no_winner\":%ld,\"decided\":%ld,"
+           "\"mean_calls\":%.3f,\"verified\":%ld,\"mismatched\":%ld,\"timeouts\":%ld,\"unverifiable\":%ld,"
+           "\"corrupt\":%ld,\"seconds\":%.3f,\"matches_per_second\":%.0f}\n",
+           total->games, total->wins[RECORD_FIRST_MOVER], total->wins[RECORD_SECOND_MOVER], total->wins[RECORD_NO_WINNER],
+           decided, (double)total->calls / games, total->results[REPLAY_VERIFIED], total->results[REPLAY_MISMATCH],
+           total->results[REPLAY_NO_LINE], total->results[REPLAY_NO_SEEDS], total->corrupt, seconds, total->games / seconds);
+    free(total);
+    for(int f = 0 ; f < file_count ; f++)munmap((void *)files[f].data, files[f].size);
+    free(files);
+    free(replay_chunks);
+    return 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+// FUNCTION: replay_worker_main                                               //
+////////////////////////////////////////////////////////////////////////////////
+// Description: Worker thread body. Takes chunks until none are left, decodes //
+//              and replays every record into its own stats block, and keeps  //
+//              two cards that are only resized when the card config changes. //
+// Parameters: arg - struct replay_worker of this thread                      //
+// Returns: void * - NULL                                                     //
+////////////////////////////////////////////////////////////////////////////////
+void *replay_worker_main(void *arg){
+    struct replay_stats *stats = &((struct replay_worker *)arg)->stats;
+    struct bingo_card cards[PLAYERS_SIZE];
+    struct game_record record;
+    uint16_t calls[MAX_CARD_NUMBER];
+    uint32_t call_ms[MAX_CARD_NUMBER];
+    int card_size = 0, max_number = 0;
+    long chunk;
+
+    memset(cards, 0, sizeof(cards));
+    record.calls = calls;
+    record.call_ms = call_ms;
+    while((chunk = __atomic_fetch_add(&replay_next_chunk, 1, __ATOMIC_RELAXED)) < replay_chunk_count){
+        const unsigned char *data = replay_chunks[chunk].data;
+        size_t len = replay_chunks[chunk].len, pos = 0, used;
+        for( ; pos < len ; pos += used){
+            if(!(used = record_decode(data + pos, len - pos, &record))){
+                stats->corrupt++;  // Whole but unreadable
+                if(!(used = replay_skip(data + pos, len - pos)))break;
+                continue;
+            }
+            stats->games++;
+            stats->wins[record.winner]++;
+            stats->calls += record.call_count;
+            if(record.call_count > 1 && record.call_ms[record.call_count - 1]){
+                stats->timed_calls += record.call_count - 1;
+                stats->think_ms += record.call_ms[record.call_count - 1] - record.call_ms[0];
+            }
+            if(record.call_count){
+                stats->opening_games[record.calls[0]]++;
+                stats->opening_wins[record.calls[0]] += record.winner == RECORD_FIRST_MOVER;
+            }
+            if(record.card_size != card_size || record.max_number != max_number){
+                for(int p = 0 ; p < PLAYERS_SIZE ; p++){
+                    bingo_card_free(&cards[p]);
+                    if(bingo_card_init(&cards[p], record.card_size, record.max_number)){
+                        perror("Card allocation failed");
+                        exit(1);
+                    }
+                }
+                card_size = record.card_size;
+                max_number = record.max_number;
+            }
+            stats->results[replay_verify(cards, &record)]++;
+        }
+    }
+    for(int p = 0 ; p < PLAYERS_SIZE ; p++)bingo_card_free(&cards[p]);
+    return NULL;
+}